@@ -0,0 +1,172 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "batch.h"
+#include "decoder.h"
+#include "parser.h"
+#include "program_image.h"
+#include "work_pool.h"
+#include <dirent.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// Status of a trace that loaded but whose engine failed, e.g. on an
+// invalid predictor or cache configuration
+#define BATCH_ERR_ENGINE -16
+
+// Result of simulating one trace
+typedef struct {
+    int status;          // LOAD_* code or BATCH_ERR_ENGINE
+    tick_t instructions;
+    tick_t cycles;
+    addr_t PC;
+    uint64_t state_hash; // core_state_hash of the final state
+} batch_record_t;
+
+typedef struct {
+    char **traces;
+    size_t num_traces;
+    engine_t engine;
+    const engine_config_t *config;
+    batch_record_t *records;
+} batch_t;
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int append_trace(batch_t *batch, size_t *capacity, const char *path) {
+    if (batch->num_traces == *capacity) {
+        size_t new_capacity = *capacity ? *capacity * 2 : 64;
+        char **traces = (char **)realloc(batch->traces, new_capacity * sizeof(char *));
+        if (traces == NULL)
+            return -1;
+        batch->traces = traces;
+        *capacity = new_capacity;
+    }
+    char *copy = strdup(path);
+    if (copy == NULL)
+        return -1;
+    batch->traces[batch->num_traces++] = copy;
+    return 0;
+}
+
+// Collect trace paths: every regular file of a directory (sorted) except
+// program images, or one path per line of a list file
+static int collect_traces(batch_t *batch, const char *source) {
+    size_t capacity = 0;
+    struct stat st;
+    if (stat(source, &st) != 0)
+        return -1;
+
+    if (S_ISDIR(st.st_mode)) {
+        DIR *dir = opendir(source);
+        if (dir == NULL)
+            return -1;
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (entry->d_name[0] == '.' || strstr(entry->d_name, IMAGE_SUFFIX) != NULL)
+                continue; // Hidden files and program images written next to traces
+            char path[4096];
+            snprintf(path, sizeof(path), "%s/%s", source, entry->d_name);
+            if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+                continue;
+            if (append_trace(batch, &capacity, path) != 0) {
+                closedir(dir);
+                return -1;
+            }
+        }
+        closedir(dir);
+        qsort(batch->traces, batch->num_traces, sizeof(char *), compare_paths);
+        return 0;
+    }
+
+    FILE *list = fopen(source, "r");
+    if (list == NULL)
+        return -1;
+    char line[4096];
+    while (fgets(line, sizeof(line), list) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#')
+            continue;
+        if (append_trace(batch, &capacity, line) != 0) {
+            fclose(list);
+            return -1;
+        }
+    }
+    fclose(list);
+    return 0;
+}
+
+// Simulate one trace on a private instruction memory and core
+static void batch_job(size_t job, unsigned worker, void *ctx) {
+    batch_t *batch = (batch_t *)ctx;
+    batch_record_t *record = &batch->records[job];
+    (void)worker;
+
+    memset(record, 0, sizeof(*record));
+
+    instruction_memory_t i_mem;
+    record->status = load_instructions(&i_mem, batch->traces[job]);
+    if (record->status != LOAD_OK)
+        return;
+
+    decode_cache_t decoded;
+    core_t *core = NULL;
+    engine_result_t result;
+    record->status = LOAD_ERR_NOMEM;
+    if (build_decode_cache(&i_mem, &decoded) == 0) {
+        core = init_core(&i_mem);
+        if (core != NULL) {
+            core->decoded = &decoded;
+            if (run_engine(core, batch->engine, batch->config, &result) == 0) {
+                record->status = LOAD_OK;
+                record->instructions = result.instructions;
+                record->cycles = result.cycles;
+                record->PC = core->PC;
+                record->state_hash = core_state_hash(core);
+                free_engine_result(&result);
+            } else {
+                record->status = BATCH_ERR_ENGINE;
+            }
+            free_core(core);
+        }
+        free_decode_cache(&decoded);
+    }
+    free_instruction_memory(&i_mem);
+}
+
+static const char *batch_status_string(int status) {
+    return status == BATCH_ERR_ENGINE ? "engine failed" : load_error_string(status);
+}
+
+// Simulate every trace of a directory or list file on a work-stealing pool
+// and write one CSV record per trace, in trace order. Returns the number of
+// traces that failed, or -1 if the batch itself could not run.
+int run_batch(const char *source, engine_t engine, const engine_config_t *config, unsigned num_threads, FILE *out) {
+    batch_t batch = { NULL, 0, engine, config, NULL };
+    int failed = -1;
+
+    if (collect_traces(&batch, source) == 0) {
+        batch.records = (batch_record_t *)calloc(batch.num_traces ? batch.num_traces : 1, sizeof(batch_record_t));
+        if (batch.records != NULL) {
+            run_work_pool(batch.num_traces, num_threads, batch_job, &batch);
+
+            failed = 0;
+            fprintf(out, "trace,status,instructions,cycles,pc,state_hash\n");
+            for (size_t i = 0; i < batch.num_traces; i++) {
+                const batch_record_t *r = &batch.records[i];
+                fprintf(out, "%s,%s,%llu,%llu,%llu,%016llx\n", batch.traces[i], batch_status_string(r->status),
+                        (unsigned long long)r->instructions, (unsigned long long)r->cycles,
+                        (unsigned long long)r->PC, (unsigned long long)r->state_hash);
+                if (r->status != LOAD_OK)
+                    failed++;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < batch.num_traces; i++)
+        free(batch.traces[i]);
+    free(batch.traces);
+    free(batch.records);
+    return failed;
+}
@@ -0,0 +1,9 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include "engine.h"
+
+// Function prototypes
+int run_batch(const char *source, engine_t engine, const engine_config_t *config, unsigned num_threads, FILE *out);
+
+#endif
@@ -0,0 +1,99 @@
+/* Parse-throughput benchmark for the trace assembler.
+ *
+ * Generates a synthetic trace of the given number of lines, assembles it
+ * repeatedly with assemble_trace (bypassing the program image cache), once
+ * serially and once on the given number of threads, and reports the best run
+ * of each in lines per second.
+ *
+ * Execute as follows:
+ *  $./bench_parse [lines (default 4000000)] [runs (default 5)] [threads (default: one per CPU)]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "parser.h"
+#include "work_pool.h"
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Write a mix of every accepted instruction format
+static int generate_trace(FILE *out, long lines) {
+    unsigned seed = 12345;
+    for (long i = 0; i < lines; i++) {
+        seed = seed * 1103515245 + 12345;
+        unsigned r = seed >> 8;
+        unsigned rd = r % 31 + 1, rs1 = (r >> 5) % 32, rs2 = (r >> 10) % 32;
+        int imm = (int)((r >> 15) % 64) - 32;
+        switch (r % 8) {
+        case 0: fprintf(out, "add x%u, x%u, x%u\n", rd, rs1, rs2); break;
+        case 1: fprintf(out, "sub x%u, x%u, x%u\n", rd, rs1, rs2); break;
+        case 2: fprintf(out, "and x%u, x%u, x%u\n", rd, rs1, rs2); break;
+        case 3: fprintf(out, "addi x%u, x%u, %d\n", rd, rs1, imm); break;
+        case 4: fprintf(out, "slli x%u, x%u, %u\n", rd, rs1, rs2); break;
+        case 5: fprintf(out, "ld x%u, %d(x%u)\n", rd, imm * 8, rs1); break;
+        case 6: fprintf(out, "sd x%u, %d(x%u)\n", rs2, imm * 8, rs1); break;
+        default: fprintf(out, "beq x%u, x%u, %d\n", rs1, rs2, imm / 4); break;
+        }
+    }
+    return ferror(out) ? -1 : 0;
+}
+
+// Best of runs assemblies of the trace at path, in seconds
+static double time_assembly(const char *path, int runs, unsigned num_threads) {
+    double best = 0;
+    for (int run = 0; run < runs; run++) {
+        instruction_memory_t i_mem;
+        double start = now_seconds();
+        int status = assemble_trace(&i_mem, path, num_threads);
+        double elapsed = now_seconds() - start;
+        if (status != LOAD_OK) {
+            fprintf(stderr, "Cannot assemble trace: %s\n", load_error_string(status));
+            unlink(path);
+            exit(EXIT_FAILURE);
+        }
+        free_instruction_memory(&i_mem);
+        if (run == 0 || elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+int main(int argc, const char **argv)
+{
+    long lines = argc > 1 ? atol(argv[1]) : 4000000;
+    int runs = argc > 2 ? atoi(argv[2]) : 5;
+    unsigned num_threads = argc > 3 ? (unsigned)atoi(argv[3]) : default_num_threads();
+
+    char path[] = "/tmp/bench_parse_XXXXXX";
+    int fd = mkstemp(path);
+    FILE *out = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (out == NULL) {
+        perror("Cannot create trace file.");
+        exit(EXIT_FAILURE);
+    }
+    int status = generate_trace(out, lines);
+    if (fclose(out) != 0 || status != 0) {
+        perror("Cannot write trace file.");
+        unlink(path);
+        exit(EXIT_FAILURE);
+    }
+
+    double serial = time_assembly(path, runs, 1);
+    double parallel = time_assembly(path, runs, num_threads);
+    unlink(path);
+
+    printf("Parsed %ld lines in %.6f s: %.0f lines/s (1 thread)\n", lines, serial,
+           serial > 0 ? lines / serial : 0.0);
+    printf("Parsed %ld lines in %.6f s: %.0f lines/s (%u threads)\n", lines, parallel,
+           parallel > 0 ? lines / parallel : 0.0, num_threads);
+    return 0;
+}
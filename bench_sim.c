@@ -0,0 +1,260 @@
+/* Simulator throughput benchmark.
+ *
+ * Generates one synthetic trace per workload, then measures for each the
+ * time to assemble it (bypassing the program image cache), the start-up
+ * time to decode it and create a core, and the steady-state speed of every
+ * execution engine. Each measurement is the best of several runs. Results
+ * are written as one JSON object, to track simulator speed across commits.
+ *
+ * Execute as follows:
+ *  $./bench_sim [--instructions=N] [--runs=N] [--workloads=alu,memory,branchy,straight]
+ *               [--engines=reference,decoded,threaded,block,pipeline] [--label=<text>] [--output=<file>]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "decoder.h"
+#include "engine.h"
+#include "parser.h"
+#include "workload.h"
+
+#define NUM_ENGINES (ENGINE_PIPELINE + 1)
+
+typedef struct {
+    double seconds;
+    uint64_t instructions;
+} engine_timing_t;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [--instructions=N] [--runs=N] [--workloads=alu,memory,branchy,straight]\n", prog);
+    printf("       %*s [--engines=reference,decoded,threaded,block,pipeline] [--label=<text>] [--output=<file>]\n",
+           (int)strlen(prog), "");
+    exit(EXIT_FAILURE);
+}
+
+// Parse a comma-separated list of names into a selection mask
+static int parse_list(const char *list, int (*from_name)(const char *, unsigned *), unsigned *mask) {
+    char name[32];
+    *mask = 0;
+    while (*list != '\0') {
+        size_t length = strcspn(list, ",");
+        if (length == 0 || length >= sizeof(name))
+            return -1;
+        memcpy(name, list, length);
+        name[length] = '\0';
+        unsigned index;
+        if (from_name(name, &index) != 0)
+            return -1;
+        *mask |= 1u << index;
+        list += length + (list[length] == ',');
+    }
+    return *mask != 0 ? 0 : -1;
+}
+
+static int workload_index(const char *name, unsigned *index) {
+    workload_kind_t kind;
+    if (workload_from_name(name, &kind) != 0)
+        return -1;
+    *index = (unsigned)kind;
+    return 0;
+}
+
+static int engine_index(const char *name, unsigned *index) {
+    engine_t engine;
+    if (engine_from_name(name, &engine) != 0)
+        return -1;
+    *index = (unsigned)engine;
+    return 0;
+}
+
+// Best of runs assemblies of the trace at path, in seconds
+static double time_parse(const char *path, int runs, instruction_memory_t *i_mem) {
+    double best = 0;
+    for (int run = 0; run < runs; run++) {
+        double start = now_seconds();
+        int status = assemble_trace(i_mem, path, 1);
+        double elapsed = now_seconds() - start;
+        if (status != LOAD_OK) {
+            fprintf(stderr, "Cannot assemble trace: %s\n", load_error_string(status));
+            exit(EXIT_FAILURE);
+        }
+        if (run + 1 < runs)
+            free_instruction_memory(i_mem);
+        if (run == 0 || elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+// Best of runs times to decode instruction memory and create a core
+static double time_startup(instruction_memory_t *i_mem, int runs) {
+    double best = 0;
+    for (int run = 0; run < runs; run++) {
+        double start = now_seconds();
+        decode_cache_t decoded;
+        if (build_decode_cache(i_mem, &decoded) != 0) {
+            perror("Failed to decode instruction memory.");
+            exit(EXIT_FAILURE);
+        }
+        core_t *core = init_core(i_mem);
+        if (core == NULL) {
+            perror("Failed to initialize the core.");
+            exit(EXIT_FAILURE);
+        }
+        core->decoded = &decoded;
+        double elapsed = now_seconds() - start;
+        free_core(core);
+        free_decode_cache(&decoded);
+        if (run == 0 || elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+// Best of runs complete executions on a fresh core, not counting start-up
+static engine_timing_t time_engine(instruction_memory_t *i_mem, const decode_cache_t *decoded, engine_t engine,
+                                   int runs) {
+    engine_timing_t best = {0, 0};
+    for (int run = 0; run < runs; run++) {
+        core_t *core = init_core(i_mem);
+        if (core == NULL) {
+            perror("Failed to initialize the core.");
+            exit(EXIT_FAILURE);
+        }
+        core->decoded = (decode_cache_t *)decoded;
+        engine_result_t result;
+        double start = now_seconds();
+        if (run_engine(core, engine, NULL, &result) != 0) {
+            perror("Failed to allocate the execution engine.");
+            exit(EXIT_FAILURE);
+        }
+        double elapsed = now_seconds() - start;
+        if (run == 0 || elapsed < best.seconds) {
+            best.seconds = elapsed;
+            best.instructions = result.instructions;
+        }
+        free_engine_result(&result);
+        free_core(core);
+    }
+    return best;
+}
+
+int main(int argc, const char **argv)
+{
+    workload_params_t params;
+    default_workload_params(&params);
+    int runs = 3;
+    unsigned workloads = (1u << NUM_WORKLOADS) - 1;
+    unsigned engines = (1u << NUM_ENGINES) - 1;
+    const char *label = "";
+    const char *output = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--instructions=", 15) == 0) {
+            params.instructions = strtoull(argv[i] + 15, NULL, 10);
+        } else if (strncmp(argv[i], "--runs=", 7) == 0) {
+            runs = atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "--workloads=", 12) == 0) {
+            if (parse_list(argv[i] + 12, workload_index, &workloads) != 0)
+                usage(argv[0]);
+        } else if (strncmp(argv[i], "--engines=", 10) == 0) {
+            if (parse_list(argv[i] + 10, engine_index, &engines) != 0)
+                usage(argv[0]);
+        } else if (strncmp(argv[i], "--label=", 8) == 0) {
+            label = argv[i] + 8;
+        } else if (strncmp(argv[i], "--output=", 9) == 0) {
+            output = argv[i] + 9;
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (runs < 1 || params.instructions == 0)
+        usage(argv[0]);
+
+    FILE *out = stdout;
+    if (output != NULL && (out = fopen(output, "w")) == NULL) {
+        perror("Cannot open output file.");
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(out, "{\"benchmark\": \"bench_sim\", \"label\": \"");
+    for (const char *c = label; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\')
+            fputc('\\', out);
+        if ((unsigned char)*c >= 0x20)
+            fputc(*c, out);
+    }
+    fprintf(out, "\", \"instructions\": %llu, \"runs\": %d, \"workloads\": [",
+            (unsigned long long)params.instructions, runs);
+
+    bool first_workload = true;
+    for (unsigned w = 0; w < NUM_WORKLOADS; w++) {
+        if (!(workloads & (1u << w)))
+            continue;
+        params.kind = (workload_kind_t)w;
+        fprintf(stderr, "Benchmarking %s...\n", workload_name(params.kind));
+
+        char path[] = "/tmp/bench_sim_XXXXXX";
+        int fd = mkstemp(path);
+        FILE *trace = fd >= 0 ? fdopen(fd, "w") : NULL;
+        if (trace == NULL) {
+            perror("Cannot create trace file.");
+            exit(EXIT_FAILURE);
+        }
+        int status = generate_workload(trace, &params);
+        if (fclose(trace) != 0 || status != 0) {
+            perror("Cannot write trace file.");
+            unlink(path);
+            exit(EXIT_FAILURE);
+        }
+
+        instruction_memory_t i_mem;
+        double parse = time_parse(path, runs, &i_mem);
+        unlink(path);
+        double startup = time_startup(&i_mem, runs);
+        decode_cache_t decoded;
+        if (build_decode_cache(&i_mem, &decoded) != 0) {
+            perror("Failed to decode instruction memory.");
+            exit(EXIT_FAILURE);
+        }
+
+        fprintf(out, "%s\n  {\"workload\": \"%s\", \"static_instructions\": %zu, \"parse_seconds\": %.6f, "
+                "\"parse_lines_per_second\": %.0f, \"startup_seconds\": %.6f, \"engines\": [",
+                first_workload ? "" : ",", workload_name(params.kind), i_mem.size, parse,
+                parse > 0 ? i_mem.size / parse : 0.0, startup);
+        first_workload = false;
+
+        bool first_engine = true;
+        for (unsigned e = 0; e < NUM_ENGINES; e++) {
+            if (!(engines & (1u << e)))
+                continue;
+            engine_timing_t timing = time_engine(&i_mem, &decoded, (engine_t)e, runs);
+            fprintf(out, "%s\n    {\"engine\": \"%s\", \"instructions\": %llu, \"seconds\": %.6f, \"mips\": %.2f}",
+                    first_engine ? "" : ",", engine_name((engine_t)e), (unsigned long long)timing.instructions,
+                    timing.seconds, timing.seconds > 0 ? timing.instructions / timing.seconds * 1e-6 : 0.0);
+            first_engine = false;
+        }
+        fprintf(out, "]}");
+
+        free_decode_cache(&decoded);
+        free_instruction_memory(&i_mem);
+    }
+    fprintf(out, "\n]}\n");
+    if (out != stdout && fclose(out) != 0) {
+        perror("Cannot write output file.");
+        exit(EXIT_FAILURE);
+    }
+    return 0;
+}
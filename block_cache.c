@@ -0,0 +1,138 @@
+#include "block_cache.h"
+#include "decoder.h"
+#include <stdlib.h>
+
+// Successor of a block that leaves the program; ends the run
+static block_t halt_block;
+
+int init_block_cache(block_cache_t *cache, const decode_cache_t *decoded) {
+    cache->decoded = decoded;
+    cache->num_blocks = 0;
+    cache->blocks = (block_t **)calloc(decoded->size ? decoded->size : 1, sizeof(block_t *));
+    return cache->blocks == NULL ? -1 : 0;
+}
+
+void free_block_cache(block_cache_t *cache) {
+    if (cache->blocks != NULL) {
+        for (size_t i = 0; i < cache->decoded->size; i++)
+            free(cache->blocks[i]);
+        free(cache->blocks);
+    }
+    cache->blocks = NULL;
+    cache->num_blocks = 0;
+}
+
+// Find the block starting at an instruction index, translating it on first
+// use. Returns NULL if the block cannot be allocated.
+static block_t *lookup_block(block_cache_t *cache, uint64_t index) {
+    const decode_cache_t *decoded = cache->decoded;
+    if (index >= decoded->size)
+        return &halt_block;
+
+    block_t *block = cache->blocks[index];
+    if (block != NULL)
+        return block;
+
+    block = (block_t *)malloc(sizeof(block_t));
+    if (block == NULL)
+        return NULL;
+
+    uint64_t end = index;
+    while (end < decoded->size && decoded->uops[end].uop != UOP_BEQ)
+        end++;
+
+    block->uops = &decoded->uops[index];
+    block->ends_in_branch = end < decoded->size;
+    block->length = (uint32_t)(end - index) + (block->ends_in_branch ? 1 : 0);
+    block->fall_index = index + block->length;
+    block->taken_index = block->ends_in_branch ?
+        end + (uint64_t)(int64_t)(decoded->uops[end].imm / 2) : block->fall_index;
+    block->taken = NULL;
+    block->fall = NULL;
+    block->executions = 0;
+    block->taken_count = 0;
+
+    cache->blocks[index] = block;
+    cache->num_blocks++;
+    return block;
+}
+
+#if PERF_COUNTERS
+// Credit every block's instructions to the performance counters once per
+// run instead of once per instruction: each block only counts its
+// executions and taken exits.
+static void fold_block_counters(block_cache_t *cache, perf_counters_t *perf) {
+    for (size_t i = 0; i < cache->decoded->size; i++) {
+        block_t *block = cache->blocks[i];
+        if (block == NULL || block->executions == 0)
+            continue;
+        for (uint32_t j = 0; j < block->length; j++) {
+            const decoded_instruction_t *d = &block->uops[j];
+            opclass_t class = uop_opclass(d->uop);
+            perf->retired[class] += block->executions;
+            if (class == OPCLASS_LOAD) {
+                perf->loads += block->executions;
+                perf->bytes_loaded += block->executions * ACCESS_BYTES(d->funct3);
+            } else if (class == OPCLASS_STORE) {
+                perf->stores += block->executions;
+                perf->bytes_stored += block->executions * ACCESS_BYTES(d->funct3);
+            } else if (class == OPCLASS_BRANCH) {
+                perf->branches_taken += block->taken_count;
+                perf->branches_not_taken += block->executions - block->taken_count;
+            }
+        }
+        block->executions = 0;
+        block->taken_count = 0;
+    }
+}
+#endif
+
+// Execute blocks from core->PC until control leaves the program. Chained
+// successors are followed without a lookup, and instructions inside a block
+// run without PC updates or bounds checks. Stores the number of
+// instructions executed, which is also added to core->clk, in *instructions.
+// Returns 0, or -1 if a block could not be translated; the core then stops
+// at the start of that block, with the instructions before it retired.
+int run_blocks(core_t *core, block_cache_t *cache, tick_t *instructions) {
+    register_t *reg = core->reg_file;
+    data_memory_t *mem = core->data_mem;
+    tick_t executed = 0;
+    uint64_t index = core->PC / 4;
+
+    block_t *block = lookup_block(cache, index);
+    while (block != NULL && block != &halt_block) {
+        uint32_t body = block->length - (block->ends_in_branch ? 1 : 0);
+        const decoded_instruction_t *d = block->uops;
+        for (uint32_t i = 0; i < body; i++)
+            execute_uop(&d[i], reg, mem);
+        executed += block->length;
+#if PERF_COUNTERS
+        block->executions++;
+#endif
+
+        block_t *next;
+        if (block->ends_in_branch && reg[d[body].rs1] == reg[d[body].rs2]) {
+#if PERF_COUNTERS
+            block->taken_count++;
+#endif
+            index = block->taken_index;
+            next = block->taken;
+            if (next == NULL)
+                next = block->taken = lookup_block(cache, index);
+        } else {
+            index = block->fall_index;
+            next = block->fall;
+            if (next == NULL)
+                next = block->fall = lookup_block(cache, index);
+        }
+        block = next;
+    }
+
+#if PERF_COUNTERS
+    fold_block_counters(cache, &core->perf);
+#endif
+    core->PC = index * 4;
+    core->clk += executed;
+    *instructions = executed;
+    return block == NULL ? -1 : 0;
+}
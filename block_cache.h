@@ -0,0 +1,33 @@
+#ifndef __BLOCK_CACHE_H__
+#define __BLOCK_CACHE_H__
+
+#include "core.h"
+
+// A translated basic block: a straight-line run of decoded instructions
+// ending at a beq or at the end of the program. Successors are chained
+// directly once they have been translated.
+typedef struct block_s {
+    const decoded_instruction_t *uops; // First instruction, inside the decode cache
+    uint32_t length;                   // Instructions in the block, terminator included
+    bool ends_in_branch;               // Last instruction is a beq
+    uint64_t taken_index;              // Instruction index of the taken successor
+    uint64_t fall_index;               // Instruction index of the fall-through successor
+    struct block_s *taken;             // Chained taken successor, NULL until first taken
+    struct block_s *fall;              // Chained fall-through successor, NULL until first used
+    uint64_t executions;               // Runs since the counters were last folded into core->perf
+    uint64_t taken_count;              // Runs that left through a taken branch
+} block_t;
+
+// Translation cache keyed by block-start PC
+typedef struct {
+    const decode_cache_t *decoded;
+    block_t **blocks; // Indexed by block-start PC / 4, NULL until translated
+    size_t num_blocks; // Blocks translated so far
+} block_cache_t;
+
+// Function prototypes
+int init_block_cache(block_cache_t *cache, const decode_cache_t *decoded);
+void free_block_cache(block_cache_t *cache);
+int run_blocks(core_t *core, block_cache_t *cache, tick_t *instructions);
+
+#endif
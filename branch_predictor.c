@@ -0,0 +1,275 @@
+#include "branch_predictor.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define COUNTER_WEAKLY_NOT_TAKEN 1
+#define COUNTER_MAX 3
+
+static const char *BP_KIND_NAME[] = {
+    [BP_NOT_TAKEN] = "not-taken",
+    [BP_BTFN] = "btfn",
+    [BP_BIMODAL] = "bimodal",
+    [BP_GSHARE] = "gshare",
+};
+
+void default_bp_config(bp_config_t *config) {
+    config->kind = BP_NOT_TAKEN;
+    config->table_bits = BP_DEFAULT_TABLE_BITS;
+    config->history_bits = BP_DEFAULT_HISTORY_BITS;
+    config->btb_entries = 0;
+}
+
+int bp_kind_from_name(const char *name, bp_kind_t *kind) {
+    for (size_t i = 0; i < sizeof(BP_KIND_NAME) / sizeof(BP_KIND_NAME[0]); i++) {
+        if (strcmp(name, BP_KIND_NAME[i]) == 0) {
+            *kind = (bp_kind_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *bp_kind_name(bp_kind_t kind) {
+    return BP_KIND_NAME[kind];
+}
+
+// Table sizes in range, gshare history no longer than its index and a
+// power-of-two BTB
+bool bp_config_valid(const bp_config_t *config) {
+    if (config->table_bits > BP_MAX_TABLE_BITS || config->history_bits > BP_MAX_HISTORY_BITS)
+        return false;
+    if (config->kind == BP_GSHARE && config->history_bits > config->table_bits)
+        return false;
+    return (config->btb_entries & (config->btb_entries - 1)) == 0;
+}
+
+// Set up a predictor for a program of num_instructions instructions.
+// Returns 0 on success, -1 if the configuration is invalid or allocation fails.
+int init_branch_predictor(branch_predictor_t *bp, const bp_config_t *config, size_t num_instructions) {
+    memset(bp, 0, sizeof(*bp));
+    bp->config = *config;
+    if (!bp_config_valid(config))
+        return -1;
+
+    if (config->kind == BP_BIMODAL || config->kind == BP_GSHARE) {
+        size_t entries = (size_t)1 << config->table_bits;
+        bp->counters = (uint8_t *)malloc(entries);
+        if (bp->counters == NULL)
+            goto fail;
+        memset(bp->counters, COUNTER_WEAKLY_NOT_TAKEN, entries);
+        bp->table_mask = (uint32_t)(entries - 1);
+        bp->history_mask = (uint32_t)((1u << config->history_bits) - 1);
+    }
+    if (config->btb_entries > 0) {
+        bp->btb = (btb_entry_t *)calloc(config->btb_entries, sizeof(btb_entry_t));
+        if (bp->btb == NULL)
+            goto fail;
+        bp->btb_mask = config->btb_entries - 1;
+    }
+
+    bp->profile.num_slots = num_instructions;
+    bp->profile.slot = (uint32_t *)calloc(num_instructions ? num_instructions : 1, sizeof(uint32_t));
+    if (bp->profile.slot == NULL)
+        goto fail;
+    return 0;
+
+fail:
+    free_branch_predictor(bp);
+    return -1;
+}
+
+void free_branch_predictor(branch_predictor_t *bp) {
+    free(bp->counters);
+    free(bp->btb);
+    free_branch_profile(&bp->profile);
+    bp->counters = NULL;
+    bp->btb = NULL;
+}
+
+static uint32_t counter_index(const branch_predictor_t *bp, addr_t PC, uint32_t history) {
+    uint32_t index = (uint32_t)(PC >> 2);
+    if (bp->config.kind == BP_GSHARE)
+        index ^= history;
+    return index & bp->table_mask;
+}
+
+// Fetch-stage prediction from the BTB. Returns true and the target when PC
+// hits in the BTB and the direction predictor says taken.
+bool bp_predict_fetch(const branch_predictor_t *bp, addr_t PC, addr_t *target) {
+    if (bp->btb == NULL)
+        return false;
+    const btb_entry_t *entry = &bp->btb[(PC >> 2) & bp->btb_mask];
+    if (!entry->valid || entry->tag != PC || !bp_predict(bp, PC, entry->target, bp->history))
+        return false;
+    *target = entry->target;
+    return true;
+}
+
+// Predicted direction of the branch at PC jumping to target, given the
+// global history at prediction time
+bool bp_predict(const branch_predictor_t *bp, addr_t PC, addr_t target, uint32_t history) {
+    switch (bp->config.kind) {
+    case BP_BTFN:
+        return target <= PC;
+    case BP_BIMODAL:
+    case BP_GSHARE:
+        return bp->counters[counter_index(bp, PC, history)] >= 2;
+    default:
+        return false;
+    }
+}
+
+static void record_branch(branch_profile_t *profile, addr_t PC, bool taken, bool mispredicted) {
+    uint64_t index = PC / 4;
+    if (index >= profile->num_slots)
+        return;
+
+    if (profile->slot[index] == 0) {
+        if (profile->count == profile->capacity) {
+            size_t capacity = profile->capacity ? profile->capacity * 2 : 64;
+            bp_branch_t *branches = (bp_branch_t *)realloc(profile->branches, capacity * sizeof(bp_branch_t));
+            if (branches == NULL)
+                return; // Statistics only; prediction is unaffected
+            profile->branches = branches;
+            profile->capacity = capacity;
+        }
+        bp_branch_t *branch = &profile->branches[profile->count++];
+        memset(branch, 0, sizeof(*branch));
+        branch->PC = PC;
+        profile->slot[index] = (uint32_t)profile->count;
+    }
+
+    bp_branch_t *branch = &profile->branches[profile->slot[index] - 1];
+    branch->executed++;
+    branch->taken += taken;
+    branch->mispredicted += mispredicted;
+}
+
+// Train the predictor with a resolved branch. history is the global history
+// the branch was predicted with: branches still in flight have not updated
+// it yet, so training must use the same counter the prediction read.
+void bp_update(branch_predictor_t *bp, addr_t PC, uint32_t history, bool taken, addr_t target, bool mispredicted) {
+    if (bp->counters != NULL) {
+        uint8_t *counter = &bp->counters[counter_index(bp, PC, history)];
+        if (taken && *counter < COUNTER_MAX)
+            (*counter)++;
+        else if (!taken && *counter > 0)
+            (*counter)--;
+        bp->history = ((bp->history << 1) | taken) & bp->history_mask;
+    }
+    if (bp->btb != NULL && taken) {
+        btb_entry_t *entry = &bp->btb[(PC >> 2) & bp->btb_mask];
+        entry->valid = true;
+        entry->tag = PC;
+        entry->target = target;
+    }
+    record_branch(&bp->profile, PC, taken, mispredicted);
+}
+
+void free_branch_profile(branch_profile_t *profile) {
+    free(profile->branches);
+    free(profile->slot);
+    memset(profile, 0, sizeof(*profile));
+}
+
+// Most mispredicted first, ties by PC
+static int compare_branches(const void *a, const void *b) {
+    const bp_branch_t *x = (const bp_branch_t *)a;
+    const bp_branch_t *y = (const bp_branch_t *)b;
+    if (x->mispredicted != y->mispredicted)
+        return x->mispredicted < y->mispredicted ? 1 : -1;
+    return (x->PC > y->PC) - (x->PC < y->PC);
+}
+
+// Print the max_rows most mispredicted branches with their accuracy
+void print_branch_profile(const branch_profile_t *profile, size_t max_rows) {
+    if (profile->count == 0)
+        return;
+
+    bp_branch_t *sorted = (bp_branch_t *)malloc(profile->count * sizeof(bp_branch_t));
+    if (sorted == NULL)
+        return;
+    memcpy(sorted, profile->branches, profile->count * sizeof(bp_branch_t));
+    qsort(sorted, profile->count, sizeof(bp_branch_t), compare_branches);
+
+    size_t rows = profile->count < max_rows ? profile->count : max_rows;
+    printf("Branch PC \tExecuted \tTaken \t\tMispredicted \tAccuracy\n");
+    for (size_t i = 0; i < rows; i++) {
+        const bp_branch_t *branch = &sorted[i];
+        printf("%-8llu \t%-10llu \t%-10llu \t%-10llu \t%.2f%%\n", (unsigned long long)branch->PC,
+               (unsigned long long)branch->executed, (unsigned long long)branch->taken,
+               (unsigned long long)branch->mispredicted,
+               100.0 * (branch->executed - branch->mispredicted) / branch->executed);
+    }
+    if (rows < profile->count)
+        printf("(%zu more branches)\n", profile->count - rows);
+    free(sorted);
+}
+
+bool bp_same_config(const bp_config_t *a, const bp_config_t *b) {
+    return a->kind == b->kind && a->table_bits == b->table_bits && a->history_bits == b->history_bits &&
+           a->btb_entries == b->btb_entries;
+}
+
+static size_t counter_entries(const branch_predictor_t *bp) {
+    return bp->counters ? (size_t)bp->table_mask + 1 : 0;
+}
+
+// Copy the counters, global history and BTB of src, leaving the branch
+// profile of dst alone. Returns -1 if the configurations differ.
+int copy_predictor_state(branch_predictor_t *dst, const branch_predictor_t *src) {
+    if (!bp_same_config(&dst->config, &src->config))
+        return -1;
+    if (src->counters != NULL)
+        memcpy(dst->counters, src->counters, counter_entries(src));
+    if (src->btb != NULL)
+        memcpy(dst->btb, src->btb, src->config.btb_entries * sizeof(btb_entry_t));
+    dst->history = src->history;
+    return 0;
+}
+
+// Serialized predictor state: configuration and history, then the counter
+// and BTB arrays in host byte order
+typedef struct {
+    uint32_t kind;
+    uint32_t table_bits;
+    uint32_t history_bits;
+    uint32_t btb_entries;
+    uint32_t history;
+    uint32_t reserved;
+} bp_state_header_t;
+
+// Write the trained state of a predictor. Returns 0 on success.
+int write_predictor_state(const branch_predictor_t *bp, FILE *out) {
+    bp_state_header_t header = {(uint32_t)bp->config.kind, bp->config.table_bits, bp->config.history_bits,
+                                bp->config.btb_entries, bp->history, 0};
+    size_t entries = counter_entries(bp);
+    if (fwrite(&header, sizeof(header), 1, out) != 1 || fwrite(bp->counters, 1, entries, out) != entries)
+        return -1;
+    if (bp->btb != NULL && fwrite(bp->btb, sizeof(btb_entry_t), bp->config.btb_entries, out) != bp->config.btb_entries)
+        return -1;
+    return 0;
+}
+
+// Load state written by write_predictor_state into a predictor initialized
+// with the same configuration. Returns -1 if the configuration or size
+// differs.
+int read_predictor_state(branch_predictor_t *bp, const unsigned char *data, size_t size) {
+    bp_state_header_t header;
+    if (size < sizeof(header))
+        return -1;
+    memcpy(&header, data, sizeof(header));
+    bp_config_t saved = {(bp_kind_t)header.kind, header.table_bits, header.history_bits, header.btb_entries};
+    size_t entries = counter_entries(bp);
+    if (!bp_same_config(&bp->config, &saved) ||
+        size != sizeof(header) + entries + bp->config.btb_entries * sizeof(btb_entry_t))
+        return -1;
+
+    data += sizeof(header);
+    if (bp->counters != NULL)
+        memcpy(bp->counters, data, entries);
+    if (bp->btb != NULL)
+        memcpy(bp->btb, data + entries, bp->config.btb_entries * sizeof(btb_entry_t));
+    bp->history = header.history;
+    return 0;
+}
@@ -0,0 +1,82 @@
+#ifndef __BRANCH_PREDICTOR_H__
+#define __BRANCH_PREDICTOR_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "instruction.h"
+
+#define BP_DEFAULT_TABLE_BITS 10   // 1024 2-bit counters
+#define BP_DEFAULT_HISTORY_BITS 8  // gshare global history length
+#define BP_MAX_TABLE_BITS 24
+#define BP_MAX_HISTORY_BITS 24
+
+// Direction predictors selectable with --predictor
+typedef enum {
+    BP_NOT_TAKEN, // Always predict fall-through
+    BP_BTFN,      // Backward taken, forward not taken
+    BP_BIMODAL,   // 2-bit saturating counters indexed by PC
+    BP_GSHARE     // 2-bit counters indexed by PC xor global history
+} bp_kind_t;
+
+typedef struct {
+    bp_kind_t kind;
+    unsigned table_bits;   // log2 of the number of counters (bimodal, gshare)
+    unsigned history_bits; // Global history length (gshare), at most table_bits
+    unsigned btb_entries;  // Branch target buffer entries, a power of two; 0 for none
+} bp_config_t;
+
+// Outcome counts of one static branch
+typedef struct {
+    addr_t PC;
+    uint64_t executed;
+    uint64_t taken;
+    uint64_t mispredicted;
+} bp_branch_t;
+
+// Per-branch-PC statistics, in order of first execution
+typedef struct {
+    bp_branch_t *branches;
+    size_t count;
+    size_t capacity;
+    uint32_t *slot;   // Indexed by PC / 4: index into branches + 1, 0 if not seen
+    size_t num_slots;
+} branch_profile_t;
+
+// Direct-mapped branch target buffer entry, tagged with the full PC
+typedef struct {
+    bool valid;
+    addr_t tag;
+    addr_t target;
+} btb_entry_t;
+
+typedef struct {
+    bp_config_t config;
+    uint8_t *counters;     // 2-bit saturating counters
+    uint32_t table_mask;
+    uint32_t history;      // Resolved global branch history, newest outcome in bit 0
+    uint32_t history_mask;
+    btb_entry_t *btb;
+    uint32_t btb_mask;
+    branch_profile_t profile;
+} branch_predictor_t;
+
+// Function prototypes
+void default_bp_config(bp_config_t *config);
+bool bp_config_valid(const bp_config_t *config);
+int bp_kind_from_name(const char *name, bp_kind_t *kind);
+const char *bp_kind_name(bp_kind_t kind);
+int init_branch_predictor(branch_predictor_t *bp, const bp_config_t *config, size_t num_instructions);
+void free_branch_predictor(branch_predictor_t *bp);
+bool bp_predict_fetch(const branch_predictor_t *bp, addr_t PC, addr_t *target);
+bool bp_predict(const branch_predictor_t *bp, addr_t PC, addr_t target, uint32_t history);
+void bp_update(branch_predictor_t *bp, addr_t PC, uint32_t history, bool taken, addr_t target, bool mispredicted);
+void free_branch_profile(branch_profile_t *profile);
+void print_branch_profile(const branch_profile_t *profile, size_t max_rows);
+bool bp_same_config(const bp_config_t *a, const bp_config_t *b);
+int copy_predictor_state(branch_predictor_t *dst, const branch_predictor_t *src);
+int write_predictor_state(const branch_predictor_t *bp, FILE *out);
+int read_predictor_state(branch_predictor_t *bp, const unsigned char *data, size_t size);
+
+#endif
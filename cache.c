@@ -0,0 +1,397 @@
+#include "cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static bool is_power_of_two(uint64_t x) {
+    return x != 0 && (x & (x - 1)) == 0;
+}
+
+static unsigned log2_of(uint64_t x) {
+    unsigned n = 0;
+    while (x >>= 1)
+        n++;
+    return n;
+}
+
+void default_cache_config(cache_config_t *config) {
+    config->size = 0;
+    config->line_size = 64;
+    config->ways = 1;
+    config->write_back = true;
+    config->write_allocate = true;
+    config->replacement = CACHE_LRU;
+    config->miss_latency = CACHE_DEFAULT_MISS_LATENCY;
+    config->prefetch = false;
+}
+
+// Parse a size with an optional k or m suffix
+static int parse_size(const char *text, size_t length, unsigned *value) {
+    char buffer[32];
+    if (length == 0 || length >= sizeof(buffer))
+        return -1;
+    memcpy(buffer, text, length);
+    buffer[length] = '\0';
+
+    char *end;
+    unsigned long n = strtoul(buffer, &end, 10);
+    if (*end == 'k' || *end == 'K') {
+        n <<= 10;
+        end++;
+    } else if (*end == 'm' || *end == 'M') {
+        n <<= 20;
+        end++;
+    }
+    if (end == buffer || *end != '\0' || n > UINT32_MAX)
+        return -1;
+    *value = (unsigned)n;
+    return 0;
+}
+
+// Parse SIZE:LINE:WAYS[:option...], e.g. "32k:64:4:wb:wa:plru:latency=30".
+// Options are wb|wt, wa|nwa, lru|plru|random, latency=N and prefetch;
+// omitted ones keep the defaults. Returns 0 on success, -1 on a malformed
+// spec.
+int parse_cache_config(const char *spec, cache_config_t *config) {
+    default_cache_config(config);
+    unsigned field = 0;
+    const char *p = spec;
+
+    for (;;) {
+        const char *colon = strchr(p, ':');
+        size_t length = colon ? (size_t)(colon - p) : strlen(p);
+
+        if (field == 0) {
+            if (parse_size(p, length, &config->size) != 0)
+                return -1;
+        } else if (field == 1) {
+            if (parse_size(p, length, &config->line_size) != 0)
+                return -1;
+        } else if (field == 2) {
+            if (parse_size(p, length, &config->ways) != 0)
+                return -1;
+        } else if (length == 2 && strncmp(p, "wb", 2) == 0) {
+            config->write_back = true;
+        } else if (length == 2 && strncmp(p, "wt", 2) == 0) {
+            config->write_back = false;
+        } else if (length == 2 && strncmp(p, "wa", 2) == 0) {
+            config->write_allocate = true;
+        } else if (length == 3 && strncmp(p, "nwa", 3) == 0) {
+            config->write_allocate = false;
+        } else if (length == 3 && strncmp(p, "lru", 3) == 0) {
+            config->replacement = CACHE_LRU;
+        } else if (length == 4 && strncmp(p, "plru", 4) == 0) {
+            config->replacement = CACHE_PLRU;
+        } else if (length == 6 && strncmp(p, "random", 6) == 0) {
+            config->replacement = CACHE_RANDOM;
+        } else if (length == 8 && strncmp(p, "prefetch", 8) == 0) {
+            config->prefetch = true;
+        } else if (length > 8 && strncmp(p, "latency=", 8) == 0) {
+            if (parse_size(p + 8, length - 8, &config->miss_latency) != 0)
+                return -1;
+        } else {
+            return -1;
+        }
+
+        field++;
+        if (colon == NULL)
+            break;
+        p = colon + 1;
+    }
+    return field >= 3 ? 0 : -1;
+}
+
+// Power-of-two line size and set count that exactly fill the capacity
+bool cache_config_valid(const cache_config_t *config) {
+    if (config->size == 0)
+        return true;
+    if (config->ways == 0 || !is_power_of_two(config->line_size) || config->line_size < 4)
+        return false;
+    uint64_t set_bytes = (uint64_t)config->line_size * config->ways;
+    if (config->size % set_bytes != 0 || !is_power_of_two(config->size / set_bytes))
+        return false;
+    if (config->replacement == CACHE_PLRU && (!is_power_of_two(config->ways) || config->ways > CACHE_MAX_PLRU_WAYS))
+        return false;
+    return true;
+}
+
+// Returns 0 on success, -1 if the configuration is invalid or allocation fails
+int init_cache(cache_t *cache, const cache_config_t *config) {
+    memset(cache, 0, sizeof(*cache));
+    cache->config = *config;
+    if (config->size == 0 || !cache_config_valid(config))
+        return -1;
+
+    uint64_t num_sets = config->size / ((uint64_t)config->line_size * config->ways);
+    size_t num_lines = (size_t)(num_sets * config->ways);
+    cache->line_shift = log2_of(config->line_size);
+    cache->set_mask = num_sets - 1;
+    cache->random_state = 0x9E3779B97F4A7C15ull;
+
+    cache->tags = (uint64_t *)malloc(num_lines * sizeof(uint64_t));
+    cache->flags = (uint8_t *)calloc(num_lines, sizeof(uint8_t));
+    if (cache->tags == NULL || cache->flags == NULL)
+        goto fail;
+    for (size_t i = 0; i < num_lines; i++)
+        cache->tags[i] = CACHE_INVALID_TAG;
+
+    if (config->replacement == CACHE_LRU && (cache->last_use = (uint64_t *)calloc(num_lines, sizeof(uint64_t))) == NULL)
+        goto fail;
+    if (config->replacement == CACHE_PLRU && (cache->plru = (uint64_t *)calloc(num_sets, sizeof(uint64_t))) == NULL)
+        goto fail;
+    return 0;
+
+fail:
+    free_cache(cache);
+    return -1;
+}
+
+void free_cache(cache_t *cache) {
+    free(cache->tags);
+    free(cache->flags);
+    free(cache->last_use);
+    free(cache->plru);
+    cache->tags = NULL;
+    cache->flags = NULL;
+    cache->last_use = NULL;
+    cache->plru = NULL;
+}
+
+// Point every tree node on the path to way away from it. Node n's children
+// are 2n and 2n + 1; bit n set means the pseudo-LRU side is the right one.
+void cache_touch_plru(cache_t *cache, uint64_t set, unsigned way) {
+    unsigned levels = log2_of(cache->config.ways);
+    uint64_t bits = cache->plru[set];
+    unsigned node = 1;
+    for (unsigned level = levels; level-- > 0;) {
+        unsigned right = (way >> level) & 1;
+        if (right)
+            bits &= ~((uint64_t)1 << node);
+        else
+            bits |= (uint64_t)1 << node;
+        node = node * 2 + right;
+    }
+    cache->plru[set] = bits;
+}
+
+static unsigned plru_victim(const cache_t *cache, uint64_t set) {
+    unsigned levels = log2_of(cache->config.ways);
+    uint64_t bits = cache->plru[set];
+    unsigned node = 1, way = 0;
+    for (unsigned level = 0; level < levels; level++) {
+        unsigned right = (bits >> node) & 1;
+        way = way * 2 + right;
+        node = node * 2 + right;
+    }
+    return way;
+}
+
+static unsigned choose_victim(cache_t *cache, uint64_t set, size_t base) {
+    unsigned ways = cache->config.ways;
+    for (unsigned way = 0; way < ways; way++) {
+        if (cache->tags[base + way] == CACHE_INVALID_TAG)
+            return way;
+    }
+
+    switch (cache->config.replacement) {
+    case CACHE_PLRU:
+        return plru_victim(cache, set);
+    case CACHE_RANDOM: {
+        uint64_t x = cache->random_state; // xorshift64
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        cache->random_state = x;
+        return (unsigned)(x % ways);
+    }
+    default: {
+        unsigned victim = 0;
+        for (unsigned way = 1; way < ways; way++) {
+            if (cache->last_use[base + way] < cache->last_use[base + victim])
+                victim = way;
+        }
+        return victim;
+    }
+    }
+}
+
+// Place line in its set, evicting a victim, and return the slot index
+static size_t fill_line(cache_t *cache, uint64_t line, uint8_t flags) {
+    uint64_t set = line & cache->set_mask;
+    size_t base = set * cache->config.ways;
+    unsigned way = choose_victim(cache, set, base);
+    if (cache->tags[base + way] != CACHE_INVALID_TAG) {
+        cache->stats.evictions++;
+        if (cache->flags[base + way] & CACHE_LINE_DIRTY)
+            cache->stats.writebacks++;
+    }
+
+    cache->tags[base + way] = line;
+    cache->flags[base + way] = flags;
+    if (cache->config.replacement == CACHE_LRU)
+        cache->last_use[base + way] = ++cache->use_clock;
+    else if (cache->config.replacement == CACHE_PLRU)
+        cache_touch_plru(cache, set, way);
+    return base + way;
+}
+
+// Next-line prefetch: fill line + 1 unless it is already present. The fill
+// is assumed to use idle memory bandwidth and costs no cycles. A cache with
+// a single set has no next set to prefetch into without evicting the line
+// just used, so it does not prefetch.
+static void prefetch_next_line(cache_t *cache, uint64_t line) {
+    uint64_t next = line + 1;
+    if (cache->set_mask == 0)
+        return;
+    size_t base = (next & cache->set_mask) * cache->config.ways;
+    for (unsigned way = 0; way < cache->config.ways; way++) {
+        if (cache->tags[base + way] == next)
+            return;
+    }
+    fill_line(cache, next, CACHE_LINE_PREFETCHED);
+    cache->stats.prefetches++;
+}
+
+// First demand hit on a prefetched line: the prefetch was useful, and the
+// prefetcher runs ahead by one more line (tagged prefetching)
+void cache_prefetch_hit(cache_t *cache, size_t index, uint64_t line) {
+    cache->flags[index] &= ~CACHE_LINE_PREFETCHED;
+    cache->stats.useful_prefetches++;
+    prefetch_next_line(cache, line);
+}
+
+// Miss path of cache_access: count the miss, fill the line unless this is
+// a write miss without write-allocate, and return the miss latency.
+// Writebacks and write-throughs are assumed to drain through a write buffer
+// without stalling.
+unsigned cache_miss(cache_t *cache, uint64_t line, bool write) {
+    if (write) {
+        cache->stats.writes++;
+        cache->stats.write_misses++;
+        if (!cache->config.write_back)
+            cache->stats.write_throughs++;
+        if (!cache->config.write_allocate)
+            return 0;
+    } else {
+        cache->stats.reads++;
+        cache->stats.read_misses++;
+    }
+
+    fill_line(cache, line, (write && cache->config.write_back) ? CACHE_LINE_DIRTY : 0);
+    if (cache->config.prefetch)
+        prefetch_next_line(cache, line);
+
+    cache->stats.stall_cycles += cache->config.miss_latency;
+    return cache->config.miss_latency;
+}
+
+void print_cache_stats(const char *name, const cache_stats_t *stats) {
+    uint64_t accesses = stats->reads + stats->writes;
+    uint64_t misses = stats->read_misses + stats->write_misses;
+    printf("%s accesses \t: %llu (%llu reads, %llu writes)\n", name, (unsigned long long)accesses,
+           (unsigned long long)stats->reads, (unsigned long long)stats->writes);
+    printf("%s hits \t\t: %llu\n", name, (unsigned long long)(accesses - misses));
+    printf("%s misses \t: %llu (%.2f%%)\n", name, (unsigned long long)misses,
+           accesses ? 100.0 * misses / accesses : 0.0);
+    printf("%s evictions \t: %llu (%llu writebacks)\n", name, (unsigned long long)stats->evictions,
+           (unsigned long long)stats->writebacks);
+    if (stats->write_throughs > 0)
+        printf("%s write-throughs : %llu\n", name, (unsigned long long)stats->write_throughs);
+    if (stats->prefetches > 0)
+        printf("%s prefetches \t: %llu (%llu useful)\n", name, (unsigned long long)stats->prefetches,
+               (unsigned long long)stats->useful_prefetches);
+    printf("%s stall cycles \t: %llu\n", name, (unsigned long long)stats->stall_cycles);
+}
+
+// Same sets, ways and replacement state, so line state can move between
+// the two. Write and fill policies may differ.
+bool cache_same_geometry(const cache_config_t *a, const cache_config_t *b) {
+    return a->size == b->size && a->line_size == b->line_size && a->ways == b->ways &&
+           a->replacement == b->replacement;
+}
+
+static size_t cache_lines(const cache_t *cache) {
+    return (size_t)(cache->set_mask + 1) * cache->config.ways;
+}
+
+// Copy the lines and replacement state of src, leaving the statistics of
+// dst alone. Returns -1 if the geometries differ.
+int copy_cache_state(cache_t *dst, const cache_t *src) {
+    if (!cache_same_geometry(&dst->config, &src->config))
+        return -1;
+    size_t lines = cache_lines(src);
+    memcpy(dst->tags, src->tags, lines * sizeof(uint64_t));
+    memcpy(dst->flags, src->flags, lines * sizeof(uint8_t));
+    if (src->last_use != NULL)
+        memcpy(dst->last_use, src->last_use, lines * sizeof(uint64_t));
+    if (src->plru != NULL)
+        memcpy(dst->plru, src->plru, (size_t)(src->set_mask + 1) * sizeof(uint64_t));
+    dst->use_clock = src->use_clock;
+    dst->random_state = src->random_state;
+    return 0;
+}
+
+// Serialized line state: geometry, replacement clocks, then the tag, LRU
+// or PLRU and flag arrays in host byte order
+typedef struct {
+    uint32_t size;
+    uint32_t line_size;
+    uint32_t ways;
+    uint32_t replacement;
+    uint64_t use_clock;
+    uint64_t random_state;
+} cache_state_header_t;
+
+static size_t cache_state_size(const cache_t *cache) {
+    size_t lines = cache_lines(cache);
+    return sizeof(cache_state_header_t) + lines * (sizeof(uint64_t) + sizeof(uint8_t)) +
+           (cache->last_use ? lines * sizeof(uint64_t) : 0) +
+           (cache->plru ? (size_t)(cache->set_mask + 1) * sizeof(uint64_t) : 0);
+}
+
+// Write the line state of a cache. Returns 0 on success.
+int write_cache_state(const cache_t *cache, FILE *out) {
+    size_t lines = cache_lines(cache);
+    cache_state_header_t header = {cache->config.size, cache->config.line_size, cache->config.ways,
+                                   (uint32_t)cache->config.replacement, cache->use_clock, cache->random_state};
+    if (fwrite(&header, sizeof(header), 1, out) != 1 || fwrite(cache->tags, sizeof(uint64_t), lines, out) != lines)
+        return -1;
+    if (cache->last_use != NULL && fwrite(cache->last_use, sizeof(uint64_t), lines, out) != lines)
+        return -1;
+    if (cache->plru != NULL && fwrite(cache->plru, sizeof(uint64_t), cache->set_mask + 1, out) != cache->set_mask + 1)
+        return -1;
+    return fwrite(cache->flags, sizeof(uint8_t), lines, out) == lines ? 0 : -1;
+}
+
+// Load line state written by write_cache_state into a cache initialized
+// with the same geometry. Returns -1 if the geometry or size differs.
+int read_cache_state(cache_t *cache, const unsigned char *data, size_t size) {
+    cache_state_header_t header;
+    if (size < sizeof(header))
+        return -1;
+    memcpy(&header, data, sizeof(header));
+    cache_config_t saved = cache->config;
+    saved.size = header.size;
+    saved.line_size = header.line_size;
+    saved.ways = header.ways;
+    saved.replacement = (cache_replacement_t)header.replacement;
+    if (!cache_same_geometry(&cache->config, &saved) || size != cache_state_size(cache))
+        return -1;
+
+    size_t lines = cache_lines(cache);
+    data += sizeof(header);
+    memcpy(cache->tags, data, lines * sizeof(uint64_t));
+    data += lines * sizeof(uint64_t);
+    if (cache->last_use != NULL) {
+        memcpy(cache->last_use, data, lines * sizeof(uint64_t));
+        data += lines * sizeof(uint64_t);
+    }
+    if (cache->plru != NULL) {
+        memcpy(cache->plru, data, (size_t)(cache->set_mask + 1) * sizeof(uint64_t));
+        data += (size_t)(cache->set_mask + 1) * sizeof(uint64_t);
+    }
+    memcpy(cache->flags, data, lines * sizeof(uint8_t));
+    cache->use_clock = header.use_clock;
+    cache->random_state = header.random_state;
+    return 0;
+}
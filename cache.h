@@ -0,0 +1,114 @@
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "instruction.h"
+
+#define CACHE_DEFAULT_MISS_LATENCY 20 // Cycles to fill a line from memory
+#define CACHE_MAX_PLRU_WAYS 64        // Tree bits of a set fit in a uint64_t
+#define CACHE_INVALID_TAG UINT64_MAX  // Never a line address: addresses are at most 48 bits
+
+// Line state flags
+#define CACHE_LINE_DIRTY 1
+#define CACHE_LINE_PREFETCHED 2       // Filled by the prefetcher, not yet used
+
+typedef enum {
+    CACHE_LRU,
+    CACHE_PLRU,   // Tree pseudo-LRU, power-of-two associativity
+    CACHE_RANDOM
+} cache_replacement_t;
+
+// Cache geometry and policies. size 0 disables the cache.
+typedef struct {
+    unsigned size;           // Capacity in bytes
+    unsigned line_size;      // Bytes per line, a power of two
+    unsigned ways;           // Associativity
+    bool write_back;         // Write-back, or write-through
+    bool write_allocate;     // Fill the line on a write miss
+    cache_replacement_t replacement;
+    unsigned miss_latency;   // Cycles charged per line fill
+    bool prefetch;           // Tagged next-line prefetcher
+} cache_config_t;
+
+typedef struct {
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t read_misses;
+    uint64_t write_misses;
+    uint64_t evictions;      // Valid lines replaced
+    uint64_t writebacks;     // Dirty lines written to memory on eviction
+    uint64_t write_throughs; // Writes forwarded to memory by a write-through cache
+    uint64_t stall_cycles;   // Miss latency charged to the clock
+    uint64_t prefetches;     // Lines filled by the prefetcher
+    uint64_t useful_prefetches; // Prefetched lines later hit by a demand access
+} cache_stats_t;
+
+// Timing model of a set-associative cache. Only tags and state are kept;
+// the data itself stays in memory. Each set's tags, line flags and LRU
+// stamps are contiguous, so a lookup touches one short run per array.
+typedef struct {
+    cache_config_t config;
+    unsigned line_shift;
+    uint64_t set_mask;
+    uint64_t *tags;       // [set * ways + way], line address or CACHE_INVALID_TAG
+    uint8_t *flags;       // [set * ways + way], CACHE_LINE_* bits
+    uint64_t *last_use;   // [set * ways + way], LRU only
+    uint64_t *plru;       // [set], tree bits, PLRU only
+    uint64_t use_clock;   // LRU timestamp source
+    uint64_t random_state;
+    cache_stats_t stats;
+} cache_t;
+
+// Function prototypes
+void default_cache_config(cache_config_t *config);
+int parse_cache_config(const char *spec, cache_config_t *config);
+bool cache_config_valid(const cache_config_t *config);
+int init_cache(cache_t *cache, const cache_config_t *config);
+void free_cache(cache_t *cache);
+unsigned cache_miss(cache_t *cache, uint64_t line, bool write);
+void cache_prefetch_hit(cache_t *cache, size_t index, uint64_t line);
+void cache_touch_plru(cache_t *cache, uint64_t set, unsigned way);
+void print_cache_stats(const char *name, const cache_stats_t *stats);
+bool cache_same_geometry(const cache_config_t *a, const cache_config_t *b);
+int copy_cache_state(cache_t *dst, const cache_t *src);
+int write_cache_state(const cache_t *cache, FILE *out);
+int read_cache_state(cache_t *cache, const unsigned char *data, size_t size);
+
+// Access the line holding addr and return the stall cycles it costs. The
+// hit path is inline; misses go through cache_miss. Accesses are assumed
+// not to cross a line boundary.
+static inline unsigned cache_access(cache_t *cache, addr_t addr, bool write) {
+    uint64_t line = addr >> cache->line_shift;
+    uint64_t set = line & cache->set_mask;
+    unsigned ways = cache->config.ways;
+    size_t base = set * ways;
+    const uint64_t *tags = &cache->tags[base];
+
+    for (unsigned way = 0; way < ways; way++) {
+        if (tags[way] != line)
+            continue;
+        if (write) {
+            cache->stats.writes++;
+            if (cache->config.write_back)
+                cache->flags[base + way] |= CACHE_LINE_DIRTY;
+            else
+                cache->stats.write_throughs++;
+        } else {
+            cache->stats.reads++;
+        }
+        if (cache->config.replacement == CACHE_LRU)
+            cache->last_use[base + way] = ++cache->use_clock;
+        else if (cache->config.replacement == CACHE_PLRU)
+            cache_touch_plru(cache, set, way);
+        if (cache->flags[base + way] & CACHE_LINE_PREFETCHED)
+            cache_prefetch_hit(cache, base + way, line);
+        return 0;
+    }
+    return cache_miss(cache, line, write);
+}
+
+#endif
@@ -0,0 +1,284 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "checkpoint.h"
+#include "program_image.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Kinds of the sections after the data memory pages
+typedef enum {
+    SECTION_DCACHE = 1,
+    SECTION_ICACHE,
+    SECTION_PREDICTOR
+} section_kind_t;
+
+typedef struct {
+    uint32_t kind;    // section_kind_t
+    uint32_t reserved;
+    uint64_t size;    // Payload bytes that follow
+} section_header_t;
+
+static uint64_t program_hash(const instruction_memory_t *i_mem) {
+    return hash_source(i_mem->instructions, i_mem->size * sizeof(instruction_t));
+}
+
+// Allocate the caches (config size > 0) and predictor (predictor not NULL)
+// whose state a checkpoint carries; the others are left NULL. Returns 0 on
+// success, -1 if a configuration is invalid or allocation fails.
+int init_uarch_state(uarch_state_t *uarch, const cache_config_t *dcache, const cache_config_t *icache,
+                     const bp_config_t *predictor, size_t num_instructions) {
+    memset(uarch, 0, sizeof(*uarch));
+    if (dcache->size > 0) {
+        if ((uarch->dcache = (cache_t *)malloc(sizeof(cache_t))) == NULL || init_cache(uarch->dcache, dcache) != 0) {
+            free(uarch->dcache);
+            uarch->dcache = NULL;
+            goto fail;
+        }
+    }
+    if (icache->size > 0) {
+        if ((uarch->icache = (icache_t *)malloc(sizeof(icache_t))) == NULL ||
+            init_icache(uarch->icache, icache, num_instructions) != 0) {
+            free(uarch->icache);
+            uarch->icache = NULL;
+            goto fail;
+        }
+    }
+    if (predictor != NULL) {
+        if ((uarch->predictor = (branch_predictor_t *)malloc(sizeof(branch_predictor_t))) == NULL ||
+            init_branch_predictor(uarch->predictor, predictor, num_instructions) != 0) {
+            free(uarch->predictor);
+            uarch->predictor = NULL;
+            goto fail;
+        }
+    }
+    return 0;
+
+fail:
+    free_uarch_state(uarch);
+    return -1;
+}
+
+void free_uarch_state(uarch_state_t *uarch) {
+    if (uarch->dcache != NULL)
+        free_cache(uarch->dcache);
+    if (uarch->icache != NULL)
+        free_icache(uarch->icache);
+    if (uarch->predictor != NULL)
+        free_branch_predictor(uarch->predictor);
+    free(uarch->dcache);
+    free(uarch->icache);
+    free(uarch->predictor);
+    memset(uarch, 0, sizeof(*uarch));
+}
+
+// Call fn on every data memory page that holds a non-zero byte
+static void for_each_page(const data_memory_t *mem, void (*fn)(uint64_t page_number, const dmem_page_t *page, void *ctx),
+                          void *ctx) {
+    static const dmem_page_t zero_page;
+    for (size_t t = 0; t < mem->num_tables; t++) {
+        if (mem->tables[t] == NULL)
+            continue;
+        for (size_t p = 0; p < DMEM_L2_SIZE; p++) {
+            const dmem_page_t *page = mem->tables[t]->pages[p];
+            if (page != NULL && memcmp(page, &zero_page, sizeof(zero_page)) != 0)
+                fn(t * DMEM_L2_SIZE + p, page, ctx);
+        }
+    }
+}
+
+typedef struct {
+    FILE *out;
+    uint64_t count;
+    bool failed;
+} page_writer_t;
+
+static void count_page(uint64_t page_number, const dmem_page_t *page, void *ctx) {
+    (void)page_number;
+    (void)page;
+    ((page_writer_t *)ctx)->count++;
+}
+
+static void write_page_number(uint64_t page_number, const dmem_page_t *page, void *ctx) {
+    page_writer_t *writer = (page_writer_t *)ctx;
+    (void)page;
+    writer->failed |= fwrite(&page_number, sizeof(page_number), 1, writer->out) != 1;
+}
+
+static void write_page(uint64_t page_number, const dmem_page_t *page, void *ctx) {
+    page_writer_t *writer = (page_writer_t *)ctx;
+    (void)page_number;
+    writer->failed |= fwrite(page, sizeof(*page), 1, writer->out) != 1;
+}
+
+// Write one section, seeking back to fill in its size once the payload is out
+static int write_section(FILE *out, section_kind_t kind, const void *state,
+                         int (*write_state)(const void *state, FILE *out)) {
+    section_header_t header = {(uint32_t)kind, 0, 0};
+    long start = ftell(out);
+    if (start < 0 || fwrite(&header, sizeof(header), 1, out) != 1 || write_state(state, out) != 0)
+        return -1;
+    long end = ftell(out);
+    header.size = (uint64_t)(end - start) - sizeof(header);
+    if (end < 0 || fseek(out, start, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, out) != 1)
+        return -1;
+    return fseek(out, end, SEEK_SET);
+}
+
+static int write_cache_section(const void *cache, FILE *out) {
+    return write_cache_state((const cache_t *)cache, out);
+}
+
+static int write_predictor_section(const void *bp, FILE *out) {
+    return write_predictor_state((const branch_predictor_t *)bp, out);
+}
+
+// Save the architectural state of a core, its non-zero data memory pages
+// and the caches and predictor in uarch (may be NULL). Returns
+// CHECKPOINT_OK or CHECKPOINT_ERR_IO.
+int save_checkpoint(const char *path, const core_t *core, const uarch_state_t *uarch) {
+    FILE *out = fopen(path, "wb");
+    if (out == NULL)
+        return CHECKPOINT_ERR_IO;
+
+    page_writer_t writer = {out, 0, false};
+    for_each_page(core->data_mem, count_page, &writer);
+
+    checkpoint_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    header.version = CHECKPOINT_VERSION;
+    header.addr_bits = core->data_mem->addr_bits;
+    header.PC = core->PC;
+    header.clk = core->clk;
+    header.num_instructions = core->instr_mem->size;
+    header.program_hash = program_hash(core->instr_mem);
+    memcpy(header.reg_file, core->reg_file, sizeof(header.reg_file));
+    header.perf = core->perf;
+    header.num_pages = writer.count;
+    uint64_t index_end = sizeof(header) + writer.count * sizeof(uint64_t);
+    header.pages_offset = (index_end + DMEM_PAGE_SIZE - 1) & ~(uint64_t)(DMEM_PAGE_SIZE - 1);
+    if (uarch != NULL)
+        header.num_sections = (uarch->dcache != NULL) + (uarch->icache != NULL) + (uarch->predictor != NULL);
+
+    static const char padding[DMEM_PAGE_SIZE];
+    writer.failed = fwrite(&header, sizeof(header), 1, out) != 1;
+    for_each_page(core->data_mem, write_page_number, &writer);
+    writer.failed |= fwrite(padding, 1, header.pages_offset - index_end, out) != header.pages_offset - index_end;
+    for_each_page(core->data_mem, write_page, &writer);
+
+    bool failed = writer.failed;
+    if (!failed && uarch != NULL) {
+        if (uarch->dcache != NULL)
+            failed |= write_section(out, SECTION_DCACHE, uarch->dcache, write_cache_section) != 0;
+        if (uarch->icache != NULL)
+            failed |= write_section(out, SECTION_ICACHE, &uarch->icache->cache, write_cache_section) != 0;
+        if (uarch->predictor != NULL)
+            failed |= write_section(out, SECTION_PREDICTOR, uarch->predictor, write_predictor_section) != 0;
+    }
+    if (fclose(out) != 0)
+        failed = true;
+    return failed ? CHECKPOINT_ERR_IO : CHECKPOINT_OK;
+}
+
+// Load one section into the matching member of uarch. Sections with no
+// destination are skipped, so a run may leave a saved cache cold.
+static int restore_section(const section_header_t *section, const unsigned char *data, uarch_state_t *uarch) {
+    int status = 0;
+    if (section->kind == SECTION_DCACHE && uarch->dcache != NULL)
+        status = read_cache_state(uarch->dcache, data, section->size);
+    else if (section->kind == SECTION_ICACHE && uarch->icache != NULL)
+        status = read_cache_state(&uarch->icache->cache, data, section->size);
+    else if (section->kind == SECTION_PREDICTOR && uarch->predictor != NULL)
+        status = read_predictor_state(uarch->predictor, data, section->size);
+    return status == 0 ? CHECKPOINT_OK : CHECKPOINT_ERR_CONFIG;
+}
+
+static int restore_mapped(const unsigned char *map, size_t size, core_t *core, uarch_state_t *uarch) {
+    const checkpoint_header_t *header = (const checkpoint_header_t *)map;
+    if (size < sizeof(*header) || memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0 ||
+        header->version != CHECKPOINT_VERSION)
+        return CHECKPOINT_ERR_FORMAT;
+    if (header->num_instructions != core->instr_mem->size || header->program_hash != program_hash(core->instr_mem))
+        return CHECKPOINT_ERR_PROGRAM;
+    if (header->addr_bits != core->data_mem->addr_bits)
+        return CHECKPOINT_ERR_MEMORY;
+    if (header->num_pages > (size - sizeof(*header)) / (DMEM_PAGE_SIZE + sizeof(uint64_t)) ||
+        header->pages_offset > size || header->num_pages * DMEM_PAGE_SIZE > size - header->pages_offset)
+        return CHECKPOINT_ERR_FORMAT;
+
+    // Data memory: one allocation and copy per page
+    const uint64_t *page_numbers = (const uint64_t *)(map + sizeof(*header));
+    const dmem_page_t *pages = (const dmem_page_t *)(map + header->pages_offset);
+    for (uint64_t i = 0; i < header->num_pages; i++) {
+        dmem_page_t *page = dmem_alloc_page(core->data_mem, page_numbers[i] << DMEM_PAGE_SHIFT);
+        if (page == NULL)
+            return CHECKPOINT_ERR_NOMEM;
+        memcpy(page, &pages[i], sizeof(*page));
+    }
+
+    const unsigned char *p = map + header->pages_offset + header->num_pages * DMEM_PAGE_SIZE;
+    const unsigned char *end = map + size;
+    for (uint32_t i = 0; i < header->num_sections; i++) {
+        section_header_t section;
+        if ((size_t)(end - p) < sizeof(section))
+            return CHECKPOINT_ERR_FORMAT;
+        memcpy(&section, p, sizeof(section));
+        p += sizeof(section);
+        if (section.size > (size_t)(end - p))
+            return CHECKPOINT_ERR_FORMAT;
+        int status = uarch != NULL ? restore_section(&section, p, uarch) : CHECKPOINT_OK;
+        if (status != CHECKPOINT_OK)
+            return status;
+        p += section.size;
+    }
+
+    core->PC = header->PC;
+    core->clk = header->clk;
+    memcpy(core->reg_file, header->reg_file, sizeof(core->reg_file));
+    core->perf = header->perf;
+    return CHECKPOINT_OK;
+}
+
+// Restore a checkpoint into a fresh core running the same program on a data
+// memory of the same size. The file is mapped and its pages copied in; the
+// caches and predictor in uarch (may be NULL) must be initialized with the
+// configuration they were saved with. Returns CHECKPOINT_OK or an error.
+int restore_checkpoint(const char *path, core_t *core, uarch_state_t *uarch) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return CHECKPOINT_ERR_IO;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return CHECKPOINT_ERR_IO;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return CHECKPOINT_ERR_FORMAT;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return CHECKPOINT_ERR_IO;
+
+    int status = restore_mapped((const unsigned char *)map, st.st_size, core, uarch);
+    munmap(map, st.st_size);
+    return status;
+}
+
+const char *checkpoint_error_string(int status) {
+    switch (status) {
+    case CHECKPOINT_OK:          return "ok";
+    case CHECKPOINT_ERR_IO:      return "cannot read or write checkpoint file";
+    case CHECKPOINT_ERR_FORMAT:  return "not a valid checkpoint";
+    case CHECKPOINT_ERR_PROGRAM: return "checkpoint belongs to a different program";
+    case CHECKPOINT_ERR_MEMORY:  return "checkpoint has a different data memory size (--mem-bits)";
+    case CHECKPOINT_ERR_CONFIG:  return "cache or predictor configuration differs from the checkpoint";
+    case CHECKPOINT_ERR_NOMEM:   return "out of memory";
+    }
+    return "unknown error";
+}
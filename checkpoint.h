@@ -0,0 +1,54 @@
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include "core.h"
+#include "branch_predictor.h"
+
+#define CHECKPOINT_MAGIC "RVCKPT"   // 6 characters plus terminator, padded to 8
+#define CHECKPOINT_VERSION 1
+
+#define CHECKPOINT_OK            0
+#define CHECKPOINT_ERR_IO       -1 // File could not be opened, read or written
+#define CHECKPOINT_ERR_FORMAT   -2 // Not a checkpoint, or truncated
+#define CHECKPOINT_ERR_PROGRAM  -3 // Saved for a different program
+#define CHECKPOINT_ERR_MEMORY   -4 // Saved with a different data memory size
+#define CHECKPOINT_ERR_CONFIG   -5 // Cache or predictor saved with a different configuration
+#define CHECKPOINT_ERR_NOMEM    -6 // Data memory pages could not be allocated
+
+// Microarchitectural state saved with a checkpoint and carried into a run.
+// Any member may be NULL.
+typedef struct {
+    cache_t *dcache;
+    icache_t *icache;
+    branch_predictor_t *predictor;
+} uarch_state_t;
+
+// Header of a checkpoint file. It is followed by the page numbers of the
+// saved data memory pages, the pages themselves starting at a page-aligned
+// offset, and then one section per saved cache or predictor, all in host
+// byte order.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t addr_bits;        // Data memory address space
+    uint64_t PC;
+    uint64_t clk;
+    uint64_t num_instructions; // Program the checkpoint belongs to
+    uint64_t program_hash;     // hash_source of its instruction words
+    int64_t reg_file[NUM_REGISTERS];
+    perf_counters_t perf;
+    uint64_t num_pages;        // Non-zero data memory pages saved
+    uint64_t pages_offset;     // File offset of the first page
+    uint32_t num_sections;
+    uint32_t reserved;
+} checkpoint_header_t;
+
+// Function prototypes
+int init_uarch_state(uarch_state_t *uarch, const cache_config_t *dcache, const cache_config_t *icache,
+                     const bp_config_t *predictor, size_t num_instructions);
+void free_uarch_state(uarch_state_t *uarch);
+int save_checkpoint(const char *path, const core_t *core, const uarch_state_t *uarch);
+int restore_checkpoint(const char *path, core_t *core, uarch_state_t *uarch);
+const char *checkpoint_error_string(int status);
+
+#endif
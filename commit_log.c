@@ -0,0 +1,100 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "commit_log.h"
+#include "disasm.h"
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+
+#define WRITER_POLL_NS 200000 // Writer sleep while fewer than a batch of records wait
+
+// Write every waiting record to the file, one write per contiguous run.
+// After a failed write the records are still consumed so the core never
+// waits on a writer that cannot make progress.
+static void drain_ring(commit_log_t *log) {
+    void *records;
+    size_t count;
+    while ((count = spsc_ring_peek(&log->ring, &records)) > 0) {
+        if (!log->write_failed && fwrite(records, sizeof(commit_record_t), count, log->file) != count)
+            log->write_failed = true;
+        spsc_ring_release(&log->ring, count);
+    }
+}
+
+static void *writer_main(void *arg) {
+    commit_log_t *log = (commit_log_t *)arg;
+    struct timespec poll = {0, WRITER_POLL_NS};
+
+    for (;;) {
+        bool closing = __atomic_load_n(&log->closing, __ATOMIC_ACQUIRE);
+        if (closing || spsc_ring_size(&log->ring) >= COMMIT_LOG_BATCH_RECORDS)
+            drain_ring(log);
+        if (closing)
+            return NULL;
+        if (spsc_ring_size(&log->ring) < COMMIT_LOG_BATCH_RECORDS)
+            nanosleep(&poll, NULL);
+    }
+}
+
+// Create the file and start the writer thread. Returns 0 on success, -1 if
+// the file cannot be created or the ring or thread cannot be set up.
+int open_commit_log(commit_log_t *log, const char *path) {
+    memset(log, 0, sizeof(*log));
+    if (init_spsc_ring(&log->ring, sizeof(commit_record_t), COMMIT_LOG_RING_RECORDS) != 0)
+        return -1;
+    if ((log->file = fopen(path, "wb")) == NULL)
+        goto fail;
+    if (fwrite(COMMIT_LOG_MAGIC, 1, 8, log->file) != 8)
+        goto fail;
+    if (pthread_create(&log->writer, NULL, writer_main, log) != 0)
+        goto fail;
+    return 0;
+
+fail:
+    if (log->file != NULL)
+        fclose(log->file);
+    free_spsc_ring(&log->ring);
+    return -1;
+}
+
+// Flush the remaining records and close the file. Returns 0 on success, -1
+// if any write failed.
+int close_commit_log(commit_log_t *log) {
+    __atomic_store_n(&log->closing, 1, __ATOMIC_RELEASE);
+    pthread_join(log->writer, NULL);
+    bool failed = log->write_failed;
+    if (fclose(log->file) != 0)
+        failed = true;
+    free_spsc_ring(&log->ring);
+    return failed ? -1 : 0;
+}
+
+// Called by the core when the ring is full: give the writer the CPU
+void commit_log_wait(commit_log_t *log) {
+    (void)log;
+    sched_yield();
+}
+
+// Check the magic number at the start of a commit log. Returns 0 if it
+// matches, -1 otherwise.
+int read_commit_log_header(FILE *file) {
+    char magic[8];
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic))
+        return -1;
+    return memcmp(magic, COMMIT_LOG_MAGIC, sizeof(magic)) == 0 ? 0 : -1;
+}
+
+// One line of text: clock, PC, instruction word and disassembly, then the
+// register and memory effects
+void format_commit_record(const commit_record_t *record, char *buffer, size_t size) {
+    char text[DISASM_MAX_LENGTH];
+    disassemble(record->instruction, text, sizeof(text));
+    int n = snprintf(buffer, size, "%llu \t%llu \t%08x \t%s", (unsigned long long)record->clk,
+                     (unsigned long long)record->PC, record->instruction, text);
+    if (n >= 0 && (size_t)n < size && (record->flags & COMMIT_REG_WRITE))
+        n += snprintf(buffer + n, size - n, " \tx%u = %lld", record->rd, (long long)record->rd_value);
+    if (n >= 0 && (size_t)n < size && (record->flags & (COMMIT_MEM_READ | COMMIT_MEM_WRITE)))
+        snprintf(buffer + n, size - n, " \tmem[%llu]:%u %s 0x%llx", (unsigned long long)record->mem_addr,
+                 record->mem_size, (record->flags & COMMIT_MEM_WRITE) ? "<-" : "->",
+                 (unsigned long long)record->mem_data);
+}
@@ -0,0 +1,62 @@
+#ifndef __COMMIT_LOG_H__
+#define __COMMIT_LOG_H__
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "spsc_ring.h"
+
+#define COMMIT_LOG_MAGIC "RVCLOG01"         // First 8 bytes of a commit log file
+#define COMMIT_LOG_RING_RECORDS (1u << 16)  // Records buffered between core and writer
+#define COMMIT_LOG_BATCH_RECORDS 4096       // Records the writer waits for per write
+#define COMMIT_LOG_TEXT_LENGTH 160          // Longest formatted record, with terminator
+
+// Record flags
+#define COMMIT_REG_WRITE 1
+#define COMMIT_MEM_READ 2
+#define COMMIT_MEM_WRITE 4
+
+// One retired instruction, 48 bytes. Files hold the records in host byte
+// order after the magic number.
+typedef struct {
+    uint64_t clk;        // Core clock at retirement
+    uint64_t PC;
+    uint64_t rd_value;   // Value written to rd, COMMIT_REG_WRITE only
+    uint64_t mem_addr;   // Effective address, loads and stores only
+    uint64_t mem_data;   // Value loaded or stored, truncated to mem_size bytes
+    uint32_t instruction;
+    uint8_t rd;
+    uint8_t flags;       // COMMIT_* bits
+    uint8_t mem_size;    // Bytes accessed
+    uint8_t reserved;
+} commit_record_t;
+
+// Commit log file fed from the core through a ring buffer. A writer thread
+// drains the ring to the file in batches, so the core only copies one
+// record per instruction.
+typedef struct commit_log_s {
+    spsc_ring_t ring;
+    FILE *file;
+    pthread_t writer;
+    int closing;         // Set by close_commit_log, read by the writer
+    bool write_failed;
+    uint64_t records;    // Records appended
+} commit_log_t;
+
+// Function prototypes
+int open_commit_log(commit_log_t *log, const char *path);
+int close_commit_log(commit_log_t *log);
+void commit_log_wait(commit_log_t *log);
+int read_commit_log_header(FILE *file);
+void format_commit_record(const commit_record_t *record, char *buffer, size_t size);
+
+// Append a record, waiting for the writer if the ring is full
+static inline void commit_log_append(commit_log_t *log, const commit_record_t *record) {
+    while (!spsc_ring_push(&log->ring, record))
+        commit_log_wait(log);
+    log->records++;
+}
+
+#endif
@@ -0,0 +1,51 @@
+/* Decoder for binary commit logs written with --commit-log.
+ *
+ * Prints one line per retired instruction: clock, PC, instruction word,
+ * disassembly, and the register and memory values it wrote or read.
+ *
+ * Execute as follows:
+ *  $./commit_log_dump <commit log file>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "commit_log.h"
+
+#define READ_RECORDS 4096 // Records read per fread
+
+int main(int argc, const char **argv)
+{
+    if (argc != 2) {
+        printf("Usage: %s <commit-log-file>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    FILE *file = fopen(argv[1], "rb");
+    if (file == NULL) {
+        perror("Cannot open commit log.");
+        return EXIT_FAILURE;
+    }
+    if (read_commit_log_header(file) != 0) {
+        fprintf(stderr, "%s is not a commit log\n", argv[1]);
+        fclose(file);
+        return EXIT_FAILURE;
+    }
+
+    commit_record_t *records = (commit_record_t *)malloc(READ_RECORDS * sizeof(commit_record_t));
+    if (records == NULL) {
+        fclose(file);
+        return EXIT_FAILURE;
+    }
+    size_t count;
+    char line[COMMIT_LOG_TEXT_LENGTH];
+    while ((count = fread(records, sizeof(commit_record_t), READ_RECORDS, file)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            format_commit_record(&records[i], line, sizeof(line));
+            puts(line);
+        }
+    }
+    int status = ferror(file) ? EXIT_FAILURE : EXIT_SUCCESS;
+    free(records);
+    fclose(file);
+    return status;
+}
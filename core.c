@@ -1,4 +1,7 @@
+#define _POSIX_C_SOURCE 200809L
 #include "core.h"
+#include "lockstep.h"
+#include "self_profile.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
@@ -6,31 +9,65 @@
 
 // Initialize core function
 core_t *init_core(instruction_memory_t *i_mem) {
+    return init_core_with_memory(i_mem, NULL);
+}
+
+// Initialize a core on an existing data memory, which the core will not
+// free. With NULL the core gets a private memory of the default size.
+core_t *init_core_with_memory(instruction_memory_t *i_mem, data_memory_t *data_mem) {
     core_t *core = (core_t *)malloc(sizeof(core_t));
     if (core == NULL)
         return NULL;
 
+    core->owns_data_mem = (data_mem == NULL);
+    if (data_mem == NULL && (data_mem = new_data_memory(DMEM_DEFAULT_ADDR_BITS)) == NULL) {
+        free(core);
+        return NULL;
+    }
+    core->data_mem = data_mem;
+
     core->clk = 0;
     core->PC = 0;
     core->instr_mem = i_mem;
+    core->decoded = NULL;
+    core->dcache = NULL;
+    core->icache = NULL;
+    core->profile = NULL;
+    core->commit_log = NULL;
+    core->lockstep = NULL;
     core->tick = tick_func;
 
-    // Initialize data memory and register file
-    memset(core->data_mem, 0, MEM_SIZE * sizeof(uint8_t));
+    // Initialize register file; data memory pages are allocated on first store
     memset(core->reg_file, 0, NUM_REGISTERS * sizeof(signal_t));
+    memset(&core->perf, 0, sizeof(core->perf));
 
     return core;
 }
 
+void free_core(core_t *core) {
+    if (core == NULL)
+        return;
+    if (core->owns_data_mem)
+        free_data_memory(core->data_mem);
+    free(core);
+}
+
 // Define tick function to manage core execution
 bool tick_func(core_t *core) {
-    // Step 1: Fetch
+    addr_t PC = core->PC;
+    tick_t start = core->clk;
+    SELF_PROFILE_START(timer);
+
+    // Step 1: Fetch; an instruction cache miss stalls the core
+    if (core->icache != NULL)
+        core->clk += icache_fetch(core->icache, core->PC);
     unsigned instruction = fetch_instruction(core);
+    SELF_PROFILE_LAP(timer, SELF_PROFILE_FETCH);
 
     // Step 2: Decode
     signal_t opcode = instruction & 0x7F;
     signal_t funct3 = (instruction >> 12) & 0x7;
-    signal_t funct7 = (instruction >> 25) & 0x7F;
+    signal_t funct7 = (opcode == 51) ? (instruction >> 25) & 0x7F : 0; // Only R-type has funct7
 
     control_signals_t signals;
     control_unit(opcode, &signals);
@@ -57,26 +94,37 @@ bool tick_func(core_t *core) {
     // Determine ALU control signal explicitly
     signal_t ALU_ctrl_signal = ALU_control_unit(signals.ALUOp, funct7, funct3);
     //printf("ALU control signal: %d\n", ALU_ctrl_signal);
+    SELF_PROFILE_LAP(timer, SELF_PROFILE_DECODE);
 
     // Execute ALU operation
     signal_t ALU_result, zero;
     ALU(ALU_input_1, ALU_input_2, ALU_ctrl_signal, &ALU_result, &zero);
     //printf("ALU result: %lld, Zero flag: %d\n", ALU_result, zero);
+    SELF_PROFILE_LAP(timer, SELF_PROFILE_EXECUTE);
 
     // Step 4: Memory Access
     memory_access_stage(core, &signals, instruction, ALU_result, rs2_val);
+    SELF_PROFILE_LAP(timer, SELF_PROFILE_MEMORY);
 
     // Step 5: Write Back
     write_back_stage(core, &signals, instruction, ALU_result);
+    SELF_PROFILE_LAP(timer, SELF_PROFILE_WRITEBACK);
 
     // Step 6: PC Update
     update_pc_stage(core, &signals, imm, zero);
+    SELF_PROFILE_LAP(timer, SELF_PROFILE_PC_UPDATE);
 
     // Step 7: Clock increment and halt condition check
+    perf_count(&core->perf, classify_signals(&signals), funct3, signals.Branch && zero);
     ++core->clk;
+    if (core->profile != NULL)
+        profile_record(core->profile, PC, core->clk - start, signals.Branch && zero);
+    if (core_logs_commits(core))
+        log_commit(core, core->clk, PC, instruction, commit_flags(&signals), ALU_result, rs2_val);
+    SELF_PROFILE_LAP(timer, SELF_PROFILE_RETIRE);
 
     // Halting condition: if the PC is beyond the last address of instruction memory
-    if (core->PC > core->instr_mem->last->addr) {
+    if (core->PC / 4 >= core->instr_mem->size) {
         return false;
     }
 
@@ -91,14 +139,18 @@ unsigned fetch_instruction(core_t *core) {
 
 // Function to handle memory access
 void memory_access_stage(core_t *core, control_signals_t *signals, unsigned instruction, signal_t ALU_result, signal_t rs2_val) {
+    unsigned funct3 = (instruction >> 12) & 0x7; // Access width: byte, half, word or double
+
+    // Data cache miss latency stalls the core
+    if (core->dcache != NULL && (signals->MemWrite || signals->MemtoReg))
+        core->clk += cache_access(core->dcache, ALU_result & core->data_mem->addr_mask, signals->MemWrite);
+
     if (signals->MemWrite) {
-        for (int i = 0; i < 8; i++) { // Handle 64-bit store
-            core->data_mem[ALU_result + i] = (rs2_val >> (i * 8)) & 0xFF;
-        }
+        dmem_write(core->data_mem, ALU_result, rs2_val, funct3);
     }
 
     if (signals->MemtoReg) {
-        core->reg_file[(instruction >> 7) & 0x1F] = core->data_mem[ALU_result];
+        core->reg_file[(instruction >> 7) & 0x1F] = dmem_read(core->data_mem, ALU_result, funct3);
     }
 }
 
@@ -109,6 +161,53 @@ void write_back_stage(core_t *core, control_signals_t *signals, unsigned instruc
     }
 }
 
+// Opcode class of an instruction from its control signals
+opclass_t classify_signals(const control_signals_t *signals) {
+    if (signals->MemWrite)
+        return OPCLASS_STORE;
+    if (signals->MemtoReg)
+        return OPCLASS_LOAD;
+    if (signals->Branch)
+        return OPCLASS_BRANCH;
+    if (signals->RegWrite)
+        return signals->ALUSrc ? OPCLASS_I : OPCLASS_R;
+    return OPCLASS_OTHER;
+}
+
+// Commit log flags of an instruction from its control signals
+unsigned commit_flags(const control_signals_t *signals) {
+    return (signals->RegWrite ? COMMIT_REG_WRITE : 0) | (signals->MemtoReg ? COMMIT_MEM_READ : 0) |
+           (signals->MemWrite ? COMMIT_MEM_WRITE : 0);
+}
+
+// Append a retired instruction to the commit log. Called once the
+// instruction has written back, so rd already holds its result; mem_addr
+// and store_data are the effective address and the rs2 value of a store.
+void log_commit(core_t *core, tick_t clk, addr_t PC, unsigned instruction, unsigned flags,
+                signal_t mem_addr, signal_t store_data) {
+    commit_record_t record;
+    memset(&record, 0, sizeof(record));
+    record.clk = clk;
+    record.PC = PC;
+    record.instruction = instruction;
+    record.flags = (uint8_t)flags;
+    if (flags & COMMIT_REG_WRITE) {
+        record.rd = (instruction >> 7) & 0x1F;
+        record.rd_value = (uint64_t)core->reg_file[record.rd];
+    }
+    if (flags & (COMMIT_MEM_READ | COMMIT_MEM_WRITE)) {
+        unsigned size = ACCESS_BYTES((instruction >> 12) & 0x7);
+        uint64_t mask = size < 8 ? ((uint64_t)1 << (8 * size)) - 1 : UINT64_MAX;
+        record.mem_addr = (uint64_t)mem_addr;
+        record.mem_size = (uint8_t)size;
+        record.mem_data = (uint64_t)((flags & COMMIT_MEM_WRITE) ? store_data : core->reg_file[record.rd]) & mask;
+    }
+    if (core->commit_log != NULL)
+        commit_log_append(core->commit_log, &record);
+    if (core->lockstep != NULL)
+        lockstep_push(core->lockstep, &record);
+}
+
 // Function to handle branch and PC update
 void update_pc_stage(core_t *core, control_signals_t *signals, signal_t imm, signal_t zero) {
     if (signals->Branch && zero) {
@@ -147,6 +246,7 @@ void control_unit(signal_t input, control_signals_t *signals) {
         //printf("Control signals set for I-type (addi or slli)\n");
     } else if (input == 35) { // sd (S-type)
         signals->ALUSrc = 1;
+        signals->MemtoReg = 0;
         signals->RegWrite = 0;
         signals->MemRead = 0;
         signals->MemWrite = 1;
@@ -154,11 +254,20 @@ void control_unit(signal_t input, control_signals_t *signals) {
         signals->ALUOp = 0;
     } else if (input == 99) { // beq (SB-type)
         signals->ALUSrc = 0;
+        signals->MemtoReg = 0;
         signals->RegWrite = 0;
         signals->MemRead = 0;
         signals->MemWrite = 0;
         signals->Branch = 1;
         signals->ALUOp = 1;
+    } else { // Unsupported opcode, executes as a nop
+        signals->ALUSrc = 0;
+        signals->MemtoReg = 0;
+        signals->RegWrite = 0;
+        signals->MemRead = 0;
+        signals->MemWrite = 0;
+        signals->Branch = 0;
+        signals->ALUOp = 0;
     }
 }
 
@@ -183,6 +292,9 @@ signal_t ALU_control_unit(signal_t ALUOp, signal_t Funct7, signal_t Funct3) {
     if (ALUOp == 0) {
         return 2;  // addition for ld/sd
     }
+    if (ALUOp == 1) {
+        return 6;  // subtraction for beq
+    }
 
     return 0;
 }
@@ -195,7 +307,7 @@ signal_t imm_gen(signal_t input) {
     if (opcode == 3 || opcode == 19) { // I-type
         imm = (input >> 20) & 0xFFF;
         if (imm & 0x800) {
-            imm |= 0xFFFFF000; // Sign extend to 32 bits
+            imm |= ~(signal_t)0xFFF; // Sign extend to 64 bits
         }
         //printf("imm_gen (I-type) - Immediate: 0x%08x\n", imm);
     } else if (opcode == 35) { // S-type
@@ -203,7 +315,7 @@ signal_t imm_gen(signal_t input) {
         signal_t imm11_5 = (input >> 25) & 0x7F;
         imm = (imm11_5 << 5) | imm4_0;
         if (imm & 0x800) {
-            imm |= 0xFFFFF000; // Sign extend to 32 bits
+            imm |= ~(signal_t)0xFFF; // Sign extend to 64 bits
         }
         //printf("imm_gen (S-type) - Immediate: 0x%08x\n", imm);
     } else if (opcode == 99) { // SB-type
@@ -213,7 +325,7 @@ signal_t imm_gen(signal_t input) {
         signal_t imm12 = (input >> 31) & 0x1;
         imm = (imm12 << 12) | (imm11 << 11) | (imm10_5 << 5) | (imm4_1 << 1);
         if (imm & 0x1000) {
-            imm |= 0xFFFFE000; // Sign extend to 32 bits
+            imm |= ~(signal_t)0x1FFF; // Sign extend to 64 bits
         }
         //printf("imm_gen (SB-type) - Immediate: 0x%08x\n", imm);
     }
@@ -236,11 +348,11 @@ void ALU(signal_t input_0, signal_t input_1, signal_t ALU_ctrl_signal, signal_t
         *zero = (*ALU_result == 0);
     }
     if (ALU_ctrl_signal == 1) {
-        *ALU_result = (input_0 || input_1);
+        *ALU_result = (input_0 | input_1);
         *zero = (*ALU_result == 0);
     }
     if (ALU_ctrl_signal == 3) {  // 3 is for SLLI
-        *ALU_result = input_0 << input_1;
+        *ALU_result = (uint64_t)input_0 << (input_1 & 0x3F);
         *zero = (*ALU_result == 0);
     }
 }
@@ -264,34 +376,70 @@ void print_core_state(core_t *core) {
 
 // Function to print data memory for debugging
 void print_data_memory(core_t *core, unsigned int start, unsigned int end) {
-    if ((start >= MEM_SIZE) || (end > MEM_SIZE)) {
-        printf("Address range [%d, %d) is invalid\n", start, end);
-        return;
+    printf("Data memory: bytes (in hex) within address range [%d, %d)\n", start, end);
+    for (unsigned int i = start; i < end; i++)
+        printf("%d: \t %02x\n", i, (unsigned)dmem_load(core->data_mem, i, 1));
+}
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t size) {
+    const byte_t *bytes = (const byte_t *)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
     }
+    return hash;
+}
 
-    printf("Data memory: bytes (in hex) within address range [%d, %d)\n", start, end);
-    for (int i = start; i < end; i++)
-        printf("%d: \t %02x\n", i, core->data_mem[i]);
+// FNV-1a hash of the architectural state: PC, register file and every
+// non-zero data memory page with its address
+uint64_t core_state_hash(core_t *core) {
+    static const dmem_page_t zero_page;
+    const data_memory_t *mem = core->data_mem;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    hash = fnv1a(hash, &core->PC, sizeof(core->PC));
+    hash = fnv1a(hash, core->reg_file, sizeof(core->reg_file));
+    for (size_t t = 0; t < mem->num_tables; t++) {
+        if (mem->tables[t] == NULL)
+            continue;
+        for (size_t p = 0; p < DMEM_L2_SIZE; p++) {
+            const dmem_page_t *page = mem->tables[t]->pages[p];
+            if (page == NULL || memcmp(page, &zero_page, sizeof(zero_page)) == 0)
+                continue;
+            uint64_t page_number = t * DMEM_L2_SIZE + p;
+            hash = fnv1a(hash, &page_number, sizeof(page_number));
+            hash = fnv1a(hash, page->bytes, DMEM_PAGE_SIZE);
+        }
+    }
+    return hash;
 }
 
-// Main simulator function
-int simulator_main(instruction_memory_t *instr_mem) {
+// Main simulator function. Every retired instruction goes to the binary
+// commit log at commit_log_path, which commit_log_dump turns back into text.
+int simulator_main(instruction_memory_t *instr_mem, const char *commit_log_path) {
     core_t *core = init_core(instr_mem);
     if (core == NULL) {
         printf("Failed to initialize core\n");
         return -1;
     }
 
-    while (tick_func(core)) {
-        print_core_state(core);
-        printf("Clock Cycle: %d\n", core->clk);
+    commit_log_t log;
+    if (open_commit_log(&log, commit_log_path) != 0) {
+        printf("Failed to open commit log %s\n", commit_log_path);
+        free_core(core);
+        return -1;
     }
+    core->commit_log = &log;
+    while (tick_func(core));
+    core->commit_log = NULL;
+    if (close_commit_log(&log) != 0)
+        printf("Failed to write commit log %s\n", commit_log_path);
 
     printf("Simulation completed\n");
-    print_data_memory(core, 0, MEM_SIZE);
+    print_data_memory(core, 0, 32);
 
     // Free allocated memory
-    free(core);
+    free_core(core);
 
     return 0;
 }
@@ -2,27 +2,42 @@
 #define __CORE_H__
 
 #include "instruction_memory.h"
+#include "decoded_instruction.h"
+#include "data_memory.h"
+#include "cache.h"
+#include "icache.h"
+#include "perf_counters.h"
+#include "profiler.h"
+#include "commit_log.h"
 
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
 
-#define MEM_SIZE 1024       // Size of memory in bytes 
 #define NUM_REGISTERS 32    // Size of register file 
 
-typedef uint8_t byte_t;
 typedef int64_t signal_t;
 typedef int64_t register_t;
 typedef uint64_t tick_t;
 typedef uint64_t addr_t; // Change to match instruction.h
 
+struct lockstep_s;
+
 // Definition of the RISC-V core
 typedef struct core_s {
     tick_t clk;                         // Core clock
     addr_t PC;                          // Program counter
     instruction_memory_t *instr_mem;    // Instruction memory 
-    byte_t data_mem[MEM_SIZE];          // Data memory
+    decode_cache_t *decoded;            // Pre-decoded instruction memory, NULL if not built
+    data_memory_t *data_mem;            // Data memory
+    bool owns_data_mem;                 // Free data_mem with the core
+    cache_t *dcache;                    // L1 data cache timing model, NULL for none
+    icache_t *icache;                   // Instruction cache timing model, NULL for none
+    perf_counters_t perf;               // Performance counters
+    guest_profile_t *profile;           // Per-PC profile, NULL when not profiling
+    commit_log_t *commit_log;           // Retired-instruction log, NULL when not logging
+    struct lockstep_s *lockstep;        // Lockstep checker fed at retirement, NULL when not checking
     register_t reg_file[NUM_REGISTERS]; // Register file
     bool (*tick)(struct core_s *core);  // Simulate function pointer
 } core_t;
@@ -38,11 +53,24 @@ typedef struct control_signals_s {
     signal_t RegWrite;
 } control_signals_t;
 
+// Whether retired instructions are logged or checked: the engines call
+// log_commit only then
+static inline bool core_logs_commits(const core_t *core) {
+    return core->commit_log != NULL || core->lockstep != NULL;
+}
+
 // Function prototypes
 core_t *init_core(instruction_memory_t *i_mem);
+core_t *init_core_with_memory(instruction_memory_t *i_mem, data_memory_t *data_mem);
+void free_core(core_t *core);
 bool tick_func(core_t *core);
 void print_core_state(core_t *core);
 void print_data_memory(core_t *core, unsigned int start, unsigned int end);
+uint64_t core_state_hash(core_t *core);
+opclass_t classify_signals(const control_signals_t *signals);
+unsigned commit_flags(const control_signals_t *signals);
+void log_commit(core_t *core, tick_t clk, addr_t PC, unsigned instruction, unsigned flags,
+                signal_t mem_addr, signal_t store_data);
 void control_unit(signal_t input, control_signals_t *signals);
 signal_t ALU_control_unit(signal_t ALUOp, signal_t funct7, signal_t funct3);
 signal_t imm_gen(signal_t input);
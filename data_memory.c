@@ -0,0 +1,186 @@
+#include "data_memory.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Allocate an empty memory with a 2^addr_bits byte address space. Only the
+// first-level table is allocated up front.
+data_memory_t *new_data_memory(unsigned addr_bits) {
+    if (addr_bits < DMEM_MIN_ADDR_BITS || addr_bits > DMEM_MAX_ADDR_BITS)
+        return NULL;
+
+    data_memory_t *mem = (data_memory_t *)malloc(sizeof(data_memory_t));
+    if (mem == NULL)
+        return NULL;
+
+    mem->addr_bits = addr_bits;
+    mem->addr_mask = ((addr_t)1 << addr_bits) - 1;
+    mem->num_tables = addr_bits > DMEM_L1_SHIFT ? (size_t)1 << (addr_bits - DMEM_L1_SHIFT) : 1;
+    mem->num_pages = 0;
+    mem->base = NULL;
+    mem->refs = 1;
+    mem->tables = (dmem_table_t **)calloc(mem->num_tables, sizeof(dmem_table_t *));
+    if (mem->tables == NULL) {
+        free(mem);
+        return NULL;
+    }
+    return mem;
+}
+
+static bool page_shared(const dmem_table_t *table, size_t index) {
+    return (table->shared[index / 64] >> (index % 64)) & 1;
+}
+
+// Drop the owner's reference. The memory is freed once its forks are gone
+// too, and a fork releases its base in turn.
+void free_data_memory(data_memory_t *mem) {
+    if (mem == NULL || __atomic_sub_fetch(&mem->refs, 1, __ATOMIC_ACQ_REL) != 0)
+        return;
+    for (size_t t = 0; t < mem->num_tables; t++) {
+        dmem_table_t *table = mem->tables[t];
+        if (table == NULL)
+            continue;
+        for (size_t p = 0; p < DMEM_L2_SIZE; p++) {
+            if (!page_shared(table, p))
+                free(table->pages[p]);
+        }
+        free(table);
+    }
+    data_memory_t *base = mem->base;
+    free(mem->tables);
+    free(mem);
+    free_data_memory(base);
+}
+
+// New memory with the contents of base, sharing its pages until the first
+// store to each. Only the page tables are copied. base stays allocated
+// until the fork is freed and must not be written meanwhile. Returns NULL
+// on allocation failure.
+data_memory_t *fork_data_memory(data_memory_t *base) {
+    data_memory_t *mem = new_data_memory(base->addr_bits);
+    if (mem == NULL)
+        return NULL;
+    for (size_t t = 0; t < base->num_tables; t++) {
+        const dmem_table_t *src = base->tables[t];
+        if (src == NULL)
+            continue;
+        dmem_table_t *table = (dmem_table_t *)calloc(1, sizeof(dmem_table_t));
+        if (table == NULL) {
+            free_data_memory(mem);
+            return NULL;
+        }
+        for (size_t p = 0; p < DMEM_L2_SIZE; p++) {
+            table->pages[p] = src->pages[p];
+            if (src->pages[p] != NULL)
+                table->shared[p / 64] |= (uint64_t)1 << (p % 64);
+        }
+        mem->tables[t] = table;
+    }
+    mem->base = base;
+    __atomic_fetch_add(&base->refs, 1, __ATOMIC_RELAXED);
+    return mem;
+}
+
+// Deep copy of a memory and every allocated page. Returns NULL on
+// allocation failure.
+data_memory_t *clone_data_memory(const data_memory_t *src) {
+    data_memory_t *mem = new_data_memory(src->addr_bits);
+    if (mem == NULL)
+        return NULL;
+    for (size_t t = 0; t < src->num_tables; t++) {
+        if (src->tables[t] == NULL)
+            continue;
+        for (size_t p = 0; p < DMEM_L2_SIZE; p++) {
+            const dmem_page_t *page = src->tables[t]->pages[p];
+            if (page == NULL)
+                continue;
+            dmem_page_t *copy = dmem_alloc_page(mem, ((addr_t)t << DMEM_L1_SHIFT) | ((addr_t)p << DMEM_PAGE_SHIFT));
+            if (copy == NULL) {
+                free_data_memory(mem);
+                return NULL;
+            }
+            memcpy(copy, page, sizeof(*page));
+        }
+    }
+    return mem;
+}
+
+// Replace a page shared with the base memory by a private copy
+static dmem_page_t *unshare_page(data_memory_t *mem, dmem_table_t *table, size_t index, addr_t addr) {
+    dmem_page_t *original = dmem_lookup(mem->base, addr);
+    dmem_page_t *page = __atomic_load_n(&table->pages[index], __ATOMIC_ACQUIRE);
+    if (page == original) {
+        dmem_page_t *copy = (dmem_page_t *)malloc(sizeof(dmem_page_t));
+        if (copy == NULL)
+            return NULL;
+        memcpy(copy, original, sizeof(*copy));
+        if (__atomic_compare_exchange_n(&table->pages[index], &page, copy, false, __ATOMIC_ACQ_REL,
+                                        __ATOMIC_ACQUIRE)) {
+            page = copy;
+            __atomic_fetch_add(&mem->num_pages, 1, __ATOMIC_RELAXED);
+        } else {
+            free(copy);
+        }
+    }
+    __atomic_fetch_and(&table->shared[index / 64], ~((uint64_t)1 << (index % 64)), __ATOMIC_RELEASE);
+    return page;
+}
+
+// Allocate the zero-filled page holding an address, or make a private copy
+// of a page shared with the base memory. Safe to call from several threads:
+// each missing table or page is installed with a CAS, and the loser of a
+// race frees its copy and uses the winner's.
+dmem_page_t *dmem_alloc_page(data_memory_t *mem, addr_t addr) {
+    addr &= mem->addr_mask;
+    dmem_table_t **slot = &mem->tables[addr >> DMEM_L1_SHIFT];
+    dmem_table_t *table = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    if (table == NULL) {
+        dmem_table_t *fresh = (dmem_table_t *)calloc(1, sizeof(dmem_table_t));
+        if (fresh == NULL)
+            return NULL;
+        if (__atomic_compare_exchange_n(slot, &table, fresh, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            table = fresh;
+        else
+            free(fresh);
+    }
+
+    size_t index = (addr >> DMEM_PAGE_SHIFT) & (DMEM_L2_SIZE - 1);
+    if ((__atomic_load_n(&table->shared[index / 64], __ATOMIC_ACQUIRE) >> (index % 64)) & 1)
+        return unshare_page(mem, table, index, addr);
+    dmem_page_t **page_slot = &table->pages[index];
+    dmem_page_t *page = __atomic_load_n(page_slot, __ATOMIC_ACQUIRE);
+    if (page == NULL) {
+        dmem_page_t *fresh = (dmem_page_t *)calloc(1, sizeof(dmem_page_t));
+        if (fresh == NULL)
+            return NULL;
+        if (__atomic_compare_exchange_n(page_slot, &page, fresh, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            page = fresh;
+            __atomic_fetch_add(&mem->num_pages, 1, __ATOMIC_RELAXED);
+        } else {
+            free(fresh);
+        }
+    }
+    return page;
+}
+
+// Byte-at-a-time load, for accesses that cross a page
+uint64_t dmem_load_slow(data_memory_t *mem, addr_t addr, unsigned size) {
+    uint64_t value = 0;
+    for (unsigned i = 0; i < size; i++) {
+        addr_t a = addr + i;
+        const dmem_page_t *page = dmem_lookup(mem, a);
+        if (page != NULL)
+            value |= (uint64_t)page->bytes[a & (DMEM_PAGE_SIZE - 1)] << (i * 8);
+    }
+    return value;
+}
+
+// Byte-at-a-time store, for accesses that cross a page
+void dmem_store_slow(data_memory_t *mem, addr_t addr, uint64_t value, unsigned size) {
+    for (unsigned i = 0; i < size; i++) {
+        addr_t a = addr + i;
+        dmem_page_t *page = dmem_lookup_write(mem, a);
+        if (page == NULL && (page = dmem_alloc_page(mem, a)) == NULL)
+            return;
+        page->bytes[a & (DMEM_PAGE_SIZE - 1)] = (value >> (i * 8)) & 0xFF;
+    }
+}
@@ -0,0 +1,144 @@
+#ifndef __DATA_MEMORY_H__
+#define __DATA_MEMORY_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "instruction.h"
+
+typedef uint8_t byte_t;
+
+#define DMEM_PAGE_SHIFT 12                      // 4 KiB pages
+#define DMEM_PAGE_SIZE (1 << DMEM_PAGE_SHIFT)
+#define DMEM_L2_BITS 10                         // Pages per second-level table
+#define DMEM_L2_SIZE (1 << DMEM_L2_BITS)
+#define DMEM_L1_SHIFT (DMEM_PAGE_SHIFT + DMEM_L2_BITS)
+#define DMEM_DEFAULT_ADDR_BITS 32               // Default address space: 4 GiB
+#define DMEM_MIN_ADDR_BITS DMEM_PAGE_SHIFT
+#define DMEM_MAX_ADDR_BITS 48
+
+typedef struct {
+    byte_t bytes[DMEM_PAGE_SIZE];
+} dmem_page_t;
+
+#define DMEM_SHARED_WORDS (DMEM_L2_SIZE / 64)
+
+// Second-level page table. A page whose shared bit is set belongs to the
+// base memory of a fork and is copied on the first store to it.
+typedef struct {
+    dmem_page_t *pages[DMEM_L2_SIZE];
+    uint64_t shared[DMEM_SHARED_WORDS];
+} dmem_table_t;
+
+// Sparse data memory. Addresses are truncated to addr_bits; pages and
+// second-level tables are allocated on first store, and reads of pages
+// that were never written return zero. Tables and pages are published
+// with compare-and-swap, so harts on several threads can share a memory
+// without locks. A fork starts with the pages of a base memory, shared
+// copy-on-write; the base must not be written while forks exist.
+typedef struct data_memory_s {
+    dmem_table_t **tables; // First level, one entry per 4 MiB
+    size_t num_tables;
+    unsigned addr_bits;
+    addr_t addr_mask;
+    size_t num_pages;      // Private pages allocated so far, updated atomically
+    struct data_memory_s *base; // Memory whose pages this fork shares, NULL if none
+    unsigned refs;         // Owner plus live forks; freed when it drops to zero
+} data_memory_t;
+
+// Function prototypes
+data_memory_t *new_data_memory(unsigned addr_bits);
+void free_data_memory(data_memory_t *mem);
+data_memory_t *clone_data_memory(const data_memory_t *src);
+data_memory_t *fork_data_memory(data_memory_t *base);
+dmem_page_t *dmem_alloc_page(data_memory_t *mem, addr_t addr);
+uint64_t dmem_load_slow(data_memory_t *mem, addr_t addr, unsigned size);
+void dmem_store_slow(data_memory_t *mem, addr_t addr, uint64_t value, unsigned size);
+
+// Page holding an address, NULL if it was never written. The acquire loads
+// pair with the publishing CAS in dmem_alloc_page; they are plain loads on
+// x86.
+static inline dmem_page_t *dmem_lookup(const data_memory_t *mem, addr_t addr) {
+    addr &= mem->addr_mask;
+    dmem_table_t *table = __atomic_load_n(&mem->tables[addr >> DMEM_L1_SHIFT], __ATOMIC_ACQUIRE);
+    return table ? __atomic_load_n(&table->pages[(addr >> DMEM_PAGE_SHIFT) & (DMEM_L2_SIZE - 1)], __ATOMIC_ACQUIRE)
+                 : NULL;
+}
+
+// Page holding an address for a store: NULL if it was never written or is
+// still shared with the base memory, in which case dmem_alloc_page makes
+// it private
+static inline dmem_page_t *dmem_lookup_write(const data_memory_t *mem, addr_t addr) {
+    addr &= mem->addr_mask;
+    dmem_table_t *table = __atomic_load_n(&mem->tables[addr >> DMEM_L1_SHIFT], __ATOMIC_ACQUIRE);
+    if (table == NULL)
+        return NULL;
+    size_t index = (addr >> DMEM_PAGE_SHIFT) & (DMEM_L2_SIZE - 1);
+    if ((__atomic_load_n(&table->shared[index / 64], __ATOMIC_ACQUIRE) >> (index % 64)) & 1)
+        return NULL;
+    return __atomic_load_n(&table->pages[index], __ATOMIC_ACQUIRE);
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define DMEM_HOST_BIG_ENDIAN 1
+#endif
+
+// Little-endian load of 1, 2, 4 or 8 bytes. Accesses that stay within one
+// page are a single host load.
+static inline uint64_t dmem_load(data_memory_t *mem, addr_t addr, unsigned size) {
+    unsigned offset = addr & (DMEM_PAGE_SIZE - 1);
+#ifndef DMEM_HOST_BIG_ENDIAN
+    if (offset + size <= DMEM_PAGE_SIZE) {
+        const dmem_page_t *page = dmem_lookup(mem, addr);
+        if (page == NULL)
+            return 0;
+        const byte_t *p = &page->bytes[offset];
+        switch (size) {
+        case 8: { uint64_t v; memcpy(&v, p, 8); return v; }
+        case 4: { uint32_t v; memcpy(&v, p, 4); return v; }
+        case 2: { uint16_t v; memcpy(&v, p, 2); return v; }
+        default: return *p;
+        }
+    }
+#endif
+    return dmem_load_slow(mem, addr, size);
+}
+
+// Little-endian store of 1, 2, 4 or 8 bytes
+static inline void dmem_store(data_memory_t *mem, addr_t addr, uint64_t value, unsigned size) {
+    unsigned offset = addr & (DMEM_PAGE_SIZE - 1);
+#ifndef DMEM_HOST_BIG_ENDIAN
+    if (offset + size <= DMEM_PAGE_SIZE) {
+        dmem_page_t *page = dmem_lookup_write(mem, addr);
+        if (page == NULL && (page = dmem_alloc_page(mem, addr)) == NULL)
+            return;
+        byte_t *p = &page->bytes[offset];
+        switch (size) {
+        case 8: { uint64_t v = value; memcpy(p, &v, 8); return; }
+        case 4: { uint32_t v = (uint32_t)value; memcpy(p, &v, 4); return; }
+        case 2: { uint16_t v = (uint16_t)value; memcpy(p, &v, 2); return; }
+        default: *p = (byte_t)value; return;
+        }
+    }
+#endif
+    dmem_store_slow(mem, addr, value, size);
+}
+
+// Load with the width and signedness given by funct3 (lb/lh/lw/ld/lbu/lhu/lwu)
+static inline int64_t dmem_read(data_memory_t *mem, addr_t addr, unsigned funct3) {
+    unsigned size = 1u << (funct3 & 3);
+    uint64_t value = dmem_load(mem, addr, size);
+    if ((funct3 & 4) || size == 8)
+        return (int64_t)value;
+    unsigned shift = 64 - 8 * size;
+    return (int64_t)(value << shift) >> shift; // Sign extend
+}
+
+// Store with the width given by funct3 (sb/sh/sw/sd)
+static inline void dmem_write(data_memory_t *mem, addr_t addr, int64_t value, unsigned funct3) {
+    dmem_store(mem, addr, (uint64_t)value, 1u << (funct3 & 3));
+}
+
+#endif
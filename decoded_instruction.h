@@ -0,0 +1,55 @@
+#ifndef __DECODED_INSTRUCTION_H__
+#define __DECODED_INSTRUCTION_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Micro-operations an instruction word resolves to once the control unit,
+// immediate generator and ALU control unit have been applied to it.
+typedef enum {
+    UOP_NOP = 0, // No architectural effect besides PC += 4
+    UOP_ADD,     // R-type, rs1 op rs2
+    UOP_SUB,
+    UOP_AND,
+    UOP_OR,
+    UOP_SLL,
+    UOP_ADDI,    // I-type, rs1 op imm
+    UOP_SUBI,
+    UOP_ANDI,
+    UOP_ORI,
+    UOP_SLLI,
+    UOP_LD,      // rd = mem[rs1 + imm]
+    UOP_SD,      // mem[rs1 + imm] = rs2
+    UOP_BEQ,     // if (rs1 == rs2) PC += imm << 1
+    NUM_UOPS
+} uop_t;
+
+// Control signals packed into a single byte
+#define CTRL_BRANCH     (1 << 0)
+#define CTRL_MEM_READ   (1 << 1)
+#define CTRL_MEM_TO_REG (1 << 2)
+#define CTRL_MEM_WRITE  (1 << 3)
+#define CTRL_ALU_SRC    (1 << 4)
+#define CTRL_REG_WRITE  (1 << 5)
+
+// One pre-decoded instruction, 16 bytes so four share a cache line
+typedef struct {
+    uint8_t uop;      // Resolved micro-op (uop_t)
+    uint8_t rd;       // Destination register index
+    uint8_t rs1;      // First source register index
+    uint8_t rs2;      // Second source register index
+    uint8_t ctrl;     // Packed control signals (CTRL_*)
+    uint8_t ALUOp;    // ALUOp from the control unit
+    uint8_t ALU_ctrl; // Output of the ALU control unit
+    uint8_t funct3;
+    int32_t imm;      // Sign-extended immediate from imm_gen
+    uint32_t raw;     // Original instruction word
+} decoded_instruction_t;
+
+// Decoded copy of instruction memory, indexed by PC / 4
+typedef struct {
+    decoded_instruction_t *uops;
+    size_t size; // Number of entries, same as instruction memory
+} decode_cache_t;
+
+#endif
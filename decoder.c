@@ -0,0 +1,119 @@
+#include "decoder.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Map the ALU control signal to its micro-op, register and immediate forms
+static uop_t alu_uop(signal_t ALU_ctrl, bool imm_operand) {
+    switch (ALU_ctrl) {
+    case 2: return imm_operand ? UOP_ADDI : UOP_ADD;
+    case 6: return imm_operand ? UOP_SUBI : UOP_SUB;
+    case 0: return imm_operand ? UOP_ANDI : UOP_AND;
+    case 1: return imm_operand ? UOP_ORI : UOP_OR;
+    case 3: return imm_operand ? UOP_SLLI : UOP_SLL;
+    }
+    return UOP_NOP;
+}
+
+// Run one instruction word through the decode hardware of tick_func and
+// record everything the later stages need
+void decode_word(unsigned instruction, decoded_instruction_t *d) {
+    signal_t opcode = instruction & 0x7F;
+    signal_t funct3 = (instruction >> 12) & 0x7;
+    signal_t funct7 = (opcode == 51) ? (instruction >> 25) & 0x7F : 0;
+
+    control_signals_t signals;
+    control_unit(opcode, &signals);
+    signal_t ALU_ctrl = ALU_control_unit(signals.ALUOp, funct7, funct3);
+
+    memset(d, 0, sizeof(*d));
+    d->rd = (instruction >> 7) & 0x1F;
+    d->rs1 = (instruction >> 15) & 0x1F;
+    d->rs2 = (instruction >> 20) & 0x1F;
+    d->ALUOp = signals.ALUOp;
+    d->ALU_ctrl = ALU_ctrl;
+    d->funct3 = funct3;
+    d->imm = (int32_t)imm_gen(instruction);
+    d->raw = instruction;
+
+    d->ctrl = (signals.Branch ? CTRL_BRANCH : 0) |
+              (signals.MemRead ? CTRL_MEM_READ : 0) |
+              (signals.MemtoReg ? CTRL_MEM_TO_REG : 0) |
+              (signals.MemWrite ? CTRL_MEM_WRITE : 0) |
+              (signals.ALUSrc ? CTRL_ALU_SRC : 0) |
+              (signals.RegWrite ? CTRL_REG_WRITE : 0);
+
+    if (signals.MemWrite) {
+        d->uop = UOP_SD;
+    } else if (signals.MemtoReg) {
+        d->uop = UOP_LD;
+    } else if (signals.Branch) {
+        d->uop = UOP_BEQ;
+    } else if (signals.RegWrite) {
+        d->uop = alu_uop(ALU_ctrl, signals.ALUSrc);
+    } else {
+        d->uop = UOP_NOP;
+    }
+}
+
+// Decode every instruction of instruction memory
+int build_decode_cache(instruction_memory_t *i_mem, decode_cache_t *cache) {
+    cache->uops = NULL;
+    cache->size = 0;
+    if (i_mem->size == 0)
+        return 0;
+
+    size_t size = i_mem->size;
+    cache->uops = (decoded_instruction_t *)malloc(size * sizeof(decoded_instruction_t));
+    if (cache->uops == NULL)
+        return -1;
+
+    for (size_t i = 0; i < size; i++)
+        decode_word(i_mem->instructions[i].instruction, &cache->uops[i]);
+    cache->size = size;
+
+    return 0;
+}
+
+void free_decode_cache(decode_cache_t *cache) {
+    free(cache->uops);
+    cache->uops = NULL;
+    cache->size = 0;
+}
+
+// Commit log flags from the packed control signals, as commit_flags does
+static unsigned decoded_commit_flags(const decoded_instruction_t *d) {
+    return ((d->ctrl & CTRL_REG_WRITE) ? COMMIT_REG_WRITE : 0) | ((d->ctrl & CTRL_MEM_TO_REG) ? COMMIT_MEM_READ : 0) |
+           ((d->ctrl & CTRL_MEM_WRITE) ? COMMIT_MEM_WRITE : 0);
+}
+
+// Same architectural behavior as tick_func, driven from the decode cache
+bool tick_decoded_func(core_t *core) {
+    const decoded_instruction_t *d = &core->decoded->uops[core->PC / 4];
+    addr_t next_PC = core->PC + 4;
+    bool taken = false;
+    signal_t mem_addr = 0, store_data = 0;
+    if (core_logs_commits(core)) {
+        mem_addr = core->reg_file[d->rs1] + d->imm;
+        store_data = core->reg_file[d->rs2];
+    }
+
+    if (d->uop == UOP_BEQ) {
+        taken = core->reg_file[d->rs1] == core->reg_file[d->rs2];
+        if (taken)
+            next_PC = core->PC + ShiftLeft1(d->imm);
+        perf_count(&core->perf, OPCLASS_BRANCH, 0, taken);
+    } else {
+        execute_uop(d, core->reg_file, core->data_mem);
+        perf_count(&core->perf, uop_opclass(d->uop), d->funct3, false);
+    }
+
+    if (core->profile != NULL)
+        profile_record(core->profile, core->PC, 1, taken);
+    if (core_logs_commits(core))
+        log_commit(core, core->clk + 1, core->PC, d->raw, decoded_commit_flags(d), mem_addr, store_data);
+    core->PC = next_PC;
+    ++core->clk;
+
+    // Halting condition: same as tick_func, PC beyond the last instruction
+    return core->PC / 4 < core->decoded->size;
+}
@@ -0,0 +1,34 @@
+#ifndef __DECODER_H__
+#define __DECODER_H__
+
+#include "core.h"
+#include "decoded_instruction.h"
+
+// Execute a decoded non-branch instruction against the register file and data memory
+static inline void execute_uop(const decoded_instruction_t *d, register_t *reg, data_memory_t *mem) {
+    signal_t rs1_val = reg[d->rs1];
+    signal_t rs2_val = reg[d->rs2];
+
+    switch (d->uop) {
+    case UOP_ADD:  reg[d->rd] = rs1_val + rs2_val; break;
+    case UOP_SUB:  reg[d->rd] = rs1_val - rs2_val; break;
+    case UOP_AND:  reg[d->rd] = rs1_val & rs2_val; break;
+    case UOP_OR:   reg[d->rd] = rs1_val | rs2_val; break;
+    case UOP_SLL:  reg[d->rd] = (uint64_t)rs1_val << (rs2_val & 0x3F); break;
+    case UOP_ADDI: reg[d->rd] = rs1_val + d->imm; break;
+    case UOP_SUBI: reg[d->rd] = rs1_val - d->imm; break;
+    case UOP_ANDI: reg[d->rd] = rs1_val & d->imm; break;
+    case UOP_ORI:  reg[d->rd] = rs1_val | d->imm; break;
+    case UOP_SLLI: reg[d->rd] = (uint64_t)rs1_val << (d->imm & 0x3F); break;
+    case UOP_LD:   reg[d->rd] = dmem_read(mem, rs1_val + d->imm, d->funct3); break;
+    case UOP_SD:   dmem_write(mem, rs1_val + d->imm, rs2_val, d->funct3); break;
+    }
+}
+
+// Function prototypes
+void decode_word(unsigned instruction, decoded_instruction_t *d);
+int build_decode_cache(instruction_memory_t *i_mem, decode_cache_t *cache);
+void free_decode_cache(decode_cache_t *cache);
+bool tick_decoded_func(core_t *core);
+
+#endif
@@ -0,0 +1,79 @@
+#include "disasm.h"
+#include "registers.h"
+#include <stdio.h>
+
+// Sign-extend the low bits of value
+static int sign_extend(unsigned value, unsigned bits) {
+    unsigned mask = 1u << (bits - 1);
+    return (int)((value ^ mask) - mask);
+}
+
+static const char *r_type_name(unsigned funct3, unsigned funct7) {
+    switch (funct3) {
+    case 0: return funct7 == 32 ? "sub" : "add";
+    case 1: return "sll";
+    case 4: return "xor";
+    case 5: return "srl";
+    case 6: return "or";
+    case 7: return "and";
+    default: return NULL;
+    }
+}
+
+// Write the assembly text of an instruction word in the trace syntax the
+// parser accepts. Branch offsets are printed in instructions, as executed
+// (PC + (imm_gen << 1)). Words outside the parser's instruction set are
+// printed as .word.
+void disassemble(unsigned instruction, char *buffer, size_t size) {
+    unsigned opcode = instruction & 0x7F;
+    unsigned funct3 = (instruction >> 12) & 0x7;
+    unsigned funct7 = (instruction >> 25) & 0x7F;
+    const char *rd = REGISTER_NAME[(instruction >> 7) & 0x1F];
+    const char *rs1 = REGISTER_NAME[(instruction >> 15) & 0x1F];
+    const char *rs2 = REGISTER_NAME[(instruction >> 20) & 0x1F];
+    int imm_i = sign_extend(instruction >> 20, 12);
+    int imm_s = sign_extend(((instruction >> 25) << 5) | ((instruction >> 7) & 0x1F), 12);
+    int imm_b = sign_extend(((instruction >> 31) << 12) | (((instruction >> 7) & 0x1) << 11) |
+                            (((instruction >> 25) & 0x3F) << 5) | (((instruction >> 8) & 0xF) << 1), 13);
+    const char *name;
+
+    switch (opcode) {
+    case 51:
+        if ((name = r_type_name(funct3, funct7)) != NULL) {
+            snprintf(buffer, size, "%s %s, %s, %s", name, rd, rs1, rs2);
+            return;
+        }
+        break;
+    case 19:
+        if (funct3 == 0 || funct3 == 1) {
+            snprintf(buffer, size, "%s %s, %s, %d", funct3 ? "slli" : "addi", rd, rs1, imm_i);
+            return;
+        }
+        break;
+    case 3:
+        if (funct3 == 2 || funct3 == 3) {
+            snprintf(buffer, size, "%s %s, %d(%s)", funct3 == 2 ? "lw" : "ld", rd, imm_i, rs1);
+            return;
+        }
+        break;
+    case 35:
+        if (funct3 == 3) {
+            snprintf(buffer, size, "sd %s, %d(%s)", rs2, imm_s, rs1);
+            return;
+        }
+        break;
+    case 99:
+        if (funct3 == 0 || funct3 == 1) {
+            snprintf(buffer, size, "%s %s, %s, %d", funct3 ? "bne" : "beq", rs1, rs2, imm_b / 2);
+            return;
+        }
+        break;
+    case 0:
+        if (instruction != 0) {
+            snprintf(buffer, size, "jalr %s", rd);
+            return;
+        }
+        break;
+    }
+    snprintf(buffer, size, ".word 0x%08x", instruction);
+}
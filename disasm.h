@@ -0,0 +1,11 @@
+#ifndef __DISASM_H__
+#define __DISASM_H__
+
+#include <stddef.h>
+
+#define DISASM_MAX_LENGTH 32 // Longest disassembled instruction, with terminator
+
+// Function prototypes
+void disassemble(unsigned instruction, char *buffer, size_t size);
+
+#endif
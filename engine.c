@@ -0,0 +1,264 @@
+#include "engine.h"
+#include "block_cache.h"
+#include "decoder.h"
+#include "threaded.h"
+#include <string.h>
+
+static const char *ENGINE_NAME[] = {
+    [ENGINE_REFERENCE] = "reference",
+    [ENGINE_DECODED] = "decoded",
+    [ENGINE_THREADED] = "threaded",
+    [ENGINE_BLOCK] = "block",
+    [ENGINE_PIPELINE] = "pipeline",
+};
+
+int engine_from_name(const char *name, engine_t *engine) {
+    for (size_t i = 0; i < sizeof(ENGINE_NAME) / sizeof(ENGINE_NAME[0]); i++) {
+        if (strcmp(name, ENGINE_NAME[i]) == 0) {
+            *engine = (engine_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *engine_name(engine_t engine) {
+    return ENGINE_NAME[engine];
+}
+
+void default_engine_config(engine_config_t *config) {
+    default_pipeline_config(&config->pipeline);
+    default_cache_config(&config->dcache);
+    default_cache_config(&config->icache);
+    config->profile = false;
+    config->warm = NULL;
+}
+
+// Engines that call the per-instruction profile and commit log hooks; the
+// threaded and block engines run without them
+bool engine_has_hooks(engine_t engine) {
+    return engine == ENGINE_REFERENCE || engine == ENGINE_DECODED || engine == ENGINE_PIPELINE;
+}
+
+// Run a core until it halts. The core must have its decode cache attached.
+// config may be NULL for the defaults. Warm state whose configuration
+// differs from config is ignored.
+// Returns 0 on success, -1 if the engine could not allocate its state.
+// The result must be released with free_engine_result.
+int run_engine(core_t *core, engine_t engine, const engine_config_t *config, engine_result_t *result) {
+    engine_config_t defaults;
+    if (config == NULL) {
+        default_engine_config(&defaults);
+        config = &defaults;
+    }
+    memset(result, 0, sizeof(*result));
+    tick_t start_clk = core->clk;
+    int status = 0;
+
+    if (config->profile && engine_has_hooks(engine)) {
+        if (init_guest_profile(&result->profile, core->instr_mem->size) != 0)
+            return -1;
+        core->profile = &result->profile;
+    }
+
+    // Cache timing models, for the engines that charge latency
+    bool timed = engine == ENGINE_REFERENCE || engine == ENGINE_PIPELINE;
+    cache_t dcache;
+    icache_t icache;
+    if (timed && config->dcache.size > 0) {
+        if (init_cache(&dcache, &config->dcache) != 0) {
+            core->profile = NULL;
+            return -1;
+        }
+        core->dcache = &dcache;
+        if (config->warm != NULL && config->warm->dcache != NULL)
+            copy_cache_state(&dcache, config->warm->dcache);
+    }
+    if (timed && config->icache.size > 0) {
+        if (init_icache(&icache, &config->icache, core->instr_mem->size) != 0) {
+            if (core->dcache != NULL)
+                free_cache(&dcache);
+            core->dcache = NULL;
+            core->profile = NULL;
+            return -1;
+        }
+        core->icache = &icache;
+        if (config->warm != NULL && config->warm->icache != NULL)
+            copy_cache_state(&icache.cache, &config->warm->icache->cache);
+    }
+
+    if (engine == ENGINE_THREADED) {
+        status = run_threaded(core, &result->instructions);
+    } else if (engine == ENGINE_BLOCK) {
+        block_cache_t blocks;
+        if (init_block_cache(&blocks, core->decoded) == 0) {
+            status = run_blocks(core, &blocks, &result->instructions);
+            free_block_cache(&blocks);
+        } else {
+            status = -1;
+        }
+    } else if (engine == ENGINE_PIPELINE) {
+        pipeline_t pipe;
+        if (init_pipeline(&pipe, core, &config->pipeline) == 0) {
+            if (config->warm != NULL && config->warm->predictor != NULL)
+                copy_predictor_state(&pipe.predictor, config->warm->predictor);
+            run_pipeline(core, &pipe);
+            result->instructions = pipe.stats.retired;
+            result->pipeline = pipe.stats;
+            result->branches = pipe.predictor.profile; // Moved into the result
+            memset(&pipe.predictor.profile, 0, sizeof(pipe.predictor.profile));
+        } else {
+            status = -1;
+        }
+        free_pipeline(&pipe);
+    } else if (core->PC / 4 < core->decoded->size) {
+        // Count ticks: with a data cache the clock also advances on misses
+        core->tick = (engine == ENGINE_DECODED) ? tick_decoded_func : tick_func;
+        do
+            result->instructions++;
+        while (core->tick(core));
+    }
+
+    if (core->dcache != NULL) {
+        result->dcache = dcache.stats;
+        free_cache(&dcache);
+        core->dcache = NULL;
+    }
+    if (core->icache != NULL) {
+        result->icache = icache.cache.stats;
+        result->icache_misses = icache.profile; // Moved into the result
+        memset(&icache.profile, 0, sizeof(icache.profile));
+        free_icache(&icache);
+        core->icache = NULL;
+    }
+    core->profile = NULL;
+    result->cycles = core->clk - start_clk;
+#if PERF_COUNTERS
+    core->perf.cycles += result->cycles;
+#endif
+    return status;
+}
+
+void print_perf_counters(const perf_counters_t *perf) {
+#if PERF_COUNTERS
+    printf("Retired R-type \t\t: %llu\n", (unsigned long long)perf->retired[OPCLASS_R]);
+    printf("Retired I-type \t\t: %llu\n", (unsigned long long)perf->retired[OPCLASS_I]);
+    printf("Retired ld \t\t: %llu\n", (unsigned long long)perf->retired[OPCLASS_LOAD]);
+    printf("Retired sd \t\t: %llu\n", (unsigned long long)perf->retired[OPCLASS_STORE]);
+    printf("Retired beq \t\t: %llu\n", (unsigned long long)perf->retired[OPCLASS_BRANCH]);
+    printf("Retired other \t\t: %llu\n", (unsigned long long)perf->retired[OPCLASS_OTHER]);
+    printf("Branches taken \t\t: %llu\n", (unsigned long long)perf->branches_taken);
+    printf("Branches not taken \t: %llu\n", (unsigned long long)perf->branches_not_taken);
+    printf("Loads \t\t\t: %llu (%llu bytes)\n", (unsigned long long)perf->loads,
+           (unsigned long long)perf->bytes_loaded);
+    printf("Stores \t\t\t: %llu (%llu bytes)\n", (unsigned long long)perf->stores,
+           (unsigned long long)perf->bytes_stored);
+    printf("Counted cycles \t\t: %llu\n", (unsigned long long)perf->cycles);
+#else
+    (void)perf;
+    printf("Performance counters are disabled in this build (PERF_COUNTERS=0)\n");
+#endif
+}
+
+static void write_json_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\')
+            fprintf(out, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(out, "\\u%04x", c);
+        else
+            fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+static void write_cache_json(FILE *out, const char *name, const cache_stats_t *stats) {
+    fprintf(out, ",\n  \"%s\": {\"reads\": %llu, \"writes\": %llu, \"read_misses\": %llu, "
+            "\"write_misses\": %llu, \"evictions\": %llu, \"writebacks\": %llu, \"write_throughs\": %llu, "
+            "\"prefetches\": %llu, \"useful_prefetches\": %llu, \"stall_cycles\": %llu}", name,
+            (unsigned long long)stats->reads, (unsigned long long)stats->writes,
+            (unsigned long long)stats->read_misses, (unsigned long long)stats->write_misses,
+            (unsigned long long)stats->evictions, (unsigned long long)stats->writebacks,
+            (unsigned long long)stats->write_throughs, (unsigned long long)stats->prefetches,
+            (unsigned long long)stats->useful_prefetches, (unsigned long long)stats->stall_cycles);
+}
+
+// Write a run's results as one JSON object: totals, the core's performance
+// counters (when compiled in), and the pipeline and cache statistics of the
+// models that were active.
+void write_stats_json(FILE *out, const char *trace, engine_t engine, const engine_config_t *config,
+                      const engine_result_t *result, const perf_counters_t *perf, double seconds) {
+    fprintf(out, "{\n  \"trace\": ");
+    write_json_string(out, trace);
+    fprintf(out, ",\n  \"engine\": \"%s\",\n  \"instructions\": %llu,\n  \"cycles\": %llu,\n"
+            "  \"seconds\": %.6f,\n  \"mips\": %.3f", engine_name(engine),
+            (unsigned long long)result->instructions, (unsigned long long)result->cycles, seconds,
+            seconds > 0 ? result->instructions / seconds * 1e-6 : 0.0);
+
+#if PERF_COUNTERS
+    fprintf(out, ",\n  \"counters\": {\"retired\": {\"r\": %llu, \"i\": %llu, \"ld\": %llu, \"sd\": %llu, "
+            "\"beq\": %llu, \"other\": %llu}, \"branches_taken\": %llu, \"branches_not_taken\": %llu, "
+            "\"loads\": %llu, \"stores\": %llu, \"bytes_loaded\": %llu, \"bytes_stored\": %llu, \"cycles\": %llu}",
+            (unsigned long long)perf->retired[OPCLASS_R], (unsigned long long)perf->retired[OPCLASS_I],
+            (unsigned long long)perf->retired[OPCLASS_LOAD], (unsigned long long)perf->retired[OPCLASS_STORE],
+            (unsigned long long)perf->retired[OPCLASS_BRANCH], (unsigned long long)perf->retired[OPCLASS_OTHER],
+            (unsigned long long)perf->branches_taken, (unsigned long long)perf->branches_not_taken,
+            (unsigned long long)perf->loads, (unsigned long long)perf->stores,
+            (unsigned long long)perf->bytes_loaded, (unsigned long long)perf->bytes_stored,
+            (unsigned long long)perf->cycles);
+#else
+    (void)perf;
+    fprintf(out, ",\n  \"counters\": null");
+#endif
+
+    if (engine == ENGINE_PIPELINE) {
+        const pipeline_stats_t *p = &result->pipeline;
+        fprintf(out, ",\n  \"pipeline\": {\"cycles\": %llu, \"retired\": %llu, \"stall_cycles\": %llu, "
+                "\"flush_cycles\": %llu, \"fetch_stall_cycles\": %llu, \"branches\": %llu, \"mispredictions\": %llu, "
+                "\"predictor\": \"%s\"}",
+                (unsigned long long)p->cycles, (unsigned long long)p->retired, (unsigned long long)p->stall_cycles,
+                (unsigned long long)p->flush_cycles, (unsigned long long)p->fetch_stall_cycles,
+                (unsigned long long)p->branches, (unsigned long long)p->mispredictions,
+                bp_kind_name(config->pipeline.predictor.kind));
+    }
+    bool timed = engine == ENGINE_REFERENCE || engine == ENGINE_PIPELINE;
+    if (timed && config->dcache.size > 0)
+        write_cache_json(out, "dcache", &result->dcache);
+    if (timed && config->icache.size > 0)
+        write_cache_json(out, "icache", &result->icache);
+    fprintf(out, "\n}\n");
+}
+
+void free_engine_result(engine_result_t *result) {
+    free_branch_profile(&result->branches);
+    free_icache_profile(&result->icache_misses);
+    free_guest_profile(&result->profile);
+}
+
+// Run at most max_instructions instructions through core->tick, training
+// predictor (if not NULL) with every branch as the pipeline would, and
+// charging any caches attached to the core. Used to fast-forward and warm
+// up a core. Returns the instructions executed; fewer than
+// max_instructions means the program ended.
+uint64_t run_instructions(core_t *core, uint64_t max_instructions, branch_predictor_t *predictor) {
+    uint64_t executed = 0;
+    while (executed < max_instructions && core->PC / 4 < core->instr_mem->size) {
+        addr_t PC = core->PC;
+        unsigned instruction = core->instr_mem->instructions[PC / 4].instruction;
+        bool is_branch = predictor != NULL && (instruction & 0x7F) == 99;
+        bool taken = is_branch && core->reg_file[(instruction >> 15) & 0x1F] == core->reg_file[(instruction >> 20) & 0x1F];
+
+        executed++;
+        bool running = core->tick(core);
+        if (is_branch) {
+            addr_t target = PC + ShiftLeft1(imm_gen(instruction));
+            bool predicted = bp_predict(predictor, PC, target, predictor->history);
+            bp_update(predictor, PC, predictor->history, taken, target, predicted != taken);
+        }
+        if (!running)
+            break;
+    }
+    return executed;
+}
@@ -0,0 +1,52 @@
+#ifndef __ENGINE_H__
+#define __ENGINE_H__
+
+#include "core.h"
+#include "checkpoint.h"
+#include "pipeline.h"
+
+// Execution engines selectable with --engine
+typedef enum {
+    ENGINE_REFERENCE, // tick_func, re-decodes every instruction
+    ENGINE_DECODED,   // tick_decoded_func, fetches from the decode cache
+    ENGINE_THREADED,  // run_threaded, direct-threaded dispatch
+    ENGINE_BLOCK,     // run_blocks, chained basic-block translation cache
+    ENGINE_PIPELINE   // run_pipeline, cycle-accurate 5-stage pipeline
+} engine_t;
+
+// Microarchitecture options of the timing models. The caches apply to
+// ENGINE_REFERENCE and ENGINE_PIPELINE; the other engines are purely
+// functional.
+typedef struct {
+    pipeline_config_t pipeline;
+    cache_config_t dcache;   // size 0 for no data cache
+    cache_config_t icache;   // size 0 for no instruction cache
+    bool profile;            // Collect a per-PC guest profile, if engine_has_hooks
+    const uarch_state_t *warm; // Starting cache and predictor state, NULL for cold
+} engine_config_t;
+
+// Outcome of running a core to completion
+typedef struct {
+    tick_t instructions;     // Instructions executed (retired)
+    tick_t cycles;           // Clock cycles, equal to instructions outside the pipeline
+    pipeline_stats_t pipeline; // Valid for ENGINE_PIPELINE only
+    branch_profile_t branches; // Per-branch-PC prediction outcomes, ENGINE_PIPELINE only
+    cache_stats_t dcache;      // Valid when a data cache was configured
+    cache_stats_t icache;      // Valid when an instruction cache was configured
+    icache_profile_t icache_misses; // I-cache misses per fetch PC
+    guest_profile_t profile;   // Executions and cycles per PC, when profiling
+} engine_result_t;
+
+// Function prototypes
+int engine_from_name(const char *name, engine_t *engine);
+const char *engine_name(engine_t engine);
+void default_engine_config(engine_config_t *config);
+bool engine_has_hooks(engine_t engine);
+int run_engine(core_t *core, engine_t engine, const engine_config_t *config, engine_result_t *result);
+void free_engine_result(engine_result_t *result);
+uint64_t run_instructions(core_t *core, uint64_t max_instructions, branch_predictor_t *predictor);
+void print_perf_counters(const perf_counters_t *perf);
+void write_stats_json(FILE *out, const char *trace, engine_t engine, const engine_config_t *config,
+                      const engine_result_t *result, const perf_counters_t *perf, double seconds);
+
+#endif
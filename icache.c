@@ -0,0 +1,73 @@
+#include "icache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Returns 0 on success, -1 if the configuration is invalid or allocation fails
+int init_icache(icache_t *icache, const cache_config_t *config, size_t num_instructions) {
+    memset(&icache->profile, 0, sizeof(icache->profile));
+    if (init_cache(&icache->cache, config) != 0)
+        return -1;
+    icache->profile.misses = (uint64_t *)calloc(num_instructions ? num_instructions : 1, sizeof(uint64_t));
+    if (icache->profile.misses == NULL) {
+        free_cache(&icache->cache);
+        return -1;
+    }
+    icache->profile.size = num_instructions;
+    return 0;
+}
+
+void free_icache(icache_t *icache) {
+    free_cache(&icache->cache);
+    free_icache_profile(&icache->profile);
+}
+
+void free_icache_profile(icache_profile_t *profile) {
+    free(profile->misses);
+    profile->misses = NULL;
+    profile->size = 0;
+}
+
+typedef struct {
+    addr_t PC;
+    uint64_t misses;
+} pc_misses_t;
+
+// Most misses first, ties by PC
+static int compare_misses(const void *a, const void *b) {
+    const pc_misses_t *x = (const pc_misses_t *)a;
+    const pc_misses_t *y = (const pc_misses_t *)b;
+    if (x->misses != y->misses)
+        return x->misses < y->misses ? 1 : -1;
+    return (x->PC > y->PC) - (x->PC < y->PC);
+}
+
+// Print the max_rows fetch PCs with the most I-cache misses
+void print_icache_profile(const icache_profile_t *profile, size_t max_rows) {
+    size_t count = 0;
+    for (size_t i = 0; i < profile->size; i++)
+        count += profile->misses[i] > 0;
+    if (count == 0)
+        return;
+
+    pc_misses_t *sorted = (pc_misses_t *)malloc(count * sizeof(pc_misses_t));
+    if (sorted == NULL)
+        return;
+    size_t n = 0;
+    for (size_t i = 0; i < profile->size; i++) {
+        if (profile->misses[i] > 0) {
+            sorted[n].PC = (addr_t)i * 4;
+            sorted[n].misses = profile->misses[i];
+            n++;
+        }
+    }
+    qsort(sorted, count, sizeof(pc_misses_t), compare_misses);
+
+    size_t rows = count < max_rows ? count : max_rows;
+    printf("Fetch PC \tI-cache misses\n");
+    for (size_t i = 0; i < rows; i++)
+        printf("%-8llu \t%llu\n", (unsigned long long)sorted[i].PC, (unsigned long long)sorted[i].misses);
+    if (rows < count)
+        printf("(%zu more PCs)\n", count - rows);
+    free(sorted);
+}
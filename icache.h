@@ -0,0 +1,33 @@
+#ifndef __ICACHE_H__
+#define __ICACHE_H__
+
+#include "cache.h"
+
+// Instruction cache misses per fetch PC
+typedef struct {
+    uint64_t *misses;   // Indexed by PC / 4
+    size_t size;        // Instructions covered
+} icache_profile_t;
+
+// Instruction cache in front of fetch, attributing each miss to the PC
+// whose fetch missed
+typedef struct {
+    cache_t cache;
+    icache_profile_t profile;
+} icache_t;
+
+// Function prototypes
+int init_icache(icache_t *icache, const cache_config_t *config, size_t num_instructions);
+void free_icache(icache_t *icache);
+void free_icache_profile(icache_profile_t *profile);
+void print_icache_profile(const icache_profile_t *profile, size_t max_rows);
+
+// Look up the line holding PC and return the stall cycles of the fetch
+static inline unsigned icache_fetch(icache_t *icache, addr_t PC) {
+    unsigned latency = cache_access(&icache->cache, PC, false);
+    if (latency > 0 && PC / 4 < icache->profile.size)
+        icache->profile.misses[PC / 4]++;
+    return latency;
+}
+
+#endif
@@ -8,9 +8,8 @@ typedef uint64_t tick_t;
 
 typedef struct
 {
-    // Byte-addressable address
-    addr_t addr;
-    // This is the translated binary format of assembly input
+    // This is the translated binary format of assembly input. Its
+    // byte-addressable address is its index in instruction memory * 4.
     unsigned int instruction;
 
 } instruction_t;
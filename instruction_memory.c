@@ -0,0 +1,54 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "instruction_memory.h"
+#include <stdlib.h>
+#include <sys/mman.h>
+
+void init_instruction_memory(instruction_memory_t *i_mem) {
+    i_mem->instructions = NULL;
+    i_mem->size = 0;
+    i_mem->capacity = 0;
+    i_mem->num_unknown = 0;
+    i_mem->mapping = NULL;
+    i_mem->mapping_size = 0;
+}
+
+void free_instruction_memory(instruction_memory_t *i_mem) {
+    if (i_mem->mapping != NULL)
+        munmap(i_mem->mapping, i_mem->mapping_size);
+    else
+        free(i_mem->instructions);
+    init_instruction_memory(i_mem);
+}
+
+// Add a zeroed slot at *index, the number of slots filled so far, growing
+// the array by doubling. Returns the slot, or NULL when out of memory.
+instruction_t *imem_append(instruction_memory_t *i_mem, size_t *index) {
+    if (*index == i_mem->capacity) {
+        size_t capacity = i_mem->capacity ? i_mem->capacity * 2 : IMEM_INITIAL_CAPACITY;
+        instruction_t *instructions = (instruction_t *)realloc(i_mem->instructions, capacity * sizeof(instruction_t));
+        if (instructions == NULL)
+            return NULL;
+        i_mem->instructions = instructions;
+        i_mem->capacity = capacity;
+    }
+    instruction_t *instr = &i_mem->instructions[(*index)++];
+    instr->instruction = 0;
+    return instr;
+}
+
+// Keep the first size instructions and release unused capacity
+void imem_shrink_to_fit(instruction_memory_t *i_mem, size_t size) {
+    i_mem->size = size;
+    if (size == 0) {
+        free(i_mem->instructions);
+        i_mem->instructions = NULL;
+        i_mem->capacity = 0;
+        return;
+    }
+    instruction_t *instructions = (instruction_t *)realloc(i_mem->instructions, size * sizeof(instruction_t));
+    if (instructions != NULL) {
+        i_mem->instructions = instructions;
+        i_mem->capacity = size;
+    }
+}
@@ -1,12 +1,25 @@
 #ifndef __INSTRUCTION_MEMORY_H__
 #define __INSTRUCTION_MEMORY_H__
 
+#include <stddef.h>
+
 #include "instruction.h"
 
-#define IMEM_SIZE 256
+#define IMEM_INITIAL_CAPACITY 1024 // Instructions; capacity doubles as the trace grows
+
 typedef struct {
-    instruction_t instructions[IMEM_SIZE];
-    instruction_t *last; // Points to the last instruction
+    instruction_t *instructions; // Instruction i is at address i * 4
+    size_t size;                 // Instructions up to and including the last valid one
+    size_t capacity;             // Allocated slots
+    unsigned num_unknown;        // Lines skipped as unknown instructions
+    void *mapping;               // Mapped program image holding instructions, or NULL
+    size_t mapping_size;
 } instruction_memory_t;
 
+// Function prototypes
+void init_instruction_memory(instruction_memory_t *i_mem);
+void free_instruction_memory(instruction_memory_t *i_mem);
+instruction_t *imem_append(instruction_memory_t *i_mem, size_t *index);
+void imem_shrink_to_fit(instruction_memory_t *i_mem, size_t size);
+
 #endif
@@ -0,0 +1,328 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "lanes.h"
+#include <string.h>
+
+// Lane vectors use GCC vector extensions, which compile to AVX-512 or AVX2
+// when the target has them (-mavx512f, -mavx2 or -march=native) and to
+// narrower SIMD or scalar code otherwise. -DLANES_USE_SCALAR or another
+// compiler selects plain one-lane code.
+#if defined(__GNUC__) && !defined(LANES_USE_SCALAR)
+#if defined(__AVX512F__)
+#define LANE_VECTOR_BYTES 64
+#else
+#define LANE_VECTOR_BYTES 32
+#endif
+#define LANE_WIDTH (LANE_VECTOR_BYTES / 8)
+typedef int64_t lane_vec_t __attribute__((vector_size(LANE_VECTOR_BYTES), may_alias));
+typedef uint64_t lane_uvec_t __attribute__((vector_size(LANE_VECTOR_BYTES), may_alias));
+#define LANE_EQ(a, b) ((a) == (b)) // -1 where equal
+#else
+#define LANE_WIDTH 1
+typedef int64_t lane_vec_t;
+typedef uint64_t lane_uvec_t;
+#define LANE_EQ(a, b) (-(lane_vec_t)((a) == (b)))
+#endif
+
+#define LANE_ALIGN 64
+#define V(array, i) (*(lane_vec_t *)&(array)[i])
+#define SELECT(m, a, b) (((a) & (m)) | ((b) & ~(m)))
+
+static bool lane_any(lane_vec_t v) {
+#if LANE_WIDTH > 1
+    for (unsigned k = 0; k < LANE_WIDTH; k++) {
+        if (v[k] != 0)
+            return true;
+    }
+    return false;
+#else
+    return v != 0;
+#endif
+}
+
+static int64_t *alloc_lane_array(size_t count) {
+    void *p;
+    if (posix_memalign(&p, LANE_ALIGN, count * sizeof(int64_t)) != 0)
+        return NULL;
+    memset(p, 0, count * sizeof(int64_t));
+    return (int64_t *)p;
+}
+
+unsigned lane_vector_width(void) {
+    return LANE_WIDTH;
+}
+
+static int compare_hashes(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Set up num_lanes lanes at PC 0 with zeroed registers, lane i in a0, and
+// empty 2^addr_bits byte data memories. Returns 0 on success, -1 on bad
+// arguments or allocation failure.
+int init_lanes(lanes_t *lanes, const decode_cache_t *decoded, unsigned num_lanes, unsigned addr_bits) {
+    memset(lanes, 0, sizeof(*lanes));
+    if (num_lanes == 0 || num_lanes > LANES_MAX)
+        return -1;
+    unsigned width = (num_lanes + LANE_WIDTH - 1) / LANE_WIDTH * LANE_WIDTH;
+    lanes->num_lanes = num_lanes;
+    lanes->width = width;
+    lanes->decoded = decoded;
+    lanes->reg = alloc_lane_array((size_t)NUM_REGISTERS * width);
+    lanes->pc = alloc_lane_array(width);
+    lanes->active = alloc_lane_array(width);
+    lanes->mask = alloc_lane_array(width);
+    lanes->instructions = alloc_lane_array(width);
+    lanes->mem = (data_memory_t **)calloc(num_lanes, sizeof(data_memory_t *));
+    if (lanes->reg == NULL || lanes->pc == NULL || lanes->active == NULL || lanes->mask == NULL ||
+        lanes->instructions == NULL || lanes->mem == NULL)
+        goto fail;
+    for (unsigned l = 0; l < num_lanes; l++) {
+        if ((lanes->mem[l] = new_data_memory(addr_bits)) == NULL)
+            goto fail;
+        lanes->active[l] = -1;
+        lanes->reg[LANES_ID_REG * width + l] = l;
+    }
+    return 0;
+
+fail:
+    free_lanes(lanes);
+    return -1;
+}
+
+void free_lanes(lanes_t *lanes) {
+    if (lanes->mem != NULL) {
+        for (unsigned l = 0; l < lanes->num_lanes; l++)
+            free_data_memory(lanes->mem[l]);
+    }
+    free(lanes->mem);
+    free(lanes->reg);
+    free(lanes->pc);
+    free(lanes->active);
+    free(lanes->mask);
+    free(lanes->instructions);
+    memset(lanes, 0, sizeof(*lanes));
+}
+
+static uint64_t splitmix64(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// Fill the argument registers a1-a7 of every lane with pseudo-random values
+// derived from seed, for input sweeps
+void randomize_lane_args(lanes_t *lanes, uint64_t seed) {
+    for (unsigned r = LANES_ID_REG + 1; r <= 17; r++) {
+        for (unsigned l = 0; l < lanes->num_lanes; l++)
+            lanes->reg[r * lanes->width + l] = (int64_t)splitmix64(&seed);
+    }
+}
+
+// Execute instruction d for the lanes in mask. With full set every lane is
+// running, so results are stored without masking; padding lanes compute
+// garbage that is never read.
+static void execute_step(lanes_t *lanes, const decoded_instruction_t *d, bool full) {
+    const unsigned width = lanes->width;
+    int64_t *mask = lanes->mask;
+    int64_t *rd = &lanes->reg[d->rd * width];
+    const int64_t *rs1 = &lanes->reg[d->rs1 * width];
+    const int64_t *rs2 = &lanes->reg[d->rs2 * width];
+    const int64_t imm = d->imm;
+
+#define LANE_ALU(expr)                                              \
+    for (unsigned i = 0; i < width; i += LANE_WIDTH) {              \
+        lane_vec_t a = V(rs1, i), b = V(rs2, i);                    \
+        lane_vec_t r = (expr);                                      \
+        (void)b;                                                    \
+        if (full)                                                   \
+            V(rd, i) = r;                                           \
+        else                                                        \
+            V(rd, i) = SELECT(V(mask, i), r, V(rd, i));             \
+    }                                                               \
+    break
+
+    switch (d->uop) {
+    case UOP_ADD: LANE_ALU(a + b);
+    case UOP_SUB: LANE_ALU(a - b);
+    case UOP_AND: LANE_ALU(a & b);
+    case UOP_OR: LANE_ALU(a | b);
+    case UOP_SLL: LANE_ALU((lane_vec_t)((lane_uvec_t)a << (lane_uvec_t)(b & 0x3F)));
+    case UOP_ADDI: LANE_ALU(a + imm);
+    case UOP_SUBI: LANE_ALU(a - imm);
+    case UOP_ANDI: LANE_ALU(a & imm);
+    case UOP_ORI: LANE_ALU(a | imm);
+    case UOP_SLLI: LANE_ALU((lane_vec_t)((lane_uvec_t)a << (imm & 0x3F)));
+    case UOP_LD:
+        for (unsigned l = 0; l < lanes->num_lanes; l++) {
+            if (mask[l])
+                rd[l] = dmem_read(lanes->mem[l], rs1[l] + imm, d->funct3);
+        }
+        break;
+    case UOP_SD:
+        for (unsigned l = 0; l < lanes->num_lanes; l++) {
+            if (mask[l])
+                dmem_write(lanes->mem[l], rs1[l] + imm, rs2[l], d->funct3);
+        }
+        break;
+    default:
+        break; // NOP; BEQ only moves the PC
+    }
+#undef LANE_ALU
+}
+
+// Halt the lanes that left the program and select the lanes at the lowest
+// running PC into mask. Returns that PC, or UINT64_MAX when no lane is
+// running; *all is set when every running lane is at that PC.
+static uint64_t select_min_pc(lanes_t *lanes, uint64_t size, bool *all) {
+    uint64_t min_pc = UINT64_MAX;
+    for (unsigned l = 0; l < lanes->num_lanes; l++) {
+        uint64_t pc = (uint64_t)lanes->pc[l];
+        if (lanes->active[l] && pc >= size)
+            lanes->active[l] = 0;
+        else if (lanes->active[l] && pc < min_pc)
+            min_pc = pc;
+    }
+    *all = true;
+    for (unsigned i = 0; i < lanes->width; i += LANE_WIDTH) {
+        lane_vec_t active = V(lanes->active, i);
+        lane_vec_t m = active & LANE_EQ(V(lanes->pc, i), (lane_vec_t){0} + (int64_t)min_pc);
+        V(lanes->mask, i) = m;
+        if (lane_any(active & ~m))
+            *all = false;
+    }
+    return min_pc;
+}
+
+// Run every lane until it leaves the program. While all running lanes share
+// a PC the engine steps them as one, with a scalar PC; a branch that splits
+// them switches to per-lane PCs and minimum-PC scheduling until they meet
+// again. Returns the instructions executed over all lanes.
+uint64_t run_lanes(lanes_t *lanes) {
+    const decoded_instruction_t *uops = lanes->decoded->uops;
+    const uint64_t size = lanes->decoded->size;
+    const unsigned width = lanes->width;
+
+    for (;;) {
+        // Diverged: issue the lowest PC for the lanes waiting there
+        bool all;
+        uint64_t pc = select_min_pc(lanes, size, &all);
+        if (pc == UINT64_MAX)
+            break;
+        if (!all) {
+            const decoded_instruction_t *d = &uops[pc];
+            execute_step(lanes, d, false);
+            for (unsigned i = 0; i < width; i += LANE_WIDTH) {
+                lane_vec_t m = V(lanes->mask, i), pcs = V(lanes->pc, i);
+                lane_vec_t next = pcs + 1;
+                if (d->uop == UOP_BEQ) {
+                    lane_vec_t taken = LANE_EQ(V(&lanes->reg[d->rs1 * width], i), V(&lanes->reg[d->rs2 * width], i));
+                    next = SELECT(taken, pcs + (int64_t)(d->imm / 2), next);
+                }
+                V(lanes->pc, i) = SELECT(m, next, pcs);
+                V(lanes->instructions, i) -= m;
+            }
+            lanes->steps++;
+            continue;
+        }
+
+        // Converged: the mask is the running lanes and stays so until a
+        // branch splits them or the program ends
+        unsigned running = 0;
+        for (unsigned l = 0; l < lanes->num_lanes; l++)
+            running += lanes->active[l] != 0;
+        bool full = running == lanes->num_lanes;
+        uint64_t steps = 0;
+        bool split = false;
+        while (pc < size) {
+            const decoded_instruction_t *d = &uops[pc];
+            steps++;
+            if (d->uop != UOP_BEQ) {
+                execute_step(lanes, d, full);
+                pc++;
+                continue;
+            }
+            const int64_t *rs1 = &lanes->reg[d->rs1 * width], *rs2 = &lanes->reg[d->rs2 * width];
+            lane_vec_t any_taken = {0}, any_not_taken = {0};
+            for (unsigned i = 0; i < width; i += LANE_WIDTH) {
+                lane_vec_t taken = LANE_EQ(V(rs1, i), V(rs2, i)), m = V(lanes->mask, i);
+                any_taken |= taken & m;
+                any_not_taken |= ~taken & m;
+            }
+            bool some_taken = lane_any(any_taken), some_not_taken = lane_any(any_not_taken);
+            uint64_t target = pc + (uint64_t)(int64_t)(d->imm / 2);
+            if (some_taken && some_not_taken) {
+                for (unsigned i = 0; i < width; i += LANE_WIDTH) {
+                    lane_vec_t taken = LANE_EQ(V(rs1, i), V(rs2, i)), m = V(lanes->mask, i);
+                    lane_vec_t next = SELECT(taken, (lane_vec_t){0} + (int64_t)target,
+                                             (lane_vec_t){0} + (int64_t)(pc + 1));
+                    V(lanes->pc, i) = SELECT(m, next, V(lanes->pc, i));
+                }
+                split = true;
+                break;
+            }
+            pc = some_taken ? target : pc + 1;
+        }
+
+        // Charge the lockstep steps to every running lane and hand the PCs
+        // back to the per-lane arrays
+        for (unsigned i = 0; i < width; i += LANE_WIDTH) {
+            lane_vec_t m = V(lanes->mask, i);
+            V(lanes->instructions, i) += m & ((lane_vec_t){0} + (int64_t)steps);
+            if (!split)
+                V(lanes->pc, i) = SELECT(m, (lane_vec_t){0} + (int64_t)pc, V(lanes->pc, i));
+        }
+        lanes->steps += steps;
+        if (!split) {
+            for (unsigned i = 0; i < width; i += LANE_WIDTH)
+                V(lanes->active, i) = (lane_vec_t){0};
+            break;
+        }
+    }
+
+    uint64_t total = 0;
+    for (unsigned l = 0; l < lanes->num_lanes; l++)
+        total += (uint64_t)lanes->instructions[l];
+    return total;
+}
+
+// Fill a core with the PC, registers and data memory of one lane, for the
+// core's printing and hashing functions. The view borrows the lane's memory.
+void lane_core_view(const lanes_t *lanes, unsigned lane, core_t *view) {
+    memset(view, 0, sizeof(*view));
+    view->PC = (addr_t)lanes->pc[lane] * 4;
+    view->clk = (tick_t)lanes->instructions[lane];
+    view->data_mem = lanes->mem[lane];
+    view->tick = tick_func;
+    for (unsigned r = 0; r < NUM_REGISTERS; r++)
+        view->reg_file[r] = lanes->reg[r * lanes->width + lane];
+}
+
+// Print the instructions, final PC and state hash of the first max_rows
+// lanes, and how many distinct end states the lanes reached
+void print_lanes_summary(const lanes_t *lanes, unsigned max_rows) {
+    uint64_t *hashes = (uint64_t *)malloc(lanes->num_lanes * sizeof(uint64_t));
+    printf("Lane \tInstructions \tPC \t\tState hash\n");
+    for (unsigned l = 0; l < lanes->num_lanes; l++) {
+        core_t view;
+        lane_core_view(lanes, l, &view);
+        uint64_t hash = core_state_hash(&view);
+        if (hashes != NULL)
+            hashes[l] = hash;
+        if (l < max_rows)
+            printf("%-4u \t%-12llu \t%-10llu \t%016llx\n", l, (unsigned long long)lanes->instructions[l],
+                   (unsigned long long)view.PC, (unsigned long long)hash);
+    }
+    if (lanes->num_lanes > max_rows)
+        printf("(%u more lanes)\n", lanes->num_lanes - max_rows);
+    if (hashes == NULL)
+        return;
+
+    qsort(hashes, lanes->num_lanes, sizeof(uint64_t), compare_hashes);
+    unsigned distinct = 0;
+    for (unsigned l = 0; l < lanes->num_lanes; l++)
+        distinct += l == 0 || hashes[l] != hashes[l - 1];
+    printf("Distinct end states \t: %u\n", distinct);
+    free(hashes);
+}
@@ -0,0 +1,37 @@
+#ifndef __LANES_H__
+#define __LANES_H__
+
+#include "core.h"
+
+#define LANES_MAX 65536
+#define LANES_ID_REG 10 // a0 holds the lane index at reset
+
+// N independent cores running one program in lockstep, stored as structure
+// of arrays so one host vector instruction advances several lanes. Each
+// lane has its own PC, registers and data memory. Lanes at different PCs
+// are masked: every step executes the instruction at the lowest PC of any
+// running lane, for the lanes at that PC, so diverged lanes reconverge
+// where their paths meet.
+typedef struct {
+    unsigned num_lanes;
+    unsigned width;          // num_lanes rounded up to the vector width
+    int64_t *reg;            // [reg * width + lane]
+    int64_t *pc;             // [lane], instruction index
+    int64_t *active;         // [lane], -1 while running, 0 once halted or padding
+    int64_t *mask;           // [lane], lanes executing the current step
+    int64_t *instructions;   // [lane], instructions executed
+    data_memory_t **mem;     // [lane]
+    const decode_cache_t *decoded;
+    uint64_t steps;          // Instructions issued, each for one or more lanes
+} lanes_t;
+
+// Function prototypes
+int init_lanes(lanes_t *lanes, const decode_cache_t *decoded, unsigned num_lanes, unsigned addr_bits);
+void free_lanes(lanes_t *lanes);
+void randomize_lane_args(lanes_t *lanes, uint64_t seed);
+uint64_t run_lanes(lanes_t *lanes);
+void lane_core_view(const lanes_t *lanes, unsigned lane, core_t *view);
+void print_lanes_summary(const lanes_t *lanes, unsigned max_rows);
+unsigned lane_vector_width(void);
+
+#endif
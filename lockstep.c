@@ -0,0 +1,244 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "lockstep.h"
+#include "disasm.h"
+#include <string.h>
+#include <time.h>
+
+#define CHECKER_POLL_NS 50000 // Checker sleep while the ring is empty
+
+static void diverge(lockstep_t *ls, lockstep_kind_t kind, uint64_t seq, const commit_record_t *record,
+                    unsigned reg, uint64_t expected, uint64_t actual) {
+    lockstep_divergence_t *d = &ls->divergence;
+    d->kind = kind;
+    d->seq = seq;
+    d->PC = record->PC;
+    d->clk = record->clk;
+    d->instruction = record->instruction;
+    d->reg = reg;
+    d->expected = expected;
+    d->actual = actual;
+}
+
+// Retire one instruction on the reference. Returns false if it already
+// left the program.
+static bool reference_step(lockstep_t *ls) {
+    core_t *ref = ls->reference;
+    if (ref->PC / 4 >= ref->instr_mem->size)
+        return false;
+    tick_func(ref);
+    ls->replayed++;
+    return true;
+}
+
+// Bring the reference to the record's instruction, executing any dropped
+// ones unchecked, then execute it and compare its effects. Returns false
+// on divergence.
+static bool check_record(lockstep_t *ls, const lockstep_record_t *r) {
+    core_t *ref = ls->reference;
+    const commit_record_t *c = &r->commit;
+
+    while (ls->replayed < r->seq) {
+        if (!reference_step(ls)) {
+            diverge(ls, LOCKSTEP_HALTED, r->seq, c, 0, ref->PC, c->PC);
+            return false;
+        }
+    }
+    if (ref->PC != c->PC) {
+        diverge(ls, ref->PC / 4 >= ref->instr_mem->size ? LOCKSTEP_HALTED : LOCKSTEP_PC, r->seq, c, 0, ref->PC,
+                c->PC);
+        return false;
+    }
+
+    unsigned instruction = fetch_instruction(ref);
+    uint64_t addr = (uint64_t)(ref->reg_file[(instruction >> 15) & 0x1F] + imm_gen(instruction));
+    reference_step(ls);
+    ls->checked++;
+
+    if ((c->flags & COMMIT_REG_WRITE) && (uint64_t)ref->reg_file[c->rd] != c->rd_value) {
+        diverge(ls, LOCKSTEP_REGISTER, r->seq, c, c->rd, (uint64_t)ref->reg_file[c->rd], c->rd_value);
+        return false;
+    }
+    if (c->flags & (COMMIT_MEM_READ | COMMIT_MEM_WRITE)) {
+        if (addr != c->mem_addr) {
+            diverge(ls, LOCKSTEP_MEM_ADDR, r->seq, c, 0, addr, c->mem_addr);
+            return false;
+        }
+        uint64_t data = dmem_load(ref->data_mem, addr, c->mem_size);
+        if (data != c->mem_data) {
+            diverge(ls, LOCKSTEP_MEM_DATA, r->seq, c, 0, data, c->mem_data);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Replay records as they arrive. After a divergence the remaining records
+// are discarded unchecked.
+static void *checker_main(void *arg) {
+    lockstep_t *ls = (lockstep_t *)arg;
+    struct timespec poll = {0, CHECKER_POLL_NS};
+
+    for (;;) {
+        bool closing = __atomic_load_n(&ls->closing, __ATOMIC_ACQUIRE);
+        void *records;
+        size_t count;
+        while ((count = spsc_ring_peek(&ls->ring, &records)) > 0) {
+            const lockstep_record_t *r = (const lockstep_record_t *)records;
+            for (size_t i = 0; i < count && ls->divergence.kind == LOCKSTEP_MATCH; i++)
+                check_record(ls, &r[i]);
+            spsc_ring_release(&ls->ring, count);
+        }
+        if (closing)
+            return NULL;
+        nanosleep(&poll, NULL);
+    }
+}
+
+// Start checking a core from its current state: the reference gets a copy
+// of its PC, clock, registers and data memory. The caller then sets
+// core->lockstep. Returns 0 on success, -1 on allocation failure.
+int start_lockstep(lockstep_t *lockstep, const core_t *core) {
+    memset(lockstep, 0, sizeof(*lockstep));
+    if (init_spsc_ring(&lockstep->ring, sizeof(lockstep_record_t), LOCKSTEP_RING_RECORDS) != 0)
+        return -1;
+    data_memory_t *mem = clone_data_memory(core->data_mem);
+    if (mem == NULL || (lockstep->reference = init_core_with_memory(core->instr_mem, mem)) == NULL) {
+        free_data_memory(mem);
+        free_spsc_ring(&lockstep->ring);
+        return -1;
+    }
+    lockstep->reference->owns_data_mem = true;
+    lockstep->reference->PC = core->PC;
+    lockstep->reference->clk = core->clk;
+    memcpy(lockstep->reference->reg_file, core->reg_file, sizeof(core->reg_file));
+
+    if (pthread_create(&lockstep->checker, NULL, checker_main, lockstep) != 0) {
+        free_core(lockstep->reference);
+        free_spsc_ring(&lockstep->ring);
+        return -1;
+    }
+    return 0;
+}
+
+// First byte at which two memories differ, searching the pages either has
+// allocated. Returns false if their contents are equal.
+static bool find_memory_difference(const data_memory_t *a, const data_memory_t *b, addr_t *addr) {
+    static const dmem_page_t zero_page;
+    for (size_t t = 0; t < a->num_tables && t < b->num_tables; t++) {
+        if (a->tables[t] == NULL && b->tables[t] == NULL)
+            continue;
+        for (size_t p = 0; p < DMEM_L2_SIZE; p++) {
+            const dmem_page_t *pa = a->tables[t] ? a->tables[t]->pages[p] : NULL;
+            const dmem_page_t *pb = b->tables[t] ? b->tables[t]->pages[p] : NULL;
+            pa = pa ? pa : &zero_page;
+            pb = pb ? pb : &zero_page;
+            if (pa == pb || memcmp(pa, pb, sizeof(*pa)) == 0)
+                continue;
+            size_t offset = 0;
+            while (pa->bytes[offset] == pb->bytes[offset])
+                offset++;
+            *addr = ((addr_t)t << DMEM_L1_SHIFT) | ((addr_t)p << DMEM_PAGE_SHIFT) | offset;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Compare the final state of a core that ran to completion with the
+// reference run to the same instruction count
+static void check_final_state(lockstep_t *ls, core_t *core) {
+    core_t *ref = ls->reference;
+    commit_record_t last;
+    memset(&last, 0, sizeof(last));
+    last.PC = core->PC;
+    last.clk = core->clk;
+
+    while (ls->replayed < ls->seq) {
+        if (!reference_step(ls)) {
+            diverge(ls, LOCKSTEP_HALTED, ls->replayed, &last, 0, ref->PC, core->PC);
+            return;
+        }
+    }
+    if (ref->PC != core->PC) {
+        diverge(ls, LOCKSTEP_FINAL_PC, ls->seq, &last, 0, ref->PC, core->PC);
+        return;
+    }
+    for (unsigned r = 0; r < NUM_REGISTERS; r++) {
+        if (ref->reg_file[r] != core->reg_file[r]) {
+            diverge(ls, LOCKSTEP_FINAL_REGISTER, ls->seq, &last, r, (uint64_t)ref->reg_file[r],
+                    (uint64_t)core->reg_file[r]);
+            return;
+        }
+    }
+    addr_t addr;
+    if (find_memory_difference(ref->data_mem, core->data_mem, &addr)) {
+        diverge(ls, LOCKSTEP_FINAL_MEMORY, ls->seq, &last, 0, dmem_load(ref->data_mem, addr, 1),
+                dmem_load(core->data_mem, addr, 1));
+        ls->divergence.addr = addr;
+    }
+}
+
+// Stop the checker after it has replayed every record. If no divergence
+// was found and core is not NULL, the core is taken to have run to
+// completion: the reference runs the instructions whose records were
+// dropped and the final registers and memory are compared. The caller
+// clears core->lockstep first. Returns the divergence, NULL if none.
+const lockstep_divergence_t *finish_lockstep(lockstep_t *lockstep, core_t *core) {
+    __atomic_store_n(&lockstep->closing, 1, __ATOMIC_RELEASE);
+    pthread_join(lockstep->checker, NULL);
+    free_spsc_ring(&lockstep->ring);
+    if (lockstep->divergence.kind == LOCKSTEP_MATCH && core != NULL)
+        check_final_state(lockstep, core);
+    free_core(lockstep->reference);
+    lockstep->reference = NULL;
+    return lockstep->divergence.kind == LOCKSTEP_MATCH ? NULL : &lockstep->divergence;
+}
+
+// Print the coverage of the check and the first divergence, if any
+void print_lockstep_report(const lockstep_t *lockstep) {
+    const lockstep_divergence_t *d = &lockstep->divergence;
+    printf("Lockstep check \t\t: %llu of %llu retired instructions compared with tick_func, %llu dropped\n",
+           (unsigned long long)lockstep->checked, (unsigned long long)lockstep->seq,
+           (unsigned long long)lockstep->dropped);
+    if (d->kind == LOCKSTEP_MATCH) {
+        printf("Lockstep check passed\n");
+        return;
+    }
+
+    if (d->kind >= LOCKSTEP_FINAL_PC) {
+        printf("Divergence in the final state after %llu instructions: ", (unsigned long long)d->seq);
+        if (d->kind == LOCKSTEP_FINAL_PC)
+            printf("PC %llu, reference %llu\n", (unsigned long long)d->actual, (unsigned long long)d->expected);
+        else if (d->kind == LOCKSTEP_FINAL_REGISTER)
+            printf("x%u = %lld, reference %lld\n", d->reg, (long long)d->actual, (long long)d->expected);
+        else
+            printf("mem[%llu] = 0x%02llx, reference 0x%02llx\n", (unsigned long long)d->addr,
+                   (unsigned long long)d->actual, (unsigned long long)d->expected);
+        return;
+    }
+
+    char text[DISASM_MAX_LENGTH];
+    disassemble(d->instruction, text, sizeof(text));
+    printf("Divergence at instruction %llu, PC %llu, clock %llu (%08x %s): ", (unsigned long long)d->seq,
+           (unsigned long long)d->PC, (unsigned long long)d->clk, d->instruction, text);
+    switch (d->kind) {
+    case LOCKSTEP_PC:
+        printf("retired PC %llu, reference at PC %llu\n", (unsigned long long)d->actual,
+               (unsigned long long)d->expected);
+        break;
+    case LOCKSTEP_REGISTER:
+        printf("x%u = %lld, reference %lld\n", d->reg, (long long)d->actual, (long long)d->expected);
+        break;
+    case LOCKSTEP_MEM_ADDR:
+        printf("address %llu, reference %llu\n", (unsigned long long)d->actual, (unsigned long long)d->expected);
+        break;
+    case LOCKSTEP_MEM_DATA:
+        printf("memory data 0x%llx, reference 0x%llx\n", (unsigned long long)d->actual,
+               (unsigned long long)d->expected);
+        break;
+    default:
+        printf("reference left the program at PC %llu\n", (unsigned long long)d->expected);
+        break;
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef __LOCKSTEP_H__
+#define __LOCKSTEP_H__
+
+#include <pthread.h>
+
+#include "core.h"
+
+#define LOCKSTEP_RING_RECORDS (1u << 16) // Records buffered between core and checker
+
+// Kinds of divergence
+typedef enum {
+    LOCKSTEP_MATCH,       // No divergence
+    LOCKSTEP_PC,          // Retired PC differs from the reference
+    LOCKSTEP_REGISTER,    // Value written to rd differs
+    LOCKSTEP_MEM_ADDR,    // Load or store effective address differs
+    LOCKSTEP_MEM_DATA,    // Value loaded or stored differs
+    LOCKSTEP_HALTED,      // Reference left the program before the core
+    LOCKSTEP_FINAL_PC,    // End of the run: PC differs
+    LOCKSTEP_FINAL_REGISTER,
+    LOCKSTEP_FINAL_MEMORY // End of the run: a data memory byte differs
+} lockstep_kind_t;
+
+// Retired instruction with its position in the retirement order. A gap in
+// seq means the core dropped records while the ring was full.
+typedef struct {
+    uint64_t seq;
+    commit_record_t commit;
+} lockstep_record_t;
+
+// First divergence found by the checker
+typedef struct {
+    lockstep_kind_t kind;
+    uint64_t seq;         // Retired instruction number, from 0
+    uint64_t PC;
+    uint64_t clk;         // Clock of the checked core at retirement
+    unsigned instruction;
+    unsigned reg;         // LOCKSTEP_REGISTER and LOCKSTEP_FINAL_REGISTER
+    uint64_t addr;        // LOCKSTEP_FINAL_MEMORY
+    uint64_t expected;    // Reference value
+    uint64_t actual;      // Checked core's value
+} lockstep_divergence_t;
+
+// Checks a core against tick_func on a second thread. The core pushes a
+// record per retired instruction into a lock-free ring and never waits: a
+// record that does not fit is dropped, and the reference core executes
+// through the gap unchecked. The reference runs the same program from a
+// copy of the core's starting state.
+typedef struct lockstep_s {
+    spsc_ring_t ring;
+    uint64_t seq;           // Records offered by the core
+    uint64_t dropped;       // Records lost to a full ring
+    pthread_t checker;
+    int closing;            // Set by finish_lockstep, read by the checker
+    core_t *reference;
+    uint64_t replayed;      // Instructions retired by the reference
+    uint64_t checked;       // Records compared by the checker
+    lockstep_divergence_t divergence;
+} lockstep_t;
+
+// Function prototypes
+int start_lockstep(lockstep_t *lockstep, const core_t *core);
+const lockstep_divergence_t *finish_lockstep(lockstep_t *lockstep, core_t *core);
+void print_lockstep_report(const lockstep_t *lockstep);
+
+// Offer a retired instruction to the checker, dropping it if the ring is full
+static inline void lockstep_push(lockstep_t *lockstep, const commit_record_t *record) {
+    lockstep_record_t *slot = (lockstep_record_t *)spsc_ring_reserve(&lockstep->ring);
+    uint64_t seq = lockstep->seq++;
+    if (slot == NULL) {
+        lockstep->dropped++;
+        return;
+    }
+    slot->seq = seq;
+    slot->commit = *record;
+    spsc_ring_commit(&lockstep->ring);
+}
+
+#endif
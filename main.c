@@ -4,7 +4,17 @@
  *  $make clean && make
  *
  * Execute as follows: 
- *  $./RISCV_core <trace file>
+ *  $./RISCV_core [--engine=reference|decoded|threaded|block|pipeline] [--mem-bits=N] [--threads=N]
+ *                [--stats=text|json] [--output=<stats file>] [--profile[=N]] [--commit-log=<file>] [--lockstep]
+ *                <trace file>
+ *  $./RISCV_core [--engine=...] [--threads=N] [--output=<file>] --batch=<directory or list file>
+ *  Pipeline options: [--predictor=not-taken|btfn|bimodal|gshare] [--bht-bits=N] [--history=N] [--btb=N]
+ *  Timing options (reference and pipeline engines): [--dcache=SIZE:LINE:WAYS[:option...]] [--icache=...]
+ *  Checkpoints: [--checkpoint-at=N --save-checkpoint=<file>] [--restore-checkpoint=<file>]
+ *  Sampled timing on the pipeline: [--sample=FAST_FORWARD:WARMUP:MEASURE]
+ *  Multi-hart, reference or decoded engine: [--harts=N] [--quantum=N]
+ *  SIMD lanes of independent cores: [--lanes=N] [--lane-seed=N]
+ *  Design-space sweep: [--sweep=KEY=VALUE,...;KEY=VALUE,... | --sweep=@<grid file>] [--threads=N] [--output=<file>]
  *
  * Modified by: Naga Kandasamy
  * Date: August 8, 2024
@@ -13,35 +23,539 @@
  * Date: 08/15/2024
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#include <time.h>
 
+#include "batch.h"
 #include "core.h"
+#include "decoder.h"
+#include "engine.h"
+#include "lanes.h"
+#include "lockstep.h"
+#include "multihart.h"
 #include "parser.h"
+#include "sampling.h"
+#include "sweep.h"
+
+// Branches listed in the per-PC prediction report
+#define BRANCH_REPORT_ROWS 10
+// Fetch PCs listed in the per-PC I-cache miss report
+#define MISS_REPORT_ROWS 10
+// Default rows of each hot-spot table of --profile
+#define PROFILE_REPORT_ROWS 10
+// Lanes listed in the --lanes summary
+#define LANE_REPORT_ROWS 10
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [--engine=reference|decoded|threaded|block|pipeline] [--mem-bits=N] [--threads=N]\n", prog);
+    printf("       %*s [--stats=text|json] [--output=<stats-file>] [--profile[=N]] [--commit-log=<file>]\n",
+           (int)strlen(prog), "");
+    printf("       %*s [--lockstep] <trace-file>\n", (int)strlen(prog), "");
+    printf("       %s [--engine=...] [--threads=N] [--output=<file>] %s\n", prog, "--batch=<directory|list-file>");
+    printf("Pipeline options: [--predictor=not-taken|btfn|bimodal|gshare] [--bht-bits=N] [--history=N] [--btb=N]\n");
+    printf("Timing options: [--dcache=SIZE:LINE:WAYS[:wb|wt][:wa|nwa][:lru|plru|random][:latency=N][:prefetch]]\n");
+    printf("                [--icache=SIZE:LINE:WAYS[:lru|plru|random][:latency=N][:prefetch]]\n");
+    printf("Checkpoints: [--checkpoint-at=N --save-checkpoint=<file>] [--restore-checkpoint=<file>]\n");
+    printf("Sampling: [--sample=FAST_FORWARD:WARMUP:MEASURE] (instructions per period)\n");
+    printf("Multi-hart: [--harts=N] [--quantum=N] (instructions per hart between barriers)\n");
+    printf("SIMD lanes: [--lanes=N] [--lane-seed=N] (random a1-a7 per lane)\n");
+    printf("Sweep: [--sweep=KEY=VALUE[,VALUE...][;KEY=...] | --sweep=@<grid-file>] "
+           "(keys engine, predictor, bht-bits, history, btb, dcache, icache)\n");
+    exit(EXIT_FAILURE);  // Change EXIT_SUCCESS to EXIT_FAILURE
+}
+
+static void parse_cache_option(const char *spec, cache_config_t *config) {
+    if (parse_cache_config(spec, config) != 0 || !cache_config_valid(config)) {
+        fprintf(stderr, "Invalid cache %s: expected SIZE:LINE:WAYS[:option...] "
+                "with power-of-two line size and set count.\n", spec);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Run the first checkpoint_at instructions functionally, warming the
+// configured caches and predictor, and save the core and that state
+static int save_checkpoint_main(core_t *core, const engine_config_t *config, uint64_t checkpoint_at,
+                                const char *path) {
+    uarch_state_t uarch;
+    if (init_uarch_state(&uarch, &config->dcache, &config->icache, &config->pipeline.predictor,
+                         core->instr_mem->size) != 0) {
+        perror("Failed to allocate the cache and predictor state.");
+        return EXIT_FAILURE;
+    }
+    core->dcache = uarch.dcache;
+    core->icache = uarch.icache;
+    core->tick = (uarch.dcache != NULL || uarch.icache != NULL) ? tick_func : tick_decoded_func;
+    uint64_t executed = run_instructions(core, checkpoint_at, uarch.predictor);
+    core->dcache = NULL;
+    core->icache = NULL;
+
+    int status = save_checkpoint(path, core, &uarch);
+    free_uarch_state(&uarch);
+    if (status != CHECKPOINT_OK) {
+        fprintf(stderr, "Cannot save checkpoint %s: %s\n", path, checkpoint_error_string(status));
+        return EXIT_FAILURE;
+    }
+    if (executed < checkpoint_at)
+        printf("Program ended after %llu instructions\n", (unsigned long long)executed);
+    printf("Saved checkpoint at instruction %llu (PC %llu, clock %llu) to %s\n", (unsigned long long)executed,
+           (unsigned long long)core->PC, (unsigned long long)core->clk, path);
+    return EXIT_SUCCESS;
+}
+
+// Run num_harts harts of the program on the shared data memory, each on its
+// own host thread, and print every hart's registers and the shared memory
+static int multihart_main(instruction_memory_t *instr_mem, decode_cache_t *decoded, data_memory_t *data_mem,
+                          engine_t engine, unsigned num_harts, uint64_t quantum, const char *stats) {
+    multihart_t mh;
+    if (init_multihart(&mh, instr_mem, decoded, data_mem, num_harts) != 0) {
+        perror("Failed to initialize the harts.");
+        return EXIT_FAILURE;
+    }
+    double start_time = now_seconds();
+    if (run_multihart(&mh, engine, quantum) != 0) {
+        perror("Failed to start the hart threads.");
+        free_multihart(&mh);
+        return EXIT_FAILURE;
+    }
+    double elapsed = now_seconds() - start_time;
+
+    uint64_t instructions = 0;
+    for (unsigned i = 0; i < num_harts; i++)
+        instructions += mh.instructions[i];
+    printf("Simulation complete.\n");
+    printf("Executed %llu instructions on %u harts in %llu quanta, %.6f s (%.2f MIPS)\n",
+           (unsigned long long)instructions, num_harts, (unsigned long long)mh.quanta, elapsed,
+           elapsed > 0 ? instructions / elapsed * 1e-6 : 0.0);
+    print_multihart_state(&mh);
+    print_data_memory(mh.harts[0], 0, 32);
+    if (stats != NULL) {
+        for (unsigned i = 0; i < num_harts; i++) {
+            printf("Hart %u counters\n", i);
+            print_perf_counters(&mh.harts[i]->perf);
+        }
+    }
+    free_multihart(&mh);
+    return EXIT_SUCCESS;
+}
+
+// Run num_lanes independent copies of the program in SIMD lanes and print
+// lane 0's registers and memory and a summary of every lane
+static int lanes_main(decode_cache_t *decoded, unsigned mem_bits, unsigned num_lanes, bool seeded, uint64_t seed) {
+    lanes_t lanes;
+    if (init_lanes(&lanes, decoded, num_lanes, mem_bits) != 0) {
+        perror("Failed to initialize the lanes.");
+        return EXIT_FAILURE;
+    }
+    if (seeded)
+        randomize_lane_args(&lanes, seed);
+
+    double start_time = now_seconds();
+    uint64_t instructions = run_lanes(&lanes);
+    double elapsed = now_seconds() - start_time;
+    printf("Simulation complete.\n");
+    printf("Executed %llu instructions on %u lanes in %llu steps, %.6f s (%.2f MIPS)\n",
+           (unsigned long long)instructions, num_lanes, (unsigned long long)lanes.steps, elapsed,
+           elapsed > 0 ? instructions / elapsed * 1e-6 : 0.0);
+    printf("Lane utilization \t: %.2f%% (%u lanes per vector)\n",
+           lanes.steps > 0 ? 100.0 * instructions / ((double)lanes.steps * num_lanes) : 0.0, lane_vector_width());
+    print_lanes_summary(&lanes, LANE_REPORT_ROWS);
+
+    core_t view;
+    lane_core_view(&lanes, 0, &view);
+    print_core_state(&view);
+    print_data_memory(&view, 0, 32);
+    free_lanes(&lanes);
+    return EXIT_SUCCESS;
+}
+
+// Run every configuration of a grid from the core's state and write the
+// result table
+static int sweep_main(const sweep_grid_t *grid, const core_t *core, engine_t engine, const engine_config_t *config,
+                      unsigned num_threads, const char *output) {
+    FILE *out = stdout;
+    if (output != NULL && (out = fopen(output, "w")) == NULL) {
+        perror("Cannot open output file.");
+        return EXIT_FAILURE;
+    }
+    double start_time = now_seconds();
+    int failed = run_sweep(grid, core, engine, config, num_threads, out);
+    if (out != stdout)
+        fclose(out);
+    if (failed < 0) {
+        perror("Failed to run the sweep.");
+        return EXIT_FAILURE;
+    }
+    fprintf(stderr, "Swept %zu configurations in %.3f s\n", grid->num_configs, now_seconds() - start_time);
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Simulate a whole directory or list of traces and write one record per trace
+static int batch_main(const char *source, engine_t engine, const engine_config_t *config,
+                      unsigned num_threads, const char *output) {
+    FILE *out = stdout;
+    if (output != NULL && (out = fopen(output, "w")) == NULL) {
+        perror("Cannot open output file.");
+        return EXIT_FAILURE;
+    }
+
+    int failed = run_batch(source, engine, config, num_threads, out);
+    if (out != stdout)
+        fclose(out);
+
+    if (failed < 0) {
+        fprintf(stderr, "Cannot read batch source %s\n", source);
+        return EXIT_FAILURE;
+    }
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
 
 int main(int argc, const char **argv)
 {   
-    if (argc != 2) {
-        printf("Usage: %s %s\n", argv[0], "<trace-file>");
-        exit(EXIT_FAILURE);  // Change EXIT_SUCCESS to EXIT_FAILURE
+    engine_t engine = ENGINE_DECODED;
+    const char *trace = NULL;
+    const char *batch = NULL;
+    const char *output = NULL;
+    unsigned num_threads = 0;
+    unsigned mem_bits = DMEM_DEFAULT_ADDR_BITS;
+    const char *stats = NULL;
+    size_t profile_rows = PROFILE_REPORT_ROWS;
+    const char *commit_log_path = NULL;
+    bool check_lockstep = false;
+    const char *save_path = NULL;
+    const char *restore_path = NULL;
+    uint64_t checkpoint_at = 0;
+    const char *sample_spec = NULL;
+    sampling_config_t sampling;
+    unsigned num_harts = 1;
+    uint64_t quantum = MULTIHART_DEFAULT_QUANTUM;
+    unsigned num_lanes = 0;
+    const char *sweep_spec = NULL;
+    sweep_grid_t grid;
+    bool lane_seeded = false;
+    uint64_t lane_seed = 0;
+    engine_config_t config;
+    default_engine_config(&config);
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--engine=", 9) == 0) {
+            if (engine_from_name(argv[i] + 9, &engine) != 0)
+                usage(argv[0]);
+        } else if (strncmp(argv[i], "--batch=", 8) == 0) {
+            batch = argv[i] + 8;
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            num_threads = (unsigned)atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--mem-bits=", 11) == 0) {
+            mem_bits = (unsigned)atoi(argv[i] + 11);
+        } else if (strncmp(argv[i], "--predictor=", 12) == 0) {
+            if (bp_kind_from_name(argv[i] + 12, &config.pipeline.predictor.kind) != 0)
+                usage(argv[0]);
+        } else if (strncmp(argv[i], "--bht-bits=", 11) == 0) {
+            config.pipeline.predictor.table_bits = (unsigned)atoi(argv[i] + 11);
+        } else if (strncmp(argv[i], "--history=", 10) == 0) {
+            config.pipeline.predictor.history_bits = (unsigned)atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--btb=", 6) == 0) {
+            config.pipeline.predictor.btb_entries = (unsigned)atoi(argv[i] + 6);
+        } else if (strncmp(argv[i], "--dcache=", 9) == 0) {
+            parse_cache_option(argv[i] + 9, &config.dcache);
+        } else if (strncmp(argv[i], "--icache=", 9) == 0) {
+            parse_cache_option(argv[i] + 9, &config.icache);
+        } else if (strncmp(argv[i], "--stats=", 8) == 0) {
+            stats = argv[i] + 8;
+            if (strcmp(stats, "text") != 0 && strcmp(stats, "json") != 0)
+                usage(argv[0]);
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            config.profile = true;
+        } else if (strncmp(argv[i], "--profile=", 10) == 0) {
+            config.profile = true;
+            profile_rows = (size_t)atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--checkpoint-at=", 16) == 0) {
+            checkpoint_at = strtoull(argv[i] + 16, NULL, 10);
+        } else if (strncmp(argv[i], "--save-checkpoint=", 18) == 0) {
+            save_path = argv[i] + 18;
+        } else if (strncmp(argv[i], "--restore-checkpoint=", 21) == 0) {
+            restore_path = argv[i] + 21;
+        } else if (strncmp(argv[i], "--sample=", 9) == 0) {
+            sample_spec = argv[i] + 9;
+            if (parse_sampling_config(sample_spec, &sampling) != 0)
+                usage(argv[0]);
+        } else if (strncmp(argv[i], "--harts=", 8) == 0) {
+            num_harts = (unsigned)atoi(argv[i] + 8);
+        } else if (strncmp(argv[i], "--quantum=", 10) == 0) {
+            quantum = strtoull(argv[i] + 10, NULL, 10);
+        } else if (strncmp(argv[i], "--lanes=", 8) == 0) {
+            num_lanes = (unsigned)atoi(argv[i] + 8);
+            if (num_lanes == 0 || num_lanes > LANES_MAX)
+                usage(argv[0]);
+        } else if (strncmp(argv[i], "--lane-seed=", 12) == 0) {
+            lane_seeded = true;
+            lane_seed = strtoull(argv[i] + 12, NULL, 10);
+        } else if (strncmp(argv[i], "--sweep=", 8) == 0) {
+            sweep_spec = argv[i] + 8;
+        } else if (strcmp(argv[i], "--lockstep") == 0) {
+            check_lockstep = true;
+        } else if (strncmp(argv[i], "--commit-log=", 13) == 0) {
+            commit_log_path = argv[i] + 13;
+        } else if (strncmp(argv[i], "--output=", 9) == 0) {
+            output = argv[i] + 9;
+        } else if (argv[i][0] != '-' && trace == NULL) {
+            trace = argv[i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (!bp_config_valid(&config.pipeline.predictor)) {
+        fprintf(stderr, "Predictor tables are at most 2^%d entries, gshare history at most --bht-bits, "
+                "and the BTB size a power of two.\n", BP_MAX_TABLE_BITS);
+        exit(EXIT_FAILURE);
     }
+    if (config.profile && (batch != NULL || !engine_has_hooks(engine))) {
+        fprintf(stderr, "--profile needs a single trace and the reference, decoded or pipeline engine.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (commit_log_path != NULL && (batch != NULL || !engine_has_hooks(engine))) {
+        fprintf(stderr, "--commit-log needs a single trace and the reference, decoded or pipeline engine.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (check_lockstep && (batch != NULL || !engine_has_hooks(engine) || save_path != NULL || sample_spec != NULL ||
+                           num_harts > 1 || num_lanes > 0)) {
+        fprintf(stderr, "--lockstep needs a single full run on the reference, decoded or pipeline engine.\n");
+        exit(EXIT_FAILURE);
+    }
+    if ((save_path != NULL || restore_path != NULL) && batch != NULL) {
+        fprintf(stderr, "Checkpoints apply to a single trace.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (save_path != NULL && commit_log_path != NULL) {
+        fprintf(stderr, "--save-checkpoint cannot be combined with --commit-log.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (sample_spec != NULL && (batch != NULL || config.profile || commit_log_path != NULL || save_path != NULL ||
+                                (stats != NULL && strcmp(stats, "json") == 0))) {
+        fprintf(stderr, "--sample runs a single trace and cannot be combined with --profile, --commit-log, "
+                "--save-checkpoint or --stats=json.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (num_harts < 1 || num_harts > MULTIHART_MAX_HARTS || quantum == 0) {
+        fprintf(stderr, "--harts must be 1 to %d and --quantum positive.\n", MULTIHART_MAX_HARTS);
+        exit(EXIT_FAILURE);
+    }
+    if (num_harts > 1 && (batch != NULL || (engine != ENGINE_REFERENCE && engine != ENGINE_DECODED) ||
+                          config.profile || commit_log_path != NULL || save_path != NULL || restore_path != NULL ||
+                          sample_spec != NULL || (stats != NULL && strcmp(stats, "json") == 0))) {
+        fprintf(stderr, "--harts runs a single trace on the reference or decoded engine and cannot be combined "
+                "with --profile, --commit-log, checkpoints, --sample or --stats=json.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (num_lanes > 0 && (batch != NULL || num_harts > 1 || config.profile || commit_log_path != NULL ||
+                          save_path != NULL || restore_path != NULL || sample_spec != NULL || stats != NULL)) {
+        fprintf(stderr, "--lanes runs a single trace on its own engine and cannot be combined with --harts, "
+                "--profile, --commit-log, checkpoints, --sample or --stats.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (sweep_spec != NULL) {
+        if (batch != NULL || num_harts > 1 || num_lanes > 0 || config.profile || commit_log_path != NULL ||
+            check_lockstep || save_path != NULL || sample_spec != NULL || stats != NULL) {
+            fprintf(stderr, "--sweep runs a single trace and cannot be combined with --batch, --harts, --lanes, "
+                    "--profile, --commit-log, --lockstep, --save-checkpoint, --sample or --stats.\n");
+            exit(EXIT_FAILURE);
+        }
+        int grid_status = parse_sweep_grid(sweep_spec, &grid);
+        if (grid_status != SWEEP_OK) {
+            fprintf(stderr, "Invalid sweep grid: %s\n", sweep_error_string(grid_status));
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (batch != NULL)
+        return batch_main(batch, engine, &config, num_threads, output);
+    if (trace == NULL)
+        usage(argv[0]);
 
     // Translate assembly instructions into binary format; store binary instructions into instruction memory.
+    // Large traces are assembled on --threads threads.
+    // A sweep keeps stdout for its result table
+    FILE *info = sweep_spec != NULL ? stderr : stdout;
+    fprintf(info, "Loading trace file: %s\n", trace);
     instruction_memory_t instr_mem;
-    instr_mem.last = NULL;
-    load_instructions(&instr_mem, argv[1]);
+    int status = load_instructions_parallel(&instr_mem, trace, num_threads);
+    if (status != LOAD_OK) {
+        fprintf(stderr, "Cannot load %s: %s\n", trace, load_error_string(status));
+        exit(EXIT_FAILURE);
+    }
+    if (instr_mem.num_unknown > 0)
+        fprintf(info, "Skipped %u unknown instructions\n", instr_mem.num_unknown);
 
-    // Initialize core with the instruction memory
-    core_t* core = init_core(&instr_mem);
+    // Decode instruction memory once; the core then fetches decoded instructions by PC / 4.
+    decode_cache_t decoded;
+    if (build_decode_cache(&instr_mem, &decoded) != 0) {
+        perror("Failed to decode instruction memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    if (num_lanes > 0) {
+        status = lanes_main(&decoded, mem_bits, num_lanes, lane_seeded, lane_seed);
+        free_instruction_memory(&instr_mem);
+        free_decode_cache(&decoded);
+        return status;
+    }
+
+    // Initialize core with the instruction memory and a 2^mem_bits byte data memory
+    data_memory_t *data_mem = new_data_memory(mem_bits);
+    if (data_mem == NULL) {
+        fprintf(stderr, "Data memory size must be %d to %d address bits.\n", DMEM_MIN_ADDR_BITS, DMEM_MAX_ADDR_BITS);
+        exit(EXIT_FAILURE);
+    }
+    if (num_harts > 1) {
+        status = multihart_main(&instr_mem, &decoded, data_mem, engine, num_harts, quantum, stats);
+        free_data_memory(data_mem);
+        free_instruction_memory(&instr_mem);
+        free_decode_cache(&decoded);
+        return status;
+    }
+    core_t* core = init_core_with_memory(&instr_mem, data_mem);
     if (core == NULL) {
         perror("Failed to initialize the core.");
         exit(EXIT_FAILURE);
     }
+    core->decoded = &decoded;
+
+    if (save_path != NULL) {
+        status = save_checkpoint_main(core, &config, checkpoint_at, save_path);
+        free_core(core);
+        free_data_memory(data_mem);
+        free_instruction_memory(&instr_mem);
+        free_decode_cache(&decoded);
+        return status;
+    }
+
+    // Continue from a checkpoint, with its caches and predictor warm
+    uarch_state_t warm = {NULL, NULL, NULL};
+    if (restore_path != NULL) {
+        if (init_uarch_state(&warm, &config.dcache, &config.icache,
+                             engine == ENGINE_PIPELINE ? &config.pipeline.predictor : NULL, instr_mem.size) != 0) {
+            perror("Failed to allocate the cache and predictor state.");
+            exit(EXIT_FAILURE);
+        }
+        status = restore_checkpoint(restore_path, core, &warm);
+        if (status != CHECKPOINT_OK) {
+            fprintf(stderr, "Cannot restore checkpoint %s: %s\n", restore_path, checkpoint_error_string(status));
+            exit(EXIT_FAILURE);
+        }
+        config.warm = &warm;
+        fprintf(info, "Restored checkpoint %s at PC %llu, clock %llu\n", restore_path,
+                (unsigned long long)core->PC, (unsigned long long)core->clk);
+    }
+
+    // Each configuration runs on a worker thread from a copy-on-write fork of
+    // this core's memory; the instruction memory and decode cache are shared
+    if (sweep_spec != NULL) {
+        status = sweep_main(&grid, core, engine, &config, num_threads, output);
+        free_sweep_grid(&grid);
+        free_core(core);
+        free_data_memory(data_mem);
+        free_instruction_memory(&instr_mem);
+        free_decode_cache(&decoded);
+        free_uarch_state(&warm);
+        return status;
+    }
+
+    // Retired instructions are logged in binary by a writer thread
+    commit_log_t commit_log;
+    if (commit_log_path != NULL) {
+        if (open_commit_log(&commit_log, commit_log_path) != 0) {
+            perror("Cannot open commit log.");
+            exit(EXIT_FAILURE);
+        }
+        core->commit_log = &commit_log;
+    }
+
+    // Sampled simulation: functional fast-forward and warm-up, pipeline timing
+    // of short intervals, CPI extrapolated to the whole run
+    if (sample_spec != NULL) {
+        sampling_result_t sampled;
+        double start_time = now_seconds();
+        if (run_sampled(core, &config, &sampling, &sampled) != 0) {
+            perror("Failed to allocate the timing models.");
+            exit(EXIT_FAILURE);
+        }
+        printf("Sampled simulation complete in %.6f s\n", now_seconds() - start_time);
+        print_sampling_result(&sampled);
+        printf("Detailed intervals:\n");
+        print_pipeline_stats(&sampled.pipeline);
+        print_core_state(core);
+        print_data_memory(core, 0, 32);
+        if (stats != NULL)
+            print_perf_counters(&core->perf);
+        free_core(core);
+        free_data_memory(data_mem);
+        free_instruction_memory(&instr_mem);
+        free_decode_cache(&decoded);
+        free_uarch_state(&warm);
+        return 0;
+    }
+
+    // Retired instructions are checked against tick_func on another thread
+    lockstep_t lockstep;
+    if (check_lockstep) {
+        if (start_lockstep(&lockstep, core) != 0) {
+            perror("Failed to start the lockstep checker.");
+            exit(EXIT_FAILURE);
+        }
+        core->lockstep = &lockstep;
+    }
 
     // Simulate core 
-    while (core->tick(core));
+    engine_result_t result;
+    double start_time = now_seconds();
+    if (run_engine(core, engine, &config, &result) != 0) {
+        perror("Failed to allocate the execution engine.");
+        exit(EXIT_FAILURE);
+    }
+    if (core->commit_log != NULL) {
+        core->commit_log = NULL;
+        if (close_commit_log(&commit_log) != 0) {
+            fprintf(stderr, "Failed to write commit log %s\n", commit_log_path);
+            exit(EXIT_FAILURE);
+        }
+    }
+    double elapsed = now_seconds() - start_time;
     printf("Simulation complete.\n");
+    printf("Executed %llu instructions in %.6f s (%.2f MIPS)\n", (unsigned long long)result.instructions,
+           elapsed, elapsed > 0 ? result.instructions / elapsed * 1e-6 : 0.0);
+    bool diverged = false;
+    if (core->lockstep != NULL) {
+        core->lockstep = NULL;
+        diverged = finish_lockstep(&lockstep, core) != NULL;
+        print_lockstep_report(&lockstep);
+    }
+    if (engine == ENGINE_PIPELINE) {
+        print_pipeline_stats(&result.pipeline);
+        print_branch_profile(&result.branches, BRANCH_REPORT_ROWS);
+    }
+    if (engine == ENGINE_REFERENCE || engine == ENGINE_PIPELINE) {
+        if (engine == ENGINE_REFERENCE && (config.dcache.size > 0 || config.icache.size > 0))
+            printf("Cycles \t\t\t: %llu\n", (unsigned long long)result.cycles);
+        if (config.dcache.size > 0)
+            print_cache_stats("D-cache", &result.dcache);
+        if (config.icache.size > 0) {
+            print_cache_stats("I-cache", &result.icache);
+            print_icache_profile(&result.icache_misses, MISS_REPORT_ROWS);
+        }
+    }
+
+    // Hot PCs, basic blocks and loops by attributed cycles
+    if (config.profile)
+        print_guest_profile(&result.profile, &instr_mem, profile_rows);
 
     // Print register file 
     print_core_state(core);
@@ -52,6 +566,25 @@ int main(int argc, const char **argv)
     
     print_data_memory(core, start, end);
 
-    free(core);  // Free allocated memory for the core object   
-    return 0;
+    // Performance counters, as text or as JSON on stdout or in --output
+    if (stats != NULL && strcmp(stats, "text") == 0) {
+        print_perf_counters(&core->perf);
+    } else if (stats != NULL) {
+        FILE *out = stdout;
+        if (output != NULL && (out = fopen(output, "w")) == NULL) {
+            perror("Cannot open output file.");
+            exit(EXIT_FAILURE);
+        }
+        write_stats_json(out, trace, engine, &config, &result, &core->perf, elapsed);
+        if (out != stdout)
+            fclose(out);
+    }
+
+    free_core(core);  // Free allocated memory for the core object   
+    free_data_memory(data_mem);
+    free_instruction_memory(&instr_mem);
+    free_decode_cache(&decoded);
+    free_engine_result(&result);
+    free_uarch_state(&warm);
+    return diverged ? EXIT_FAILURE : 0;
 }
@@ -0,0 +1,263 @@
+#include "multihart.h"
+#include "decoder.h"
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+#define BARRIER_SPINS 4096 // Polls before yielding the host CPU
+
+// Start state of the hart threads: they wait for the go signal so a failed
+// pthread_create never leaves the others stuck at a barrier
+#define START_WAIT 0
+#define START_RUN 1
+#define START_ABORT 2
+
+typedef struct {
+    multihart_t *mh;
+    unsigned hart;
+    uint64_t quantum;
+    bool (*tick)(core_t *core);
+    int *start;
+} hart_args_t;
+
+// Set up num_harts cores on a shared data memory and decode cache. Hart i
+// starts at PC 0 with i in a0. Returns 0 on success, -1 on allocation failure.
+int init_multihart(multihart_t *mh, instruction_memory_t *i_mem, decode_cache_t *decoded, data_memory_t *data_mem,
+                   unsigned num_harts) {
+    memset(mh, 0, sizeof(*mh));
+    if (num_harts == 0 || num_harts > MULTIHART_MAX_HARTS)
+        return -1;
+    mh->harts = (core_t **)calloc(num_harts, sizeof(core_t *));
+    mh->instructions = (uint64_t *)calloc(num_harts, sizeof(uint64_t));
+    mh->views = (data_memory_t **)calloc(num_harts, sizeof(data_memory_t *));
+    if (mh->harts == NULL || mh->instructions == NULL || mh->views == NULL)
+        goto fail;
+    mh->num_harts = num_harts;
+    mh->memory = data_mem;
+    for (unsigned i = 0; i < num_harts; i++) {
+        if ((mh->harts[i] = init_core_with_memory(i_mem, data_mem)) == NULL)
+            goto fail;
+        mh->harts[i]->decoded = decoded;
+        mh->harts[i]->reg_file[MULTIHART_HART_ID_REG] = i;
+    }
+    return 0;
+
+fail:
+    free_multihart(mh);
+    return -1;
+}
+
+void free_multihart(multihart_t *mh) {
+    if (mh->harts != NULL) {
+        for (unsigned i = 0; i < mh->num_harts; i++)
+            free_core(mh->harts[i]);
+    }
+    free(mh->harts);
+    free(mh->instructions);
+    free(mh->views);
+    memset(mh, 0, sizeof(*mh));
+}
+
+// Give every hart a fresh fork of the shared memory, or with fork false
+// put them back on the shared memory itself. Returns -1 on allocation
+// failure, leaving the harts on the shared memory.
+static int reset_views(multihart_t *mh, bool fork) {
+    for (unsigned i = 0; i < mh->num_harts; i++) {
+        free_data_memory(mh->views[i]);
+        mh->views[i] = NULL;
+        mh->harts[i]->data_mem = mh->memory;
+    }
+    if (!fork)
+        return 0;
+    for (unsigned i = 0; i < mh->num_harts; i++) {
+        if ((mh->views[i] = fork_data_memory(mh->memory)) == NULL) {
+            reset_views(mh, false);
+            return -1;
+        }
+        mh->harts[i]->data_mem = mh->views[i];
+    }
+    return 0;
+}
+
+// Copy the bytes of page that differ from the shared memory into the same
+// page of merged
+static int merge_page(data_memory_t *merged, const data_memory_t *memory, addr_t addr, const dmem_page_t *page) {
+    const dmem_page_t *old = dmem_lookup(memory, addr);
+    dmem_page_t *dst = dmem_lookup_write(merged, addr);
+    if (dst == NULL && (dst = dmem_alloc_page(merged, addr)) == NULL)
+        return -1;
+    for (size_t b = 0; b < DMEM_PAGE_SIZE; b++) {
+        if (page->bytes[b] != (old != NULL ? old->bytes[b] : 0))
+            dst->bytes[b] = page->bytes[b];
+    }
+    return 0;
+}
+
+// Apply fn to every page a fork has written: its pages not shared with
+// the base. Stops at the first failure and returns -1.
+static int for_each_private_page(data_memory_t *fork, data_memory_t *dst, const data_memory_t *memory,
+                                 int (*fn)(data_memory_t *, const data_memory_t *, addr_t, const dmem_page_t *)) {
+    for (size_t t = 0; t < fork->num_tables; t++) {
+        const dmem_table_t *table = fork->tables[t];
+        if (table == NULL)
+            continue;
+        for (size_t p = 0; p < DMEM_L2_SIZE; p++) {
+            if (table->pages[p] == NULL || ((table->shared[p / 64] >> (p % 64)) & 1))
+                continue;
+            addr_t addr = ((addr_t)t << DMEM_L1_SHIFT) | ((addr_t)p << DMEM_PAGE_SHIFT);
+            if (fn(dst, memory, addr, table->pages[p]) != 0)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+static int copy_page(data_memory_t *memory, const data_memory_t *unused, addr_t addr, const dmem_page_t *page) {
+    (void)unused;
+    dmem_page_t *dst = dmem_alloc_page(memory, addr);
+    if (dst == NULL)
+        return -1;
+    memcpy(dst, page, sizeof(*dst));
+    return 0;
+}
+
+// Publish the stores of a quantum, then fork again for the next one unless
+// the run is over. The changes of each hart are merged in hart-id order
+// into a fork of the shared memory, so every comparison is against the
+// memory as it was at the start of the quantum. The views are released
+// before the merged pages are copied back; the merged fork reads only its
+// own pages, which the shared memory does not hold. Runs on the last hart
+// to reach the barrier while the others wait. Returns -1 on allocation
+// failure.
+static int commit_quantum(multihart_t *mh, bool last) {
+    data_memory_t *merged = fork_data_memory(mh->memory);
+    int status = merged != NULL ? 0 : -1;
+    for (unsigned i = 0; i < mh->num_harts && status == 0; i++)
+        status = for_each_private_page(mh->views[i], merged, mh->memory, merge_page);
+    reset_views(mh, false);
+    if (status == 0)
+        status = for_each_private_page(merged, mh->memory, NULL, copy_page);
+    free_data_memory(merged);
+    if (status == 0 && !last && reset_views(mh, true) != 0)
+        status = -1;
+    return status;
+}
+
+// Arrive at the end of a quantum and wait for the other harts. The last
+// to arrive commits the quantum's stores. Spins briefly, then yields, so
+// oversubscribed hosts still make progress. Returns true once every hart
+// has halted or a commit failed.
+static bool barrier_wait(multihart_t *mh, bool halted) {
+    quantum_barrier_t *b = &mh->barrier;
+    unsigned generation = __atomic_load_n(&b->generation, __ATOMIC_ACQUIRE);
+    if (halted)
+        __atomic_fetch_add(&b->halted, 1, __ATOMIC_RELAXED);
+    if (__atomic_sub_fetch(&b->waiting, 1, __ATOMIC_ACQ_REL) == 0) {
+        b->all_halted = __atomic_load_n(&b->halted, __ATOMIC_RELAXED) == b->harts;
+        if (commit_quantum(mh, b->all_halted) != 0) {
+            mh->failed = true;
+            b->all_halted = true;
+        }
+        b->halted = 0;
+        b->waiting = b->harts;
+        __atomic_store_n(&b->generation, generation + 1, __ATOMIC_RELEASE);
+        return b->all_halted;
+    }
+    for (unsigned spins = 0; __atomic_load_n(&b->generation, __ATOMIC_ACQUIRE) == generation; spins++) {
+        if (spins >= BARRIER_SPINS)
+            sched_yield();
+    }
+    // Not overwritten before this hart arrives at the next barrier
+    return b->all_halted;
+}
+
+static void *hart_main(void *arg) {
+    hart_args_t *args = (hart_args_t *)arg;
+    multihart_t *mh = args->mh;
+    core_t *core = mh->harts[args->hart];
+    core->tick = args->tick;
+
+    int start;
+    while ((start = __atomic_load_n(args->start, __ATOMIC_ACQUIRE)) == START_WAIT)
+        sched_yield();
+    if (start == START_ABORT)
+        return NULL;
+
+    tick_t start_clk = core->clk;
+    bool halted = false;
+    for (;;) {
+        if (!halted) {
+            uint64_t executed = run_instructions(core, args->quantum, NULL);
+            mh->instructions[args->hart] += executed;
+            halted = executed < args->quantum;
+        }
+        if (barrier_wait(mh, halted))
+            break;
+        if (args->hart == 0)
+            mh->quanta++;
+    }
+#if PERF_COUNTERS
+    core->perf.cycles += core->clk - start_clk;
+#else
+    (void)start_clk;
+#endif
+    return NULL;
+}
+
+// Run every hart to completion on its own host thread with the reference
+// or decoded engine. Returns 0 on success, -1 if the engine is not
+// supported, a thread cannot be started or memory runs out. The harts end
+// on the shared memory.
+int run_multihart(multihart_t *mh, engine_t engine, uint64_t quantum) {
+    if ((engine != ENGINE_REFERENCE && engine != ENGINE_DECODED) || quantum == 0)
+        return -1;
+    pthread_t *threads = (pthread_t *)calloc(mh->num_harts, sizeof(pthread_t));
+    hart_args_t *args = (hart_args_t *)calloc(mh->num_harts, sizeof(hart_args_t));
+    if (threads == NULL || args == NULL) {
+        free(threads);
+        free(args);
+        return -1;
+    }
+
+    memset(&mh->barrier, 0, sizeof(mh->barrier));
+    mh->barrier.harts = mh->num_harts;
+    mh->barrier.waiting = mh->num_harts;
+    mh->quanta = 1;
+
+    mh->failed = false;
+    if (reset_views(mh, true) != 0) {
+        free(threads);
+        free(args);
+        return -1;
+    }
+
+    int start = START_WAIT;
+    unsigned started = 0;
+    for (; started < mh->num_harts; started++) {
+        hart_args_t *a = &args[started];
+        a->mh = mh;
+        a->hart = started;
+        a->quantum = quantum;
+        a->tick = (engine == ENGINE_DECODED) ? tick_decoded_func : tick_func;
+        a->start = &start;
+        if (pthread_create(&threads[started], NULL, hart_main, a) != 0)
+            break;
+    }
+    __atomic_store_n(&start, started == mh->num_harts ? START_RUN : START_ABORT, __ATOMIC_RELEASE);
+    for (unsigned i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    reset_views(mh, false);
+
+    free(threads);
+    free(args);
+    return started == mh->num_harts && !mh->failed ? 0 : -1;
+}
+
+// Print each hart's executed instructions and register file
+void print_multihart_state(const multihart_t *mh) {
+    for (unsigned i = 0; i < mh->num_harts; i++) {
+        printf("Hart %u: %llu instructions, PC %llu\n", i, (unsigned long long)mh->instructions[i],
+               (unsigned long long)mh->harts[i]->PC);
+        print_core_state(mh->harts[i]);
+    }
+}
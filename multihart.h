@@ -0,0 +1,48 @@
+#ifndef __MULTIHART_H__
+#define __MULTIHART_H__
+
+#include "engine.h"
+
+#define MULTIHART_MAX_HARTS 64
+#define MULTIHART_DEFAULT_QUANTUM 10000 // Instructions per hart between barriers
+#define MULTIHART_HART_ID_REG 10        // a0 holds the hart id at reset
+
+// Barrier ending each quantum. The last hart to arrive records whether
+// every hart has halted and starts the next generation.
+typedef struct {
+    unsigned harts;
+    unsigned waiting;     // Harts still to arrive in this generation
+    unsigned halted;      // Arrived harts that have halted
+    unsigned generation;
+    bool all_halted;      // Outcome of the last completed generation
+} quantum_barrier_t;
+
+// N harts running one program on a shared data memory. Each hart is a core
+// with its own PC and register file on its own host thread. Harts run
+// `quantum` instructions, then wait for each other at a barrier. During a
+// quantum each hart runs on a private copy-on-write fork of the shared
+// memory, so it sees its own stores at once and no other hart's. The last
+// hart to reach the barrier commits the forks in hart-id order: every byte
+// a hart changed takes that hart's value, so where harts changed the same
+// byte the highest hart id wins. Every hart then sees all stores of the
+// quantum in the next one. Results depend only on the program and the
+// quantum, never on host scheduling.
+typedef struct {
+    core_t **harts;
+    unsigned num_harts;
+    uint64_t *instructions;   // Executed by each hart
+    uint64_t quanta;          // Quanta simulated
+    quantum_barrier_t barrier;
+    data_memory_t *memory;    // Shared memory, written only at barriers
+    data_memory_t **views;    // Each hart's fork of memory for the current quantum
+    bool failed;              // A commit ran out of memory and stopped the run
+} multihart_t;
+
+// Function prototypes
+int init_multihart(multihart_t *mh, instruction_memory_t *i_mem, decode_cache_t *decoded, data_memory_t *data_mem,
+                   unsigned num_harts);
+void free_multihart(multihart_t *mh);
+int run_multihart(multihart_t *mh, engine_t engine, uint64_t quantum);
+void print_multihart_state(const multihart_t *mh);
+
+#endif
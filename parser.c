@@ -1,321 +1,448 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "parser.h"
+#include "program_image.h"
 #include "registers.h"
 #include "instruction.h"
+#include "work_pool.h"
+
+// Operand layouts of the supported mnemonics
+typedef enum {
+    FORMAT_R,       // rd, rs1, rs2
+    FORMAT_I,       // rd, rs1, imm
+    FORMAT_LOAD,    // rd, imm(rs1)
+    FORMAT_RD_ONLY, // rd (jalr: remaining operands are not encoded)
+    FORMAT_SB,      // rs1, rs2, imm
+    FORMAT_S        // rs2, imm(rs1)
+} format_t;
+
+typedef struct {
+    char name[5];
+    uint8_t len;    // 0 for an empty slot
+    uint8_t format; // format_t
+    uint8_t opcode;
+    uint8_t funct3;
+    uint8_t funct7;
+} mnemonic_t;
+
+// Perfect hash of the accepted mnemonics: no two of them share a slot, so
+// a lookup is one hash and one comparison
+#define MNEMONIC_SLOTS 32
+#define MNEMONIC_HASH(s, len) ((2 * (unsigned char)(s)[0] + (unsigned char)(s)[1] + \
+                                (unsigned char)(s)[(len) - 1] + (len)) & (MNEMONIC_SLOTS - 1))
+
+static const mnemonic_t MNEMONICS[MNEMONIC_SLOTS] = {
+    [13] = { "add",  3, FORMAT_R,       51, 0, 0 },
+    [0]  = { "sub",  3, FORMAT_R,       51, 0, 32 },
+    [1]  = { "sll",  3, FORMAT_R,       51, 1, 0 },
+    [7]  = { "srl",  3, FORMAT_R,       51, 5, 0 },
+    [20] = { "xor",  3, FORMAT_R,       51, 4, 0 },
+    [4]  = { "or",   2, FORMAT_R,       51, 6, 0 },
+    [23] = { "and",  3, FORMAT_R,       51, 7, 0 },
+    [19] = { "addi", 4, FORMAT_I,       19, 0, 0 },
+    [31] = { "slli", 4, FORMAT_I,       19, 1, 0 },
+    [8]  = { "lw",   2, FORMAT_LOAD,    3,  2, 0 },
+    [2]  = { "ld",   2, FORMAT_LOAD,    3,  3, 0 },
+    [11] = { "jalr", 4, FORMAT_RD_ONLY, 0,  0, 0 },
+    [29] = { "beq",  3, FORMAT_SB,      99, 0, 0 },
+    [26] = { "bne",  3, FORMAT_SB,      99, 1, 0 },
+    [16] = { "sd",   2, FORMAT_S,       35, 3, 0 },
+};
+
+// Result of assembling one line
+#define LINE_OK      0
+#define LINE_BLANK   1
+#define LINE_UNKNOWN 2
+
+static inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
 
-// Rename your custom getline function to avoid conflict with standard libraries
-ssize_t my_getline(char **lineptr, size_t *n, FILE *stream) {
-    char *bufptr = NULL;
-    char *p = NULL;
-    size_t size;
-    int c;
+static inline bool is_delimiter(char c) {
+    return is_space(c) || c == ',';
+}
 
-    if (lineptr == NULL || n == NULL || stream == NULL) {
-        return -1;
+static const mnemonic_t *lookup_mnemonic(const char *s, size_t len) {
+    if (len < 2 || len > 4)
+        return NULL;
+    const mnemonic_t *m = &MNEMONICS[MNEMONIC_HASH(s, len)];
+    return (m->len == len && memcmp(m->name, s, len) == 0) ? m : NULL;
+}
+
+// Register index straight from the name: x0-x31 are 0-31, f0-f31 are
+// 32-63, and anything else is NUM_OF_REGS (as in REGISTER_NAME)
+int reg_index(const char *reg, size_t len) {
+    if (len < 2 || len > 3 || (reg[0] != 'x' && reg[0] != 'f'))
+        return NUM_OF_REGS;
+    if (reg[1] < '0' || reg[1] > '9' || (len == 3 && (reg[1] == '0' || reg[2] < '0' || reg[2] > '9')))
+        return NUM_OF_REGS;
+
+    int n = reg[1] - '0';
+    if (len == 3)
+        n = n * 10 + (reg[2] - '0');
+    if (n >= 32)
+        return NUM_OF_REGS;
+    return reg[0] == 'x' ? n : 32 + n;
+}
+
+// Parse a register operand, skipping leading delimiters. The name ends at
+// a delimiter or parenthesis.
+static unsigned parse_reg(const char **p, const char *end) {
+    const char *s = *p;
+    while (s < end && is_delimiter(*s))
+        s++;
+    const char *start = s;
+    while (s < end && !is_delimiter(*s) && *s != '(' && *s != ')')
+        s++;
+    *p = s;
+    return (unsigned)reg_index(start, s - start);
+}
+
+// Parse an immediate like atoi: optional sign and decimal digits, 0 when absent
+static int parse_imm(const char **p, const char *end) {
+    const char *s = *p;
+    while (s < end && is_delimiter(*s))
+        s++;
+    int sign = 1;
+    if (s < end && (*s == '-' || *s == '+')) {
+        if (*s == '-')
+            sign = -1;
+        s++;
     }
+    int value = 0;
+    while (s < end && *s >= '0' && *s <= '9')
+        value = value * 10 + (*s++ - '0');
+    *p = s;
+    return sign * value;
+}
 
-    bufptr = *lineptr;
-    size = *n;
+// Parse "imm(rs1)" of loads and stores
+static unsigned parse_offset_base(const char **p, const char *end, int *imm) {
+    *imm = parse_imm(p, end);
+    const char *s = *p;
+    while (s < end && *s != '(')
+        s++;
+    if (s < end)
+        s++;
+    *p = s;
+    return parse_reg(p, end);
+}
 
-    c = fgetc(stream);
-    if (c == EOF) {
-        return -1;
+// Assemble the line [p, end) into an instruction word
+static int assemble_line(const char *p, const char *end, unsigned *word) {
+    *word = 0;
+    while (p < end && is_space(*p))
+        p++;
+    if (p == end)
+        return LINE_BLANK;
+
+    const char *name = p;
+    while (p < end && !is_space(*p))
+        p++;
+    const mnemonic_t *m = lookup_mnemonic(name, p - name);
+    if (m == NULL)
+        return LINE_UNKNOWN;
+
+    unsigned w = m->opcode | (m->funct3 << 12);
+    int imm;
+    unsigned u; // Immediate bits
+    switch (m->format) {
+    case FORMAT_R: {
+        unsigned rd = parse_reg(&p, end);
+        unsigned rs1 = parse_reg(&p, end);
+        unsigned rs2 = parse_reg(&p, end);
+        w |= (rd << 7) | (rs1 << 15) | (rs2 << 20) | ((unsigned)m->funct7 << 25);
+        break;
     }
-    if (bufptr == NULL) {
-        bufptr = malloc(128);
-        if (bufptr == NULL) {
-            return -1;
-        }
-        size = 128;
+    case FORMAT_I: {
+        unsigned rd = parse_reg(&p, end);
+        unsigned rs1 = parse_reg(&p, end);
+        u = (unsigned)parse_imm(&p, end);
+        w |= (rd << 7) | (rs1 << 15) | ((u & 0xFFF) << 20);
+        break;
+    }
+    case FORMAT_LOAD: {
+        unsigned rd = parse_reg(&p, end);
+        unsigned rs1 = parse_offset_base(&p, end, &imm);
+        u = (unsigned)imm;
+        w |= (rd << 7) | (rs1 << 15) | ((u & 0xFFF) << 20);
+        break;
+    }
+    case FORMAT_RD_ONLY:
+        w |= parse_reg(&p, end) << 7;
+        break;
+    case FORMAT_SB: {
+        unsigned rs1 = parse_reg(&p, end);
+        unsigned rs2 = parse_reg(&p, end);
+        u = (unsigned)parse_imm(&p, end);
+        w |= (((u >> 12) & 0x1) << 31);     // imm[12]
+        w |= (((u >> 11) & 0x1) << 7);      // imm[11]
+        w |= (((u >> 5) & 0x3F) << 25);     // imm[10:5]
+        w |= ((u & 0xF) << 8);              // imm[4:1]
+        w |= (rs2 << 20) | (rs1 << 15);
+        break;
+    }
+    case FORMAT_S: {
+        unsigned rs2 = parse_reg(&p, end);
+        unsigned rs1 = parse_offset_base(&p, end, &imm);
+        u = (unsigned)imm;
+        w |= ((u & 0x1F) << 7);             // imm[4:0]
+        w |= (((u >> 5) & 0x7F) << 25);     // imm[11:5]
+        w |= (rs2 << 20) | (rs1 << 15);
+        break;
     }
-    p = bufptr;
-    while (c != EOF) {
-        if ((p - bufptr) > (size - 1)) {
-            size_t new_size = size + 128;
-            char *new_bufptr = realloc(bufptr, new_size);
-            if (new_bufptr == NULL) {
-                free(bufptr);  // Free original buffer on failure
-                return -1;
-            }
-            p = new_bufptr + (p - bufptr);  // Update p after realloc
-            bufptr = new_bufptr;
-            size = new_size;
-        }
-        *p++ = c;
-        if (c == '\n') {
-            break;
-        }
-        c = fgetc(stream);
     }
-    *p = '\0';  // Null-terminate the string
-    *lineptr = bufptr;
-    *n = size;
 
-    return p - bufptr;
+    *word = w;
+    return LINE_OK;
 }
 
-void load_instructions(instruction_memory_t *i_mem, const char *trace) {
-    printf("Loading trace file: %s\n", trace);
+// Number of lines in a buffer, counting a final line without a newline
+size_t count_lines(const char *text, size_t size) {
+    size_t lines = 0;
+    const char *p = text;
+    const char *end = text + size;
+    while (p < end && (p = memchr(p, '\n', end - p)) != NULL) {
+        lines++;
+        p++;
+    }
+    if (size > 0 && text[size - 1] != '\n')
+        lines++;
+    return lines;
+}
 
-    FILE *fd = fopen(trace, "r");
-    if (fd == NULL) {
-        perror("Cannot open trace file.\n");
-        exit(EXIT_FAILURE);
+// Assemble the lines of [text, text + size) into instr[0..], one slot per
+// line so branch offsets count lines. Unknown and blank lines become
+// all-zero words, which execute as nops. Returns the number of slots up to
+// and including the last valid instruction.
+size_t assemble_lines(const char *text, size_t size, instruction_t *instr, unsigned *num_unknown) {
+    const char *p = text;
+    const char *end = text + size;
+    size_t index = 0;
+    size_t last = 0;
+
+    while (p < end) {
+        const char *eol = memchr(p, '\n', end - p);
+        if (eol == NULL)
+            eol = end;
+
+        int result = assemble_line(p, eol, &instr[index].instruction);
+        index++;
+        if (result == LINE_OK)
+            last = index;
+        else if (result == LINE_UNKNOWN)
+            (*num_unknown)++;
+        p = eol + 1;
     }
+    return last;
+}
 
-    char *line = NULL;
-    size_t len = 0;
-    ssize_t read;
-    addr_t PC = 0;
-    int IMEM_index = 0;
-
-    while ((read = my_getline(&line, &len, fd)) != -1) {
-        if (read == -1) {
-            perror("Error reading trace file.\n");
-            free(line);
-            fclose(fd);
-            exit(EXIT_FAILURE);
-        }
+// Assemble trace text held in memory. The text is only read, never copied
+// or modified.
+int assemble_buffer(instruction_memory_t *i_mem, const char *text, size_t size) {
+    init_instruction_memory(i_mem);
 
-        i_mem->instructions[IMEM_index].addr = PC;
-        char *raw_instr = strtok(line, " ");
-        if (raw_instr == NULL) {
-            continue; // Skip empty lines or invalid instructions
-        }
+    size_t lines = count_lines(text, size);
+    if (lines == 0)
+        return LOAD_OK;
 
-        // Parse different instruction types
-        if (strcmp(raw_instr, "add") == 0 || strcmp(raw_instr, "sub") == 0 ||
-            strcmp(raw_instr, "sll") == 0 || strcmp(raw_instr, "srl") == 0 ||
-            strcmp(raw_instr, "xor") == 0 || strcmp(raw_instr, "or") == 0 ||
-            strcmp(raw_instr, "and") == 0) {
-            parse_R_type(raw_instr, &(i_mem->instructions[IMEM_index]));
-            i_mem->last = &(i_mem->instructions[IMEM_index]);
-        } else if (strcmp(raw_instr, "addi") == 0 || strcmp(raw_instr, "lw") == 0 ||
-                   strcmp(raw_instr, "jalr") == 0 || strcmp(raw_instr, "slli") == 0 ||
-                   strcmp(raw_instr, "ld") == 0) {
-            parse_I_type(raw_instr, &(i_mem->instructions[IMEM_index]));
-            i_mem->last = &(i_mem->instructions[IMEM_index]);
-        } else if (strcmp(raw_instr, "beq") == 0 || strcmp(raw_instr, "bne") == 0) {
-            parse_SB_type(raw_instr, &(i_mem->instructions[IMEM_index]));
-            i_mem->last = &(i_mem->instructions[IMEM_index]);
-        } else if (strcmp(raw_instr, "sd") == 0) {
-            parse_S_type(raw_instr, &(i_mem->instructions[IMEM_index]));
-            i_mem->last = &(i_mem->instructions[IMEM_index]);
-        } else {
-            printf("Unknown instruction: %s\n", raw_instr);
-        }
-
-        IMEM_index++;
-        PC += 4;
-    }
+    i_mem->instructions = (instruction_t *)malloc(lines * sizeof(instruction_t));
+    if (i_mem->instructions == NULL)
+        return LOAD_ERR_NOMEM;
+    i_mem->capacity = lines;
 
-    free(line);  // Free allocated memory for line
-    fclose(fd);
+    size_t last = assemble_lines(text, size, i_mem->instructions, &i_mem->num_unknown);
+    imem_shrink_to_fit(i_mem, last); // Trailing unknown lines are never executed
+    return LOAD_OK;
 }
 
+// One newline-aligned piece of the trace for parallel assembly
+typedef struct {
+    const char *text;
+    size_t size;
+    size_t first;         // Index of the chunk's first line in instruction memory
+    size_t lines;
+    size_t last;          // Slots up to the last valid instruction, relative to first
+    unsigned num_unknown;
+} assembly_chunk_t;
+
+typedef struct {
+    assembly_chunk_t *chunks;
+    instruction_t *instructions;
+} parallel_assembly_t;
+
+static void count_chunk(size_t job, unsigned worker, void *ctx) {
+    assembly_chunk_t *chunk = &((parallel_assembly_t *)ctx)->chunks[job];
+    (void)worker;
+    chunk->lines = count_lines(chunk->text, chunk->size);
+}
 
-void parse_R_type(char *opr, instruction_t *instr) {
-    instr->instruction = 0;
-    unsigned opcode = 51;
-    unsigned funct3 = 0;
-    unsigned funct7 = 0;
-
-    if (strcmp(opr, "add") == 0) {
-        funct3 = 0;
-        funct7 = 0;
-    } else if (strcmp(opr, "sub") == 0) {
-        funct3 = 0;
-        funct7 = 32;
-    } else if (strcmp(opr, "and") == 0) {
-        funct3 = 7;
-        funct7 = 0;
-    } else if (strcmp(opr, "or") == 0) {
-        funct3 = 6;
-        funct7 = 0;
-    } else if (strcmp(opr, "xor") == 0) {
-        funct3 = 4;
-        funct7 = 0;
-    } else if (strcmp(opr, "sll") == 0) {
-        funct3 = 1;
-        funct7 = 0;
-    } else if (strcmp(opr, "srl") == 0) {
-        funct3 = 5;
-        funct7 = 0;
-    } else if (strcmp(opr, "sltu") == 0) {
-        funct3 = 3;
-        funct7 = 0;
-    } else if (strcmp(opr, "sra") == 0) {
-        funct3 = 5;
-        funct7 = 32;
-    }
-    
-    char *reg = strtok(NULL, ", ");
-    unsigned rd = reg_index(reg);
-
-    reg = strtok(NULL, ", ");
-    unsigned rs_1 = reg_index(reg);
-
-    reg = strtok(NULL, ", ");
-    reg[strlen(reg) - 1] = '\0';
-    unsigned rs_2 = reg_index(reg);
-
-    // Construct instruction
-    instr->instruction |= opcode;
-    instr->instruction |= (rd << 7);
-    instr->instruction |= (funct3 << (7 + 5));
-    instr->instruction |= (rs_1 << (7 + 5 + 3));
-    instr->instruction |= (rs_2 << (7 + 5 + 3 + 5));
-    instr->instruction |= (funct7 << (7 + 5 + 3 + 5 + 5));
+static void assemble_chunk(size_t job, unsigned worker, void *ctx) {
+    parallel_assembly_t *assembly = (parallel_assembly_t *)ctx;
+    assembly_chunk_t *chunk = &assembly->chunks[job];
+    (void)worker;
+    chunk->num_unknown = 0;
+    chunk->last = assemble_lines(chunk->text, chunk->size,
+                                 assembly->instructions + chunk->first, &chunk->num_unknown);
 }
 
-void parse_I_type(char *opr, instruction_t *instr) {
-    instr->instruction = 0;
-    unsigned opcode = 0;
-    unsigned funct3 = 0;
-    int imm = 0;  // Immediate value as a signed integer
-
-    if (strcmp(opr, "lb") == 0) {
-        funct3 = 0;
-        opcode = 3;
-    } else if (strcmp(opr, "lh") == 0) {
-        funct3 = 1;
-        opcode = 3;
-    } else if (strcmp(opr, "lw") == 0) {
-        funct3 = 2;
-        opcode = 3;
-    } else if (strcmp(opr, "ld") == 0) {
-        funct3 = 3;
-        opcode = 3;
-    } else if (strcmp(opr, "lbu") == 0) {
-        funct3 = 4;
-        opcode = 3;
-    } else if (strcmp(opr, "lhu") == 0) {
-        funct3 = 5;
-        opcode = 3;
-    } else if (strcmp(opr, "lwu") == 0) {
-        funct3 = 6;
-        opcode = 3;
-    } else if (strcmp(opr, "addi") == 0) {
-        funct3 = 0;
-        opcode = 19;
-    } else if (strcmp(opr, "slli") == 0) {
-        funct3 = 1;
-        opcode = 19;
+// Assemble trace text on num_threads threads (0 for one per CPU). The text
+// is cut into one chunk per thread at newline boundaries; the chunks count
+// their lines in parallel, a prefix sum gives each chunk its first
+// instruction index, and each chunk then encodes its lines directly into
+// its slice of instruction memory. Small inputs are assembled serially.
+int assemble_buffer_parallel(instruction_memory_t *i_mem, const char *text, size_t size, unsigned num_threads) {
+    if (num_threads == 0)
+        num_threads = default_num_threads();
+    if (num_threads <= 1 || size < PARALLEL_ASSEMBLY_MIN_BYTES)
+        return assemble_buffer(i_mem, text, size);
+
+    init_instruction_memory(i_mem);
+    parallel_assembly_t assembly = { NULL, NULL };
+    assembly.chunks = (assembly_chunk_t *)calloc(num_threads, sizeof(assembly_chunk_t));
+    if (assembly.chunks == NULL)
+        return LOAD_ERR_NOMEM;
+
+    // Split at the first newline after each 1/num_threads boundary
+    size_t num_chunks = 0;
+    const char *p = text;
+    const char *end = text + size;
+    for (unsigned i = 1; i <= num_threads && p < end; i++) {
+        const char *cut = (i == num_threads) ? end : text + size / num_threads * i;
+        if (cut < p)
+            cut = p;
+        const char *eol = (cut < end) ? memchr(cut, '\n', end - cut) : NULL;
+        cut = eol ? eol + 1 : end;
+        assembly.chunks[num_chunks].text = p;
+        assembly.chunks[num_chunks].size = cut - p;
+        num_chunks++;
+        p = cut;
     }
 
-    char *reg = strtok(NULL, ", ");
-    unsigned rd = reg_index(reg);
+    run_work_pool(num_chunks, num_threads, count_chunk, &assembly);
 
-    if (opcode == 3) {  // Load-type instructions
-        char *imm_str = strtok(NULL, "(");
-        imm = atoi(imm_str);  // Get the immediate (offset) value
+    size_t lines = 0;
+    for (size_t i = 0; i < num_chunks; i++) {
+        assembly.chunks[i].first = lines;
+        lines += assembly.chunks[i].lines;
+    }
 
-        reg = strtok(NULL, ")");
-        unsigned rs_1 = reg_index(reg);  // Get the source register (rs1)
+    int status = LOAD_OK;
+    if (lines > 0) {
+        assembly.instructions = (instruction_t *)malloc(lines * sizeof(instruction_t));
+        if (assembly.instructions == NULL) {
+            status = LOAD_ERR_NOMEM;
+        } else {
+            i_mem->instructions = assembly.instructions;
+            i_mem->capacity = lines;
+            run_work_pool(num_chunks, num_threads, assemble_chunk, &assembly);
+
+            size_t last = 0;
+            for (size_t i = 0; i < num_chunks; i++) {
+                const assembly_chunk_t *chunk = &assembly.chunks[i];
+                if (chunk->last > 0)
+                    last = chunk->first + chunk->last;
+                i_mem->num_unknown += chunk->num_unknown;
+            }
+            imem_shrink_to_fit(i_mem, last); // Trailing unknown lines are never executed
+        }
+    }
 
-        instr->instruction |= (imm & 0xFFF) << 20;  // imm[11:0] -> bits [31:20]
-        instr->instruction |= (rs_1 << 15);         // rs1 -> bits [19:15]
-    } else if (opcode == 19) {  // Arithmetic-type instructions
-        reg = strtok(NULL, ", ");
-        unsigned rs_1 = reg_index(reg);  // Get the source register (rs1)
+    free(assembly.chunks);
+    return status;
+}
 
-        reg = strtok(NULL, ", ");
-        imm = atoi(reg);  // Get the immediate value
+// Map a whole trace file read-only. An empty file maps to NULL with size 0.
+static int map_trace(const char *trace, const char **text, size_t *size) {
+    int fd = open(trace, O_RDONLY);
+    if (fd < 0)
+        return LOAD_ERR_OPEN;
 
-        instr->instruction |= (imm & 0xFFF) << 20;  // imm[11:0] -> bits [31:20]
-        instr->instruction |= (rs_1 << 15);         // rs1 -> bits [19:15]
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return LOAD_ERR_OPEN;
     }
 
-    instr->instruction |= (funct3 << 12);     // funct3 -> bits [14:12]
-    instr->instruction |= (rd << 7);          // rd -> bits [11:7]
-    instr->instruction |= opcode;             // opcode -> bits [6:0]
+    *text = NULL;
+    *size = (size_t)st.st_size;
+    if (*size > 0) {
+        void *map = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            close(fd);
+            return LOAD_ERR_OPEN;
+        }
+        *text = (const char *)map;
+    }
+    close(fd);
+    return LOAD_OK;
 }
 
-void parse_SB_type(char *opr, instruction_t *instr) {
-    instr->instruction = 0;
-    unsigned opcode = 99;
-    unsigned funct3 = 0;
-
-    if (strcmp(opr, "beq") == 0) {
-        funct3 = 0;
-    } else if (strcmp(opr, "bne") == 0) {
-        funct3 = 1;
-    } else if (strcmp(opr, "blt") == 0) {
-        funct3 = 4;
-    } else if (strcmp(opr, "bge") == 0) {
-        funct3 = 5;
-    } else if (strcmp(opr, "bltu") == 0) {
-        funct3 = 6;
-    } else if (strcmp(opr, "bgeu") == 0) {
-        funct3 = 7;
-    }
+static void unmap_trace(const char *text, size_t size) {
+    if (text != NULL)
+        munmap((void *)text, size);
+}
 
-    char *reg = strtok(NULL, ", ");
-    unsigned rs1 = reg_index(reg);
-    reg = strtok(NULL, ", ");
-    unsigned rs2 = reg_index(reg);
-    int imm = atoi(strtok(NULL, ", "));
-
-    unsigned imm12 = (imm >> 12) & 0x1;
-    unsigned imm11 = (imm >> 11) & 0x1;
-    unsigned imm10_5 = (imm >> 5) & 0x3F;
-    unsigned imm4_1 = imm & 0xF;
-
-    instr->instruction |= (imm12 << 31);        // imm[12]
-    instr->instruction |= (imm11 << 7);         // imm[11]
-    instr->instruction |= (imm10_5 << 25);      // imm[10:5]
-    instr->instruction |= (imm4_1 << 8);        // imm[4:1]
-    instr->instruction |= rs2 << 20;            // rs2
-    instr->instruction |= rs1 << 15;            // rs1
-    instr->instruction |= funct3 << 12;         // funct3
-    instr->instruction |= opcode;               // opcode
+// Load a trace into instruction memory. When a program image built from
+// the same trace text exists next to it, the image is mapped instead of
+// re-assembling; otherwise the text is assembled and an image is written
+// for the next run (best effort, e.g. not in read-only directories).
+// Reentrant: all state is local, and errors are returned instead of
+// terminating.
+int load_instructions(instruction_memory_t *i_mem, const char *trace) {
+    return load_instructions_parallel(i_mem, trace, 1);
 }
 
-void parse_S_type(char *opr, instruction_t *instr) {
-    instr->instruction = 0;
-    unsigned opcode = 35;
-    unsigned funct3 = 0;
-
-    if (strcmp(opr, "sd") == 0) {
-        funct3 = 3;
-    } else if (strcmp(opr, "sw") == 0) {
-        funct3 = 2;
-    } else if (strcmp(opr, "sh") == 0) {
-        funct3 = 1;
-    } else if (strcmp(opr, "sb") == 0) {
-        funct3 = 0;
-    }
+// load_instructions, assembling on num_threads threads (0 for one per CPU)
+int load_instructions_parallel(instruction_memory_t *i_mem, const char *trace, unsigned num_threads) {
+    const char *text;
+    size_t size;
 
-    char *reg = strtok(NULL, ", ");
-    unsigned rs2 = reg_index(reg);
+    init_instruction_memory(i_mem);
+    int status = map_trace(trace, &text, &size);
+    if (status != LOAD_OK)
+        return status;
 
-    char *imm_str = strtok(NULL, "(");
-    int imm = atoi(imm_str);  // Get the immediate (offset) value
+    uint64_t source_hash = hash_source(text, size);
+    if (load_image(i_mem, trace, size, source_hash) != 0) {
+        status = assemble_buffer_parallel(i_mem, text, size, num_threads);
+        if (status == LOAD_OK)
+            save_image(i_mem, trace, size, source_hash);
+    }
+
+    unmap_trace(text, size);
+    return status;
+}
 
-    reg = strtok(NULL, ")");
-    unsigned rs1 = reg_index(reg);  // Get the source register (rs1)
+// Assemble a trace file on num_threads threads (0 for one per CPU) without
+// consulting or writing its program image
+int assemble_trace(instruction_memory_t *i_mem, const char *trace, unsigned num_threads) {
+    const char *text;
+    size_t size;
 
-    unsigned imm4_0 = imm & 0x1F;  // imm[4:0]
-    unsigned imm11_5 = (imm >> 5) & 0x7F;  // imm[11:5]
+    init_instruction_memory(i_mem);
+    int status = map_trace(trace, &text, &size);
+    if (status != LOAD_OK)
+        return status;
 
-    instr->instruction |= (imm11_5 << 25);  // imm[11:5] -> bits [31:25]
-    instr->instruction |= (rs2 << 20);      // rs2 -> bits [24:20]
-    instr->instruction |= (rs1 << 15);      // rs1 -> bits [19:15]
-    instr->instruction |= (funct3 << 12);   // funct3 -> bits [14:12]
-    instr->instruction |= (imm4_0 << 7);    // imm[4:0] -> bits [11:7]
-    instr->instruction |= opcode;           // opcode -> bits [6:0]
+    status = assemble_buffer_parallel(i_mem, text, size, num_threads);
+    unmap_trace(text, size);
+    return status;
 }
 
-
-int reg_index(char *reg)
-{
-    unsigned i = 0;
-    for (i; i < NUM_OF_REGS; i++) {
-        if (strcmp(REGISTER_NAME[i], reg) == 0)
-            break;
+const char *load_error_string(int status) {
+    switch (status) {
+    case LOAD_OK:       return "ok";
+    case LOAD_ERR_OPEN: return "cannot open trace file";
+    case LOAD_ERR_NOMEM: return "out of memory";
     }
-
-    return i;
+    return "unknown error";
 }
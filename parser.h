@@ -1,4 +1,3 @@
-#include <sys/types.h>
 #ifndef PARSER_H
 #define PARSER_H
 
@@ -7,19 +6,26 @@
 #include <stdlib.h>
 #include <string.h>
 
-// The GNU_SOURCE macro is already defined in the source file where you use the custom getline.
-// It should be defined before including any standard headers, if needed.
-#define _GNU_SOURCE
-
 #include "instruction_memory.h"
 #include "registers.h"
 
+// Return codes of load_instructions
+#define LOAD_OK        0
+#define LOAD_ERR_OPEN -1 // Trace file could not be opened
+#define LOAD_ERR_NOMEM -2 // Instruction memory could not grow
+
+// Traces smaller than this are assembled on one thread
+#define PARALLEL_ASSEMBLY_MIN_BYTES (1 << 20)
+
 // Function prototypes
-void load_instructions(instruction_memory_t *i_mem, const char *trace);
-void parse_R_type(char *opr, instruction_t *instr);
-void parse_I_type(char *opr, instruction_t *instr);
-void parse_SB_type(char *opr, instruction_t *instr);
-void parse_S_type(char *opr, instruction_t *instr);
-int reg_index(char *reg);
+int load_instructions(instruction_memory_t *i_mem, const char *trace);
+int load_instructions_parallel(instruction_memory_t *i_mem, const char *trace, unsigned num_threads);
+int assemble_trace(instruction_memory_t *i_mem, const char *trace, unsigned num_threads);
+int assemble_buffer(instruction_memory_t *i_mem, const char *text, size_t size);
+int assemble_buffer_parallel(instruction_memory_t *i_mem, const char *text, size_t size, unsigned num_threads);
+size_t count_lines(const char *text, size_t size);
+size_t assemble_lines(const char *text, size_t size, instruction_t *instr, unsigned *num_unknown);
+const char *load_error_string(int status);
+int reg_index(const char *reg, size_t len);
 
 #endif // PARSER_H
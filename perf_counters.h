@@ -0,0 +1,82 @@
+#ifndef __PERF_COUNTERS_H__
+#define __PERF_COUNTERS_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "decoded_instruction.h"
+
+// Counter collection is compiled in unless built with -DPERF_COUNTERS=0,
+// in which case every counting call compiles to nothing
+#ifndef PERF_COUNTERS
+#define PERF_COUNTERS 1
+#endif
+
+// Opcode classes of retired instructions
+typedef enum {
+    OPCLASS_R,      // Register-register ALU
+    OPCLASS_I,      // Register-immediate ALU
+    OPCLASS_LOAD,
+    OPCLASS_STORE,
+    OPCLASS_BRANCH,
+    OPCLASS_OTHER,  // No architectural effect (unknown opcodes)
+    NUM_OPCLASSES
+} opclass_t;
+
+// Hardware performance counters of a core
+typedef struct {
+    uint64_t retired[NUM_OPCLASSES];
+    uint64_t branches_taken;
+    uint64_t branches_not_taken;
+    uint64_t loads;
+    uint64_t stores;
+    uint64_t bytes_loaded;
+    uint64_t bytes_stored;
+    uint64_t cycles;
+} perf_counters_t;
+
+// Bytes moved by a load or store of width funct3
+#define ACCESS_BYTES(funct3) (1u << ((funct3) & 3))
+
+static inline opclass_t uop_opclass(unsigned uop) {
+    switch (uop) {
+    case UOP_ADD: case UOP_SUB: case UOP_AND: case UOP_OR: case UOP_SLL:
+        return OPCLASS_R;
+    case UOP_ADDI: case UOP_SUBI: case UOP_ANDI: case UOP_ORI: case UOP_SLLI:
+        return OPCLASS_I;
+    case UOP_LD:
+        return OPCLASS_LOAD;
+    case UOP_SD:
+        return OPCLASS_STORE;
+    case UOP_BEQ:
+        return OPCLASS_BRANCH;
+    default:
+        return OPCLASS_OTHER;
+    }
+}
+
+// Count one retired instruction. funct3 matters for loads and stores,
+// taken for branches. With a constant class this folds to the one or two
+// increments that class needs.
+static inline void perf_count(perf_counters_t *perf, opclass_t class, unsigned funct3, bool taken) {
+#if PERF_COUNTERS
+    perf->retired[class]++;
+    if (class == OPCLASS_LOAD) {
+        perf->loads++;
+        perf->bytes_loaded += ACCESS_BYTES(funct3);
+    } else if (class == OPCLASS_STORE) {
+        perf->stores++;
+        perf->bytes_stored += ACCESS_BYTES(funct3);
+    } else if (class == OPCLASS_BRANCH) {
+        perf->branches_taken += taken;
+        perf->branches_not_taken += !taken;
+    }
+#else
+    (void)perf;
+    (void)class;
+    (void)funct3;
+    (void)taken;
+#endif
+}
+
+#endif
@@ -0,0 +1,283 @@
+#include "pipeline.h"
+#include <string.h>
+
+// Branches resolve in EX, so a mispredicted branch squashes the instructions in IF and ID
+#define BRANCH_PENALTY 2
+
+void default_pipeline_config(pipeline_config_t *config) {
+    default_bp_config(&config->predictor);
+}
+
+// Reset the pipeline around a core. A NULL config selects the defaults.
+// Returns 0 on success, -1 if the configuration is invalid or allocation fails.
+int init_pipeline(pipeline_t *pipe, const core_t *core, const pipeline_config_t *config) {
+    pipeline_config_t defaults;
+    if (config == NULL) {
+        default_pipeline_config(&defaults);
+        config = &defaults;
+    }
+    memset(pipe, 0, sizeof(*pipe));
+    return init_branch_predictor(&pipe->predictor, &config->predictor, core->instr_mem->size);
+}
+
+void free_pipeline(pipeline_t *pipe) {
+    free_branch_predictor(&pipe->predictor);
+}
+
+// Whether an instruction reads rs2 (R-type, sd and beq)
+static bool uses_rs2(const control_signals_t *signals) {
+    return !signals->ALUSrc || signals->MemWrite;
+}
+
+// Load-use hazard: the instruction in ID needs a value the load in EX has not read yet
+static bool load_use_hazard(const pipeline_t *pipe) {
+    if (!pipe->if_id.valid || !pipe->id_ex.valid || !pipe->id_ex.signals.MemRead)
+        return false;
+
+    unsigned instruction = pipe->if_id.instruction;
+    control_signals_t signals;
+    control_unit(instruction & 0x7F, &signals);
+
+    uint8_t rs1 = (instruction >> 15) & 0x1F;
+    uint8_t rs2 = (instruction >> 20) & 0x1F;
+    return pipe->id_ex.rd == rs1 || (uses_rs2(&signals) && pipe->id_ex.rd == rs2);
+}
+
+// Forwarding unit: newest value of a source register from EX/MEM or MEM/WB.
+// x0 is writable in this datapath, so it is forwarded like any other register.
+static signal_t forward(const pipeline_t *pipe, uint8_t rs, signal_t reg_val) {
+    const ex_mem_latch_t *ex_mem = &pipe->ex_mem;
+    const mem_wb_latch_t *mem_wb = &pipe->mem_wb;
+
+    if (ex_mem->valid && ex_mem->signals.RegWrite && !ex_mem->signals.MemtoReg && ex_mem->rd == rs)
+        return ex_mem->ALU_result;
+    if (mem_wb->valid && mem_wb->signals.RegWrite && mem_wb->rd == rs)
+        return MUX(mem_wb->signals.MemtoReg, mem_wb->ALU_result, mem_wb->mem_data);
+    return reg_val;
+}
+
+// A redirect abandons the wait for a fill on the old path
+static void cancel_fetch(pipeline_t *pipe) {
+    pipe->fetch_wait = 0;
+    pipe->fetch_filled = false;
+}
+
+// Advance the pipeline by one clock cycle. Stages are evaluated from WB back
+// to IF so each one reads the latch contents of the previous cycle, and WB
+// writes the register file before ID reads it. Returns false once the
+// pipeline has drained and fetch has left the program.
+bool pipeline_cycle(core_t *core, pipeline_t *pipe) {
+    if_id_latch_t if_id = {0};
+    id_ex_latch_t id_ex = {0};
+    ex_mem_latch_t ex_mem = {0};
+    mem_wb_latch_t mem_wb = {0};
+
+    // WB
+    if (pipe->mem_wb.valid) {
+        const mem_wb_latch_t *wb = &pipe->mem_wb;
+        if (wb->signals.RegWrite)
+            core->reg_file[wb->rd] = MUX(wb->signals.MemtoReg, wb->ALU_result, wb->mem_data);
+        pipe->stats.retired++;
+        // Each instruction is charged the cycles since the previous one
+        // retired, so stalls and flushes land on the instruction they delay
+        if (core->profile != NULL) {
+            profile_charge(core->profile, wb->PC, pipe->stats.cycles + 1 - pipe->last_retire);
+            pipe->last_retire = pipe->stats.cycles + 1;
+        }
+        if (core_logs_commits(core))
+            log_commit(core, core->clk + 1, wb->PC, wb->instruction, commit_flags(&wb->signals),
+                       wb->ALU_result, wb->rs2_val);
+    }
+
+    // MEM
+    unsigned mem_latency = 0;
+    if (pipe->ex_mem.valid) {
+        const ex_mem_latch_t *mem = &pipe->ex_mem;
+        unsigned funct3 = (mem->instruction >> 12) & 0x7;
+        if (core->dcache != NULL && (mem->signals.MemWrite || mem->signals.MemtoReg))
+            mem_latency = cache_access(core->dcache, mem->ALU_result & core->data_mem->addr_mask,
+                                       mem->signals.MemWrite);
+        if (mem->signals.MemWrite)
+            dmem_write(core->data_mem, mem->ALU_result, mem->rs2_val, funct3);
+        mem_wb.valid = true;
+        mem_wb.PC = mem->PC;
+        mem_wb.instruction = mem->instruction;
+        mem_wb.signals = mem->signals;
+        mem_wb.ALU_result = mem->ALU_result;
+        mem_wb.mem_data = mem->signals.MemtoReg ? dmem_read(core->data_mem, mem->ALU_result, funct3) : 0;
+        mem_wb.rs2_val = mem->rs2_val;
+        mem_wb.rd = mem->rd;
+    }
+
+    // EX
+    bool redirect = false;
+    addr_t target = 0;
+    if (pipe->id_ex.valid) {
+        const id_ex_latch_t *ex = &pipe->id_ex;
+        signal_t rs1_val = forward(pipe, ex->rs1, ex->rs1_val);
+        signal_t rs2_val = forward(pipe, ex->rs2, ex->rs2_val);
+        signal_t ALU_result, zero;
+        ALU(rs1_val, MUX(ex->signals.ALUSrc, rs2_val, ex->imm), ex->ALU_ctrl, &ALU_result, &zero);
+
+        // Nothing squashes an instruction once it reaches EX, so it is counted here
+        perf_count(&core->perf, classify_signals(&ex->signals), (ex->instruction >> 12) & 0x7,
+                   ex->signals.Branch && zero);
+        if (core->profile != NULL)
+            profile_execute(core->profile, ex->PC, ex->signals.Branch && zero);
+
+        ex_mem.valid = true;
+        ex_mem.PC = ex->PC;
+        ex_mem.instruction = ex->instruction;
+        ex_mem.signals = ex->signals;
+        ex_mem.ALU_result = ALU_result;
+        ex_mem.rs2_val = rs2_val;
+        ex_mem.rd = ex->rd;
+
+        // Resolve the branch and check the path fetch followed
+        if (ex->signals.Branch) {
+            addr_t branch_target = ex->PC + ShiftLeft1(ex->imm);
+            addr_t next_PC = zero ? branch_target : ex->PC + 4;
+            bool mispredicted = next_PC != ex->predicted_PC;
+            bp_update(&pipe->predictor, ex->PC, ex->history, zero, branch_target, mispredicted);
+            pipe->stats.branches++;
+            if (mispredicted) {
+                pipe->stats.mispredictions++;
+                redirect = true;
+                target = next_PC;
+            }
+        }
+    }
+
+    // Hazard detection unit
+    bool stall = load_use_hazard(pipe);
+
+    // ID
+    bool predict_taken = false;
+    if (pipe->if_id.valid && !stall) {
+        unsigned instruction = pipe->if_id.instruction;
+        signal_t opcode = instruction & 0x7F;
+        signal_t funct3 = (instruction >> 12) & 0x7;
+        signal_t funct7 = (opcode == 51) ? (instruction >> 25) & 0x7F : 0;
+
+        id_ex.valid = true;
+        id_ex.PC = pipe->if_id.PC;
+        id_ex.predicted_PC = pipe->if_id.predicted_PC;
+        id_ex.history = pipe->if_id.history;
+        id_ex.instruction = instruction;
+        control_unit(opcode, &id_ex.signals);
+        id_ex.ALU_ctrl = ALU_control_unit(id_ex.signals.ALUOp, funct7, funct3);
+        id_ex.imm = imm_gen(instruction);
+        id_ex.rs1 = (instruction >> 15) & 0x1F;
+        id_ex.rs2 = (instruction >> 20) & 0x1F;
+        id_ex.rd = (instruction >> 7) & 0x1F;
+        id_ex.rs1_val = core->reg_file[id_ex.rs1];
+        id_ex.rs2_val = core->reg_file[id_ex.rs2];
+
+        // Without a BTB, fetch cannot know a branch's target, so the
+        // direction predictor is consulted once the branch is decoded
+        if (id_ex.signals.Branch && pipe->predictor.btb == NULL) {
+            addr_t branch_target = id_ex.PC + ShiftLeft1(id_ex.imm);
+            id_ex.history = pipe->predictor.history;
+            if (bp_predict(&pipe->predictor, id_ex.PC, branch_target, id_ex.history)) {
+                predict_taken = true;
+                id_ex.predicted_PC = branch_target;
+            }
+        }
+    }
+
+    // IF. An I-cache miss sends bubbles into ID until the line arrives;
+    // the fill proceeds during hazard stalls as well.
+    bool fetching = !pipe->fetch_stopped && core->PC / 4 < core->instr_mem->size;
+    bool fill_pending = pipe->fetch_wait > 0;
+    unsigned fetch_latency = 0;
+    if (fill_pending)
+        pipe->fetch_wait--;
+    if (stall) {
+        if_id = pipe->if_id; // Hold IF/ID and PC, a bubble enters EX
+        pipe->stats.stall_cycles++;
+    } else if (fill_pending) {
+        pipe->stats.fetch_stall_cycles++;
+    } else if (fetching && core->icache != NULL && !pipe->fetch_filled &&
+               (fetch_latency = icache_fetch(core->icache, core->PC)) > 0) {
+        pipe->fetch_wait = fetch_latency - 1;
+        pipe->fetch_filled = true;
+        pipe->stats.fetch_stall_cycles++;
+    } else if (fetching) {
+        pipe->fetch_filled = false;
+        if_id.valid = true;
+        if_id.PC = core->PC;
+        if_id.instruction = fetch_instruction(core);
+        if_id.history = pipe->predictor.history;
+        addr_t predicted;
+        core->PC = bp_predict_fetch(&pipe->predictor, core->PC, &predicted) ? predicted : core->PC + 4;
+        if_id.predicted_PC = core->PC;
+    }
+
+    // Predicted taken in ID: squash the fall-through instruction fetched this cycle
+    if (predict_taken) {
+        memset(&if_id, 0, sizeof(if_id));
+        cancel_fetch(pipe);
+        core->PC = id_ex.predicted_PC;
+        pipe->stats.flush_cycles++;
+    }
+
+    // Mispredicted branch: squash the wrong-path instructions in IF and ID
+    if (redirect) {
+        memset(&if_id, 0, sizeof(if_id));
+        cancel_fetch(pipe);
+        memset(&id_ex, 0, sizeof(id_ex));
+        core->PC = target;
+        pipe->stats.flush_cycles += BRANCH_PENALTY;
+    }
+
+    pipe->if_id = if_id;
+    pipe->id_ex = id_ex;
+    pipe->ex_mem = ex_mem;
+    pipe->mem_wb = mem_wb;
+    // A data cache miss blocks the whole pipeline until the line arrives
+    pipe->stats.cycles += 1 + mem_latency;
+    core->clk += 1 + mem_latency;
+
+    fetching = !pipe->fetch_stopped && core->PC / 4 < core->instr_mem->size;
+    return fetching || if_id.valid || id_ex.valid || ex_mem.valid || mem_wb.valid;
+}
+
+// Run the pipeline until the program leaves instruction memory and all
+// in-flight instructions have retired. Returns the cycles simulated.
+tick_t run_pipeline(core_t *core, pipeline_t *pipe) {
+    tick_t start = pipe->stats.cycles;
+    while (pipeline_cycle(core, pipe));
+    return pipe->stats.cycles - start;
+}
+
+// Stop at a precise instruction boundary: squash the instructions that have
+// not executed yet, point the PC at the oldest of them and let the ones in
+// MEM and WB retire. The core can then continue functionally, or the
+// pipeline can restart from core->PC.
+void drain_pipeline(core_t *core, pipeline_t *pipe) {
+    if (pipe->id_ex.valid)
+        core->PC = pipe->id_ex.PC;
+    else if (pipe->if_id.valid)
+        core->PC = pipe->if_id.PC;
+    memset(&pipe->if_id, 0, sizeof(pipe->if_id));
+    memset(&pipe->id_ex, 0, sizeof(pipe->id_ex));
+    cancel_fetch(pipe);
+
+    pipe->fetch_stopped = true;
+    while (pipe->ex_mem.valid || pipe->mem_wb.valid)
+        pipeline_cycle(core, pipe);
+    pipe->fetch_stopped = false;
+}
+
+void print_pipeline_stats(const pipeline_stats_t *stats) {
+    printf("Cycles \t\t\t: %llu\n", (unsigned long long)stats->cycles);
+    printf("Retired instructions \t: %llu\n", (unsigned long long)stats->retired);
+    printf("Stall cycles \t\t: %llu\n", (unsigned long long)stats->stall_cycles);
+    printf("Flush cycles \t\t: %llu\n", (unsigned long long)stats->flush_cycles);
+    printf("Fetch stall cycles \t: %llu\n", (unsigned long long)stats->fetch_stall_cycles);
+    printf("Branches \t\t: %llu\n", (unsigned long long)stats->branches);
+    printf("Mispredictions \t\t: %llu\n", (unsigned long long)stats->mispredictions);
+    printf("Prediction accuracy \t: %.2f%%\n",
+           stats->branches ? 100.0 * (stats->branches - stats->mispredictions) / stats->branches : 100.0);
+    printf("CPI \t\t\t: %.3f\n", stats->retired ? (double)stats->cycles / stats->retired : 0.0);
+}
@@ -0,0 +1,95 @@
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+#include "core.h"
+#include "branch_predictor.h"
+
+// IF/ID pipeline register
+typedef struct {
+    bool valid;          // False for a bubble
+    addr_t PC;
+    addr_t predicted_PC; // Where fetch went after this instruction
+    uint32_t history;    // Branch history the prediction was made with
+    unsigned instruction;
+} if_id_latch_t;
+
+// ID/EX pipeline register
+typedef struct {
+    bool valid;
+    addr_t PC;
+    addr_t predicted_PC;
+    uint32_t history;
+    unsigned instruction;
+    control_signals_t signals;
+    signal_t ALU_ctrl;
+    signal_t imm;
+    signal_t rs1_val;
+    signal_t rs2_val;
+    uint8_t rs1;
+    uint8_t rs2;
+    uint8_t rd;
+} id_ex_latch_t;
+
+// EX/MEM pipeline register
+typedef struct {
+    bool valid;
+    addr_t PC;
+    unsigned instruction;
+    control_signals_t signals;
+    signal_t ALU_result;
+    signal_t rs2_val;    // Store data, after forwarding
+    uint8_t rd;
+} ex_mem_latch_t;
+
+// MEM/WB pipeline register
+typedef struct {
+    bool valid;
+    addr_t PC;
+    unsigned instruction;
+    control_signals_t signals;
+    signal_t ALU_result;
+    signal_t mem_data;   // Loaded value
+    signal_t rs2_val;    // Stored value, for the commit log
+    uint8_t rd;
+} mem_wb_latch_t;
+
+// Timing results of a pipelined run
+typedef struct {
+    tick_t cycles;
+    uint64_t retired;      // Instructions that completed WB
+    uint64_t stall_cycles; // Cycles IF and ID were held by the hazard unit
+    uint64_t flush_cycles; // Fetch slots squashed by branch redirects (misprediction penalty)
+    uint64_t branches;     // Branches resolved in EX
+    uint64_t mispredictions;
+    uint64_t fetch_stall_cycles; // Cycles IF waited for an I-cache fill
+} pipeline_stats_t;
+
+// Microarchitecture options of the pipeline
+typedef struct {
+    bp_config_t predictor;
+} pipeline_config_t;
+
+// State of the 5-stage pipeline around a core
+typedef struct {
+    if_id_latch_t if_id;
+    id_ex_latch_t id_ex;
+    ex_mem_latch_t ex_mem;
+    mem_wb_latch_t mem_wb;
+    pipeline_stats_t stats;
+    branch_predictor_t predictor;
+    unsigned fetch_wait;     // Cycles until the pending I-cache fill arrives
+    bool fetch_filled;       // The line of core->PC was filled; fetch without a lookup
+    tick_t last_retire;      // Cycle count when the last instruction retired
+    bool fetch_stopped;      // Draining: IF fetches nothing
+} pipeline_t;
+
+// Function prototypes
+void default_pipeline_config(pipeline_config_t *config);
+int init_pipeline(pipeline_t *pipe, const core_t *core, const pipeline_config_t *config);
+void free_pipeline(pipeline_t *pipe);
+bool pipeline_cycle(core_t *core, pipeline_t *pipe);
+tick_t run_pipeline(core_t *core, pipeline_t *pipe);
+void drain_pipeline(core_t *core, pipeline_t *pipe);
+void print_pipeline_stats(const pipeline_stats_t *stats);
+
+#endif
@@ -0,0 +1,238 @@
+#include "profiler.h"
+#include "core.h"
+#include "disasm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BLOCK_LISTING_ROWS 8 // Instructions listed under each hot block
+
+// Returns 0 on success, -1 if allocation fails
+int init_guest_profile(guest_profile_t *profile, size_t num_instructions) {
+    profile->pcs = (pc_profile_t *)calloc(num_instructions ? num_instructions : 1, sizeof(pc_profile_t));
+    profile->size = profile->pcs ? num_instructions : 0;
+    return profile->pcs ? 0 : -1;
+}
+
+void free_guest_profile(guest_profile_t *profile) {
+    free(profile->pcs);
+    profile->pcs = NULL;
+    profile->size = 0;
+}
+
+// A hot region: one PC, one basic block or one loop
+typedef struct {
+    size_t first;       // Instruction index of the start (PC, block leader, loop header)
+    size_t last;        // Instruction index of the end (block end, back edge)
+    uint64_t count;     // Executions of the first instruction
+    uint64_t cycles;    // Cycles attributed to the whole region
+    uint64_t back_taken; // Loops only: taken back edges to the header
+} region_t;
+
+// Most cycles first, then most executions, ties by PC
+static int compare_regions(const void *a, const void *b) {
+    const region_t *x = (const region_t *)a;
+    const region_t *y = (const region_t *)b;
+    if (x->cycles != y->cycles)
+        return x->cycles < y->cycles ? 1 : -1;
+    if (x->count != y->count)
+        return x->count < y->count ? 1 : -1;
+    return (x->first > y->first) - (x->first < y->first);
+}
+
+// By header, then by back edge
+static int compare_back_edges(const void *a, const void *b) {
+    const region_t *x = (const region_t *)a;
+    const region_t *y = (const region_t *)b;
+    if (x->first != y->first)
+        return (x->first > y->first) - (x->first < y->first);
+    return (x->last > y->last) - (x->last < y->last);
+}
+
+static bool is_branch(unsigned instruction) {
+    return (instruction & 0x7F) == 99;
+}
+
+// Instruction index a branch jumps to, as executed: PC + (imm << 1)
+static int64_t branch_target(size_t index, unsigned instruction) {
+    return (int64_t)index + imm_gen(instruction) / 2;
+}
+
+static uint64_t sum_cycles(const guest_profile_t *profile, size_t first, size_t last) {
+    uint64_t cycles = 0;
+    for (size_t i = first; i <= last; i++)
+        cycles += profile->pcs[i].cycles;
+    return cycles;
+}
+
+static double percent(uint64_t part, uint64_t total) {
+    return total ? 100.0 * part / total : 0.0;
+}
+
+static void print_hot_pcs(const guest_profile_t *profile, const instruction_memory_t *i_mem,
+                          uint64_t total, size_t max_rows) {
+    size_t count = 0;
+    for (size_t i = 0; i < profile->size; i++)
+        count += profile->pcs[i].count > 0;
+    region_t *sorted = (region_t *)malloc((count ? count : 1) * sizeof(region_t));
+    if (sorted == NULL)
+        return;
+    size_t n = 0;
+    for (size_t i = 0; i < profile->size; i++) {
+        if (profile->pcs[i].count > 0) {
+            sorted[n] = (region_t){i, i, profile->pcs[i].count, profile->pcs[i].cycles, 0};
+            n++;
+        }
+    }
+    qsort(sorted, count, sizeof(region_t), compare_regions);
+
+    size_t rows = count < max_rows ? count : max_rows;
+    printf("Hot PC \t\tExecuted \tCycles \t\tCycles %% \tInstruction\n");
+    for (size_t i = 0; i < rows; i++) {
+        char text[DISASM_MAX_LENGTH];
+        disassemble(i_mem->instructions[sorted[i].first].instruction, text, sizeof(text));
+        printf("%-8llu \t%-10llu \t%-10llu \t%6.2f%% \t%s\n", (unsigned long long)sorted[i].first * 4,
+               (unsigned long long)sorted[i].count, (unsigned long long)sorted[i].cycles,
+               percent(sorted[i].cycles, total), text);
+    }
+    if (rows < count)
+        printf("(%zu more PCs)\n", count - rows);
+    free(sorted);
+}
+
+// Basic blocks are split at PC 0, at every branch target and after every
+// branch. Each is listed with its instructions.
+static void print_hot_blocks(const guest_profile_t *profile, const instruction_memory_t *i_mem,
+                             uint64_t total, size_t max_rows) {
+    size_t size = profile->size;
+    bool *leader = (bool *)calloc(size + 1, sizeof(bool));
+    region_t *blocks = (region_t *)malloc((size ? size : 1) * sizeof(region_t));
+    if (leader == NULL || blocks == NULL) {
+        free(leader);
+        free(blocks);
+        return;
+    }
+    leader[0] = true;
+    for (size_t i = 0; i < size; i++) {
+        unsigned instruction = i_mem->instructions[i].instruction;
+        if (!is_branch(instruction))
+            continue;
+        int64_t target = branch_target(i, instruction);
+        if (target >= 0 && (uint64_t)target < size)
+            leader[target] = true;
+        leader[i + 1] = true;
+    }
+
+    size_t count = 0;
+    for (size_t first = 0; first < size;) {
+        size_t last = first;
+        while (last + 1 < size && !leader[last + 1])
+            last++;
+        if (profile->pcs[first].count > 0) {
+            blocks[count] = (region_t){first, last, profile->pcs[first].count,
+                                       sum_cycles(profile, first, last), 0};
+            count++;
+        }
+        first = last + 1;
+    }
+    qsort(blocks, count, sizeof(region_t), compare_regions);
+
+    size_t rows = count < max_rows ? count : max_rows;
+    printf("Hot block \tExecuted \tCycles \t\tCycles %% \tInstructions\n");
+    for (size_t i = 0; i < rows; i++) {
+        const region_t *block = &blocks[i];
+        printf("%-8llu \t%-10llu \t%-10llu \t%6.2f%% \t%zu\n", (unsigned long long)block->first * 4,
+               (unsigned long long)block->count, (unsigned long long)block->cycles,
+               percent(block->cycles, total), block->last - block->first + 1);
+        for (size_t j = block->first; j <= block->last && j < block->first + BLOCK_LISTING_ROWS; j++) {
+            char text[DISASM_MAX_LENGTH];
+            disassemble(i_mem->instructions[j].instruction, text, sizeof(text));
+            printf("    %-8llu \t%-10llu \t%s\n", (unsigned long long)j * 4,
+                   (unsigned long long)profile->pcs[j].cycles, text);
+        }
+        if (block->last - block->first + 1 > BLOCK_LISTING_ROWS)
+            printf("    ...\n");
+    }
+    if (rows < count)
+        printf("(%zu more blocks)\n", count - rows);
+    free(leader);
+    free(blocks);
+}
+
+// A loop is a taken backward branch and the code from its target (the
+// header) up to the branch (the back edge). Back edges sharing a header
+// form one loop ending at the furthest of them. A loop is entered every
+// time its header runs other than through a back edge, so the average trip
+// count is header executions per entry.
+static void print_hot_loops(const guest_profile_t *profile, const instruction_memory_t *i_mem,
+                            uint64_t total, size_t max_rows) {
+    size_t count = 0;
+    for (size_t i = 0; i < profile->size; i++) {
+        unsigned instruction = i_mem->instructions[i].instruction;
+        int64_t target = branch_target(i, instruction);
+        count += is_branch(instruction) && profile->pcs[i].taken > 0 && target >= 0 && (uint64_t)target <= i;
+    }
+    if (count == 0)
+        return;
+
+    region_t *loops = (region_t *)malloc(count * sizeof(region_t));
+    if (loops == NULL)
+        return;
+    size_t n = 0;
+    for (size_t i = 0; i < profile->size; i++) {
+        unsigned instruction = i_mem->instructions[i].instruction;
+        int64_t target = branch_target(i, instruction);
+        if (is_branch(instruction) && profile->pcs[i].taken > 0 && target >= 0 && (uint64_t)target <= i) {
+            loops[n] = (region_t){(size_t)target, i, 0, 0, profile->pcs[i].taken};
+            n++;
+        }
+    }
+    qsort(loops, count, sizeof(region_t), compare_back_edges);
+
+    // Merge the back edges of each header
+    n = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (n > 0 && loops[n - 1].first == loops[i].first) {
+            loops[n - 1].last = loops[i].last;
+            loops[n - 1].back_taken += loops[i].back_taken;
+        } else {
+            loops[n++] = loops[i];
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        loops[i].count = profile->pcs[loops[i].first].count;
+        loops[i].cycles = sum_cycles(profile, loops[i].first, loops[i].last);
+    }
+    qsort(loops, n, sizeof(region_t), compare_regions);
+
+    size_t rows = n < max_rows ? n : max_rows;
+    printf("Loop header \tBack edge \tEntries \tIterations \tAvg trips \tCycles \t\tCycles %% \tHeader\n");
+    for (size_t i = 0; i < rows; i++) {
+        const region_t *loop = &loops[i];
+        uint64_t entries = loop->count > loop->back_taken ? loop->count - loop->back_taken : 0;
+        char text[DISASM_MAX_LENGTH];
+        disassemble(i_mem->instructions[loop->first].instruction, text, sizeof(text));
+        printf("%-8llu \t%-8llu \t%-10llu \t%-10llu \t%-10.2f \t%-10llu \t%6.2f%% \t%s\n",
+               (unsigned long long)loop->first * 4, (unsigned long long)loop->last * 4,
+               (unsigned long long)entries, (unsigned long long)loop->count,
+               entries ? (double)loop->count / entries : 0.0, (unsigned long long)loop->cycles,
+               percent(loop->cycles, total), text);
+    }
+    if (rows < n)
+        printf("(%zu more loops)\n", n - rows);
+    free(loops);
+}
+
+// Print the max_rows hottest PCs, basic blocks and loops by attributed
+// cycles, annotated with the disassembled instructions of i_mem
+void print_guest_profile(const guest_profile_t *profile, const instruction_memory_t *i_mem, size_t max_rows) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < profile->size; i++)
+        total += profile->pcs[i].cycles;
+    if (total == 0)
+        return;
+
+    print_hot_pcs(profile, i_mem, total, max_rows);
+    print_hot_blocks(profile, i_mem, total, max_rows);
+    print_hot_loops(profile, i_mem, total, max_rows);
+}
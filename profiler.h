@@ -0,0 +1,53 @@
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "instruction.h"
+#include "instruction_memory.h"
+
+// Execution profile of one static instruction
+typedef struct {
+    uint64_t count;   // Executions
+    uint64_t cycles;  // Cycles attributed, stalls included
+    uint64_t taken;   // Taken executions, branches only
+} pc_profile_t;
+
+// Per-PC guest profile
+typedef struct {
+    pc_profile_t *pcs;  // Indexed by PC / 4
+    size_t size;        // Instructions covered
+} guest_profile_t;
+
+// Function prototypes
+int init_guest_profile(guest_profile_t *profile, size_t num_instructions);
+void free_guest_profile(guest_profile_t *profile);
+void print_guest_profile(const guest_profile_t *profile, const instruction_memory_t *i_mem, size_t max_rows);
+
+// Count one execution of the instruction at PC
+static inline void profile_execute(guest_profile_t *profile, addr_t PC, bool taken) {
+    if (PC / 4 < profile->size) {
+        profile->pcs[PC / 4].count++;
+        profile->pcs[PC / 4].taken += taken;
+    }
+}
+
+// Attribute cycles to the instruction at PC
+static inline void profile_charge(guest_profile_t *profile, addr_t PC, uint64_t cycles) {
+    if (PC / 4 < profile->size)
+        profile->pcs[PC / 4].cycles += cycles;
+}
+
+// Count one execution of the instruction at PC that took cycles
+static inline void profile_record(guest_profile_t *profile, addr_t PC, uint64_t cycles, bool taken) {
+    if (PC / 4 < profile->size) {
+        pc_profile_t *pc = &profile->pcs[PC / 4];
+        pc->count++;
+        pc->cycles += cycles;
+        pc->taken += taken;
+    }
+}
+
+#endif
@@ -0,0 +1,129 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "program_image.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// 64-bit hash of the trace text, eight bytes per step
+uint64_t hash_source(const void *data, uint64_t size) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    uint64_t hash = 0xcbf29ce484222325ULL ^ size;
+    uint64_t i = 0;
+
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        hash = (hash ^ word) * 0x100000001b3ULL;
+        hash ^= hash >> 29;
+    }
+    for (; i < size; i++)
+        hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+    return hash;
+}
+
+static char *image_path(const char *trace) {
+    size_t len = strlen(trace);
+    char *path = (char *)malloc(len + sizeof(IMAGE_SUFFIX));
+    if (path != NULL) {
+        memcpy(path, trace, len);
+        memcpy(path + len, IMAGE_SUFFIX, sizeof(IMAGE_SUFFIX));
+    }
+    return path;
+}
+
+// Map the image of a trace straight into instruction memory if it exists
+// and was built from the same source. Returns 0 on success, -1 if the
+// image is missing or stale.
+int load_image(instruction_memory_t *i_mem, const char *trace, uint64_t source_size, uint64_t source_hash) {
+    char *path = image_path(trace);
+    if (path == NULL)
+        return -1;
+    int fd = open(path, O_RDONLY);
+    free(path);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(image_header_t)) {
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    const image_header_t *header = (const image_header_t *)map;
+    if (memcmp(header->magic, IMAGE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != IMAGE_VERSION ||
+        header->source_size != source_size || header->source_hash != source_hash ||
+        header->num_instructions != (st.st_size - sizeof(image_header_t)) / sizeof(instruction_t)) {
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    init_instruction_memory(i_mem);
+    i_mem->instructions = (instruction_t *)((char *)map + sizeof(image_header_t));
+    i_mem->size = header->num_instructions;
+    i_mem->capacity = header->num_instructions;
+    i_mem->num_unknown = header->num_unknown;
+    i_mem->mapping = map;
+    i_mem->mapping_size = st.st_size;
+    return 0;
+}
+
+// Write the image of an assembled trace next to it. The image is written to
+// a temporary file and renamed, so concurrent loaders never see a partial
+// image. Returns 0 on success.
+int save_image(const instruction_memory_t *i_mem, const char *trace, uint64_t source_size, uint64_t source_hash) {
+    char *path = image_path(trace);
+    if (path == NULL)
+        return -1;
+    size_t len = strlen(path);
+    char *tmp_path = (char *)malloc(len + sizeof(".XXXXXX"));
+    if (tmp_path == NULL) {
+        free(path);
+        return -1;
+    }
+    memcpy(tmp_path, path, len);
+    memcpy(tmp_path + len, ".XXXXXX", sizeof(".XXXXXX"));
+
+    int status = -1;
+    int fd = mkstemp(tmp_path);
+    if (fd >= 0) {
+        fchmod(fd, 0644);
+        image_header_t header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+        header.version = IMAGE_VERSION;
+        header.num_unknown = i_mem->num_unknown;
+        header.num_instructions = i_mem->size;
+        header.source_size = source_size;
+        header.source_hash = source_hash;
+
+        FILE *out = fdopen(fd, "wb");
+        if (out != NULL) {
+            if (fwrite(&header, sizeof(header), 1, out) == 1 &&
+                fwrite(i_mem->instructions, sizeof(instruction_t), i_mem->size, out) == i_mem->size)
+                status = 0;
+            if (fclose(out) != 0)
+                status = -1;
+        } else {
+            close(fd);
+        }
+        if (status == 0 && rename(tmp_path, path) != 0)
+            status = -1;
+        if (status != 0)
+            unlink(tmp_path);
+    }
+
+    free(tmp_path);
+    free(path);
+    return status;
+}
@@ -0,0 +1,28 @@
+#ifndef __PROGRAM_IMAGE_H__
+#define __PROGRAM_IMAGE_H__
+
+#include <stdint.h>
+
+#include "instruction_memory.h"
+
+#define IMAGE_MAGIC "RVIMAGE"   // 7 characters plus terminator
+#define IMAGE_VERSION 1
+#define IMAGE_SUFFIX ".rvbin"   // Image of <trace> is stored as <trace>.rvbin
+
+// Header of a pre-assembled program image. The instruction words follow
+// it directly, in host byte order.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_unknown;      // Unknown lines skipped by the assembler
+    uint64_t num_instructions;
+    uint64_t source_size;      // Size of the trace text in bytes
+    uint64_t source_hash;      // hash_source of the trace text
+} image_header_t;
+
+// Function prototypes
+uint64_t hash_source(const void *data, uint64_t size);
+int load_image(instruction_memory_t *i_mem, const char *trace, uint64_t source_size, uint64_t source_hash);
+int save_image(const instruction_memory_t *i_mem, const char *trace, uint64_t source_size, uint64_t source_hash);
+
+#endif
@@ -0,0 +1,153 @@
+#include "sampling.h"
+#include "decoder.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Two-sided 95% Student t quantiles for 1 to 30 degrees of freedom; the
+// normal quantile is used beyond
+static const double T_95[30] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+#define Z_95 1.960
+
+// Parse N:W:M, e.g. "1000000:100000:10000". M must be positive. Returns 0
+// on success, -1 on a malformed spec.
+int parse_sampling_config(const char *spec, sampling_config_t *sampling) {
+    char *end;
+    sampling->fast_forward = strtoull(spec, &end, 10);
+    if (end == spec || *end != ':')
+        return -1;
+    spec = end + 1;
+    sampling->warmup = strtoull(spec, &end, 10);
+    if (end == spec || *end != ':')
+        return -1;
+    spec = end + 1;
+    sampling->measure = strtoull(spec, &end, 10);
+    if (end == spec || *end != '\0' || sampling->measure == 0)
+        return -1;
+    return 0;
+}
+
+// Time up to measure instructions from an empty pipeline and drain it.
+// Returns false if the program ended during the interval.
+static bool measure_interval(core_t *core, pipeline_t *pipe, uint64_t measure) {
+    uint64_t target = pipe->stats.retired + measure;
+    bool running = true;
+    while (running && pipe->stats.retired < target)
+        running = pipeline_cycle(core, pipe);
+    if (running)
+        drain_pipeline(core, pipe);
+    return running && core->PC / 4 < core->instr_mem->size;
+}
+
+// Run a core to completion in sampling mode: the decoded engine skips
+// ahead, tick_func warms the caches and the pipeline's predictor, and the
+// pipeline times each measured interval. The CPI of the whole run is
+// estimated from the mean CPI of the intervals. Returns 0 on success, -1
+// if the caches or pipeline cannot be allocated.
+int run_sampled(core_t *core, const engine_config_t *config, const sampling_config_t *sampling,
+                sampling_result_t *result) {
+    memset(result, 0, sizeof(*result));
+    cache_t dcache;
+    icache_t icache;
+    pipeline_t pipe;
+    int status = -1;
+
+    if (config->dcache.size > 0 && init_cache(&dcache, &config->dcache) != 0)
+        return -1;
+    if (config->icache.size > 0 && init_icache(&icache, &config->icache, core->instr_mem->size) != 0)
+        goto free_dcache;
+    if (init_pipeline(&pipe, core, &config->pipeline) != 0)
+        goto free_pipeline;
+    if (config->warm != NULL) {
+        if (config->warm->dcache != NULL && config->dcache.size > 0)
+            copy_cache_state(&dcache, config->warm->dcache);
+        if (config->warm->icache != NULL && config->icache.size > 0)
+            copy_cache_state(&icache.cache, &config->warm->icache->cache);
+        if (config->warm->predictor != NULL)
+            copy_predictor_state(&pipe.predictor, config->warm->predictor);
+    }
+
+    double mean = 0.0, m2 = 0.0; // Welford's running mean and squared deviations
+    bool running = core->PC / 4 < core->instr_mem->size;
+    while (running) {
+        // Fast-forward: functional only, no timing state touched
+        core->tick = tick_decoded_func;
+        uint64_t executed = run_instructions(core, sampling->fast_forward, NULL);
+        result->instructions += executed;
+        if (executed < sampling->fast_forward || core->PC / 4 >= core->instr_mem->size)
+            break;
+
+        // Warm-up: functional, but through the caches and predictor
+        core->dcache = config->dcache.size > 0 ? &dcache : NULL;
+        core->icache = config->icache.size > 0 ? &icache : NULL;
+        core->tick = tick_func;
+        executed = run_instructions(core, sampling->warmup, &pipe.predictor);
+        result->instructions += executed;
+        result->warmup_instructions += executed;
+        if (executed < sampling->warmup || core->PC / 4 >= core->instr_mem->size) {
+            core->dcache = NULL;
+            core->icache = NULL;
+            break;
+        }
+
+        // Detailed interval
+        uint64_t retired = pipe.stats.retired;
+        tick_t cycles = pipe.stats.cycles;
+        running = measure_interval(core, &pipe, sampling->measure);
+        core->dcache = NULL;
+        core->icache = NULL;
+        retired = pipe.stats.retired - retired;
+        cycles = pipe.stats.cycles - cycles;
+        result->instructions += retired;
+        if (retired == 0)
+            break;
+        result->detailed_instructions += retired;
+        result->detailed_cycles += cycles;
+
+        double cpi = (double)cycles / retired;
+        result->samples++;
+        double delta = cpi - mean;
+        mean += delta / result->samples;
+        m2 += delta * (cpi - mean);
+    }
+
+    result->cpi = mean;
+    result->pipeline = pipe.stats;
+    if (result->samples >= 2) {
+        uint64_t df = result->samples - 1;
+        result->cpi_stddev = sqrt(m2 / df);
+        result->cpi_error = (df <= 30 ? T_95[df - 1] : Z_95) * result->cpi_stddev / sqrt((double)result->samples);
+    }
+    status = 0;
+
+free_pipeline:
+    free_pipeline(&pipe);
+    if (config->icache.size > 0)
+        free_icache(&icache);
+free_dcache:
+    if (config->dcache.size > 0)
+        free_cache(&dcache);
+    return status;
+}
+
+void print_sampling_result(const sampling_result_t *result) {
+    printf("Samples \t\t: %llu\n", (unsigned long long)result->samples);
+    printf("Instructions \t\t: %llu (%llu warm-up, %llu detailed)\n", (unsigned long long)result->instructions,
+           (unsigned long long)result->warmup_instructions, (unsigned long long)result->detailed_instructions);
+    printf("Detailed cycles \t: %llu\n", (unsigned long long)result->detailed_cycles);
+    if (result->samples == 0) {
+        printf("Estimated CPI \t\t: n/a (no complete sample; shorten the period)\n");
+        return;
+    }
+    if (result->samples >= 2)
+        printf("Estimated CPI \t\t: %.4f +/- %.4f (95%% confidence, %.2f%%)\n", result->cpi, result->cpi_error,
+               result->cpi > 0 ? 100.0 * result->cpi_error / result->cpi : 0.0);
+    else
+        printf("Estimated CPI \t\t: %.4f (one sample, no confidence interval)\n", result->cpi);
+    printf("Estimated cycles \t: %.0f\n", result->cpi * result->instructions);
+}
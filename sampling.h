@@ -0,0 +1,33 @@
+#ifndef __SAMPLING_H__
+#define __SAMPLING_H__
+
+#include "engine.h"
+
+// One sampling period: skip fast_forward instructions functionally, warm
+// caches and predictor over warmup instructions, then time measure
+// instructions on the pipeline. Periods repeat until the program ends.
+typedef struct {
+    uint64_t fast_forward;
+    uint64_t warmup;
+    uint64_t measure;
+} sampling_config_t;
+
+typedef struct {
+    uint64_t samples;               // Measured intervals
+    uint64_t instructions;          // All instructions executed
+    uint64_t warmup_instructions;
+    uint64_t detailed_instructions; // Retired in measured intervals
+    uint64_t detailed_cycles;
+    double cpi;                     // Mean CPI of the samples
+    double cpi_stddev;              // Sample standard deviation
+    double cpi_error;               // Half-width of the 95% confidence interval, 0 if under 2 samples
+    pipeline_stats_t pipeline;      // Summed over the measured intervals
+} sampling_result_t;
+
+// Function prototypes
+int parse_sampling_config(const char *spec, sampling_config_t *sampling);
+int run_sampled(core_t *core, const engine_config_t *config, const sampling_config_t *sampling,
+                sampling_result_t *result);
+void print_sampling_result(const sampling_result_t *result);
+
+#endif
@@ -0,0 +1,155 @@
+#define _POSIX_C_SOURCE 200809L
+#include "self_profile.h"
+
+#ifdef SELF_PROFILE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CALIBRATION_NS 5000000  // Spin this long to measure the timer rate
+#define OVERHEAD_SAMPLES 10000
+
+__thread self_profile_table_t *self_profile_thread_table;
+double self_profile_ns_per_tick = 1.0;
+
+static pthread_mutex_t tables_lock = PTHREAD_MUTEX_INITIALIZER;
+static self_profile_table_t *tables;
+static uint64_t overhead_ticks; // Cheapest back-to-back timer read
+
+static const char *STAGE_NAME[NUM_SELF_PROFILE_STAGES] = {
+    [SELF_PROFILE_FETCH] = "fetch",
+    [SELF_PROFILE_DECODE] = "decode",
+    [SELF_PROFILE_EXECUTE] = "execute",
+    [SELF_PROFILE_MEMORY] = "memory",
+    [SELF_PROFILE_WRITEBACK] = "writeback",
+    [SELF_PROFILE_PC_UPDATE] = "pc-update",
+    [SELF_PROFILE_RETIRE] = "retire",
+};
+
+static uint64_t monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+// Measure the timer rate against the monotonic clock and the cost of a
+// timer read, and arrange for the report at exit. Runs before main, so the
+// first sample is already scaled and no tick pays for the calibration.
+__attribute__((constructor)) static void calibrate(void) {
+    uint64_t start_ns = monotonic_ns();
+    uint64_t start_ticks = self_profile_now();
+    uint64_t now_ns;
+    while ((now_ns = monotonic_ns()) - start_ns < CALIBRATION_NS)
+        ;
+    uint64_t ticks = self_profile_now() - start_ticks;
+    if (ticks > 0)
+        self_profile_ns_per_tick = (double)(now_ns - start_ns) / ticks;
+
+    overhead_ticks = UINT64_MAX;
+    for (unsigned i = 0; i < OVERHEAD_SAMPLES; i++) {
+        uint64_t t0 = self_profile_now();
+        uint64_t t1 = self_profile_now();
+        if (t1 - t0 < overhead_ticks)
+            overhead_ticks = t1 - t0;
+    }
+    atexit(print_self_profile);
+}
+
+// Give the calling thread its table, on its first sample. Tables live
+// until exit so the report can read them after their threads are gone.
+self_profile_table_t *self_profile_register_thread(void) {
+    self_profile_table_t *table = (self_profile_table_t *)calloc(1, sizeof(self_profile_table_t));
+    if (table == NULL)
+        return NULL;
+    for (unsigned s = 0; s < NUM_SELF_PROFILE_STAGES; s++)
+        table->stages[s].min_ticks = UINT64_MAX;
+
+    pthread_mutex_lock(&tables_lock);
+    table->next = tables;
+    tables = table;
+    pthread_mutex_unlock(&tables_lock);
+    self_profile_thread_table = table;
+    return table;
+}
+
+static void merge_stage(self_profile_stage_stats_t *total, const self_profile_stage_stats_t *stats) {
+    total->samples += stats->samples;
+    total->ticks += stats->ticks;
+    if (stats->min_ticks < total->min_ticks)
+        total->min_ticks = stats->min_ticks;
+    if (stats->max_ticks > total->max_ticks)
+        total->max_ticks = stats->max_ticks;
+    for (unsigned b = 0; b < SELF_PROFILE_BUCKETS; b++)
+        total->buckets[b] += stats->buckets[b];
+}
+
+static void print_bucket_label(unsigned bucket) {
+    char label[48];
+    if (bucket == 0)
+        snprintf(label, sizeof(label), "<1");
+    else if (bucket == SELF_PROFILE_BUCKETS - 1)
+        snprintf(label, sizeof(label), ">=%llu", 1ull << (bucket - 1));
+    else
+        snprintf(label, sizeof(label), "%llu-%llu", 1ull << (bucket - 1), (1ull << bucket) - 1);
+    fprintf(stderr, "%-22s", label);
+}
+
+// Print the time per stage of all threads, then a histogram of sample
+// durations with one column per stage. Goes to stderr so it never mixes with the
+// simulator's own output. Times include one timer read per sample.
+void print_self_profile(void) {
+    self_profile_stage_stats_t total[NUM_SELF_PROFILE_STAGES] = {{0}};
+    for (unsigned s = 0; s < NUM_SELF_PROFILE_STAGES; s++)
+        total[s].min_ticks = UINT64_MAX;
+
+    pthread_mutex_lock(&tables_lock);
+    unsigned threads = 0;
+    for (const self_profile_table_t *table = tables; table != NULL; table = table->next, threads++)
+        for (unsigned s = 0; s < NUM_SELF_PROFILE_STAGES; s++)
+            merge_stage(&total[s], &table->stages[s]);
+    pthread_mutex_unlock(&tables_lock);
+
+    uint64_t all_ticks = 0;
+    unsigned first = SELF_PROFILE_BUCKETS, last = 0;
+    for (unsigned s = 0; s < NUM_SELF_PROFILE_STAGES; s++) {
+        all_ticks += total[s].ticks;
+        for (unsigned b = 0; b < SELF_PROFILE_BUCKETS; b++) {
+            if (total[s].buckets[b] == 0)
+                continue;
+            first = b < first ? b : first;
+            last = b > last ? b : last;
+        }
+    }
+    if (all_ticks == 0)
+        return;
+
+    double scale = self_profile_ns_per_tick;
+    fprintf(stderr, "\nSelf profile: %llu instructions on %u threads (%.3f ns per tick, timer read %.1f ns)\n",
+            (unsigned long long)total[SELF_PROFILE_FETCH].samples, threads, scale, overhead_ticks * scale);
+    fprintf(stderr, "%-10s %14s %10s %7s %9s %9s %11s\n", "Stage", "Samples", "Total ms", "Share",
+            "Mean ns", "Min ns", "Max ns");
+    for (unsigned s = 0; s < NUM_SELF_PROFILE_STAGES; s++) {
+        const self_profile_stage_stats_t *stats = &total[s];
+        if (stats->samples == 0)
+            continue;
+        fprintf(stderr, "%-10s %14llu %10.2f %6.1f%% %9.2f %9.1f %11.1f\n", STAGE_NAME[s],
+                (unsigned long long)stats->samples, stats->ticks * scale / 1e6, 100.0 * stats->ticks / all_ticks,
+                stats->ticks * scale / stats->samples, stats->min_ticks * scale, stats->max_ticks * scale);
+    }
+
+    fprintf(stderr, "\n%-22s", "Duration (ns)");
+    for (unsigned s = 0; s < NUM_SELF_PROFILE_STAGES; s++)
+        if (total[s].samples > 0)
+            fprintf(stderr, " %10s", STAGE_NAME[s]);
+    fprintf(stderr, "\n");
+    for (unsigned b = first; b <= last; b++) {
+        print_bucket_label(b);
+        for (unsigned s = 0; s < NUM_SELF_PROFILE_STAGES; s++)
+            if (total[s].samples > 0)
+                fprintf(stderr, " %10llu", (unsigned long long)total[s].buckets[b]);
+        fprintf(stderr, "\n");
+    }
+}
+
+#endif // SELF_PROFILE
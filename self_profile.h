@@ -0,0 +1,105 @@
+#ifndef __SELF_PROFILE_H__
+#define __SELF_PROFILE_H__
+
+// Host-side profile of where the reference engine spends its time, per
+// datapath stage of tick_func. Built only with -DSELF_PROFILE; otherwise
+// every macro below expands to nothing and no timer is read.
+
+// Stages of one tick, timed back to back
+typedef enum {
+    SELF_PROFILE_FETCH,     // I-cache model and fetch_instruction
+    SELF_PROFILE_DECODE,    // control_unit, imm_gen, register reads, ALU_control_unit
+    SELF_PROFILE_EXECUTE,   // ALU
+    SELF_PROFILE_MEMORY,    // memory_access_stage, D-cache model included
+    SELF_PROFILE_WRITEBACK, // write_back_stage
+    SELF_PROFILE_PC_UPDATE, // update_pc_stage
+    SELF_PROFILE_RETIRE,    // Clock, counters, profile and commit log hooks
+    NUM_SELF_PROFILE_STAGES
+} self_profile_stage_t;
+
+#ifdef SELF_PROFILE
+
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define SELF_PROFILE_BUCKETS 32 // Bucket 0 is under 1 ns, bucket b is [2^(b-1), 2^b) ns
+
+typedef struct {
+    uint64_t samples;
+    uint64_t ticks;         // Sum of the timer ticks of all samples
+    uint64_t min_ticks;
+    uint64_t max_ticks;
+    uint64_t buckets[SELF_PROFILE_BUCKETS];
+} self_profile_stage_stats_t;
+
+// Samples of one thread. Each thread records into its own table, so
+// multi-hart, batch and sweep runs need no atomics; the tables are merged
+// when the report is printed at exit.
+typedef struct self_profile_table_s {
+    self_profile_stage_stats_t stages[NUM_SELF_PROFILE_STAGES];
+    struct self_profile_table_s *next;
+} self_profile_table_t;
+
+extern __thread self_profile_table_t *self_profile_thread_table;
+extern double self_profile_ns_per_tick;
+
+// Function prototypes
+self_profile_table_t *self_profile_register_thread(void);
+void print_self_profile(void);
+
+// Timestamp in timer ticks: the time-stamp counter on x86, nanoseconds of
+// the monotonic clock elsewhere
+static inline uint64_t self_profile_now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+#endif
+}
+
+static inline void self_profile_record(self_profile_table_t *table, self_profile_stage_t stage, uint64_t ticks) {
+    self_profile_stage_stats_t *stats = &table->stages[stage];
+    stats->samples++;
+    stats->ticks += ticks;
+    if (ticks < stats->min_ticks)
+        stats->min_ticks = ticks;
+    if (ticks > stats->max_ticks)
+        stats->max_ticks = ticks;
+
+    uint64_t ns = (uint64_t)(ticks * self_profile_ns_per_tick);
+    unsigned bucket = ns ? 64 - __builtin_clzll(ns) : 0;
+    stats->buckets[bucket < SELF_PROFILE_BUCKETS ? bucket : SELF_PROFILE_BUCKETS - 1]++;
+}
+
+// Charge the time since start to stage and return the new start. A
+// thread's first lap registers its table, which is not charged to the
+// next stage.
+static inline uint64_t self_profile_lap(self_profile_stage_t stage, uint64_t start) {
+    uint64_t now = self_profile_now();
+    self_profile_table_t *table = self_profile_thread_table;
+    if (table == NULL) {
+        if ((table = self_profile_register_thread()) != NULL)
+            self_profile_record(table, stage, now - start);
+        return self_profile_now();
+    }
+    self_profile_record(table, stage, now - start);
+    return now;
+}
+
+#define SELF_PROFILE_START(timer) uint64_t timer = self_profile_now()
+#define SELF_PROFILE_LAP(timer, stage) (timer = self_profile_lap(stage, timer))
+
+#else
+
+#define SELF_PROFILE_START(timer)
+#define SELF_PROFILE_LAP(timer, stage)
+
+#endif // SELF_PROFILE
+
+#endif
@@ -0,0 +1,352 @@
+#include "simulator.h"
+#include "decoder.h"
+#include "parser.h"
+#include <stdlib.h>
+#include <string.h>
+
+// A simulator owns its program, decode cache, data memory and core. The
+// caches are attached to the core for stepping; runs through run_engine
+// bring their own and add their statistics to the totals.
+struct sim_s {
+    sim_config_t config;
+    instruction_memory_t instr_mem;
+    decode_cache_t decoded;
+    core_t *core;
+    cache_t dcache;
+    icache_t icache;
+    uint64_t instructions;
+    cache_stats_t run_dcache;  // Cache statistics of runs through run_engine
+    cache_stats_t run_icache;
+    pipeline_stats_t pipeline;
+};
+
+void default_sim_config(sim_config_t *config) {
+    config->engine = ENGINE_DECODED;
+    default_cache_config(&config->dcache);
+    default_cache_config(&config->icache);
+    default_pipeline_config(&config->pipeline);
+    config->addr_bits = DMEM_DEFAULT_ADDR_BITS;
+}
+
+static bool sim_config_valid(const sim_config_t *config) {
+    if (config->engine > ENGINE_PIPELINE)
+        return false;
+    if (config->addr_bits < DMEM_MIN_ADDR_BITS || config->addr_bits > DMEM_MAX_ADDR_BITS)
+        return false;
+    if (config->dcache.size > 0 && !cache_config_valid(&config->dcache))
+        return false;
+    if (config->icache.size > 0 && !cache_config_valid(&config->icache))
+        return false;
+    return bp_config_valid(&config->pipeline.predictor);
+}
+
+// Set up everything around an assembled program. On failure the
+// simulator is destroyed.
+static int finish_create(sim_t *sim, sim_t **out) {
+    if (build_decode_cache(&sim->instr_mem, &sim->decoded) != 0)
+        goto fail;
+    data_memory_t *data_mem = new_data_memory(sim->config.addr_bits);
+    if (data_mem == NULL)
+        goto fail;
+    sim->core = init_core_with_memory(&sim->instr_mem, data_mem);
+    if (sim->core == NULL) {
+        free_data_memory(data_mem);
+        goto fail;
+    }
+    sim->core->owns_data_mem = true;
+    sim->core->decoded = &sim->decoded;
+    sim->core->tick = sim->config.engine == ENGINE_REFERENCE ? tick_func : tick_decoded_func;
+
+    // The pipeline gets its caches from run_engine
+    if (sim->config.engine == ENGINE_REFERENCE) {
+        if (sim->config.dcache.size > 0) {
+            if (init_cache(&sim->dcache, &sim->config.dcache) != 0)
+                goto fail;
+            sim->core->dcache = &sim->dcache;
+        }
+        if (sim->config.icache.size > 0) {
+            if (init_icache(&sim->icache, &sim->config.icache, sim->instr_mem.size) != 0)
+                goto fail;
+            sim->core->icache = &sim->icache;
+        }
+    }
+    *out = sim;
+    return SIM_OK;
+
+fail:
+    sim_destroy(sim);
+    return SIM_ERR_NOMEM;
+}
+
+static int load_status(int status) {
+    switch (status) {
+    case LOAD_OK:        return SIM_OK;
+    case LOAD_ERR_OPEN:  return SIM_ERR_OPEN;
+    default:             return SIM_ERR_NOMEM;
+    }
+}
+
+static int new_sim(const sim_config_t *config, sim_t **sim) {
+    sim_config_t defaults;
+    if (config == NULL) {
+        default_sim_config(&defaults);
+        config = &defaults;
+    }
+    if (!sim_config_valid(config))
+        return SIM_ERR_CONFIG;
+    *sim = (sim_t *)calloc(1, sizeof(sim_t));
+    if (*sim == NULL)
+        return SIM_ERR_NOMEM;
+    (*sim)->config = *config;
+    init_instruction_memory(&(*sim)->instr_mem);
+    return SIM_OK;
+}
+
+// Create a simulator for a trace file. The file is assembled directly; no
+// program image is read or written next to it. config may be NULL for the
+// defaults. On success *sim is the new simulator.
+int sim_create_from_file(const char *path, const sim_config_t *config, sim_t **sim) {
+    if (path == NULL || sim == NULL)
+        return SIM_ERR_ARGUMENT;
+    sim_t *s;
+    int status = new_sim(config, &s);
+    if (status != SIM_OK)
+        return status;
+    status = load_status(assemble_trace(&s->instr_mem, path, 1));
+    if (status != SIM_OK) {
+        sim_destroy(s);
+        return status;
+    }
+    return finish_create(s, sim);
+}
+
+// Create a simulator for trace text held in memory, which is not kept
+int sim_create_from_buffer(const char *text, size_t size, const sim_config_t *config, sim_t **sim) {
+    if ((text == NULL && size > 0) || sim == NULL)
+        return SIM_ERR_ARGUMENT;
+    sim_t *s;
+    int status = new_sim(config, &s);
+    if (status != SIM_OK)
+        return status;
+    status = load_status(assemble_buffer(&s->instr_mem, text, size));
+    if (status != SIM_OK) {
+        sim_destroy(s);
+        return status;
+    }
+    return finish_create(s, sim);
+}
+
+void sim_destroy(sim_t *sim) {
+    if (sim == NULL)
+        return;
+    if (sim->core != NULL) {
+        if (sim->core->dcache != NULL)
+            free_cache(&sim->dcache);
+        if (sim->core->icache != NULL)
+            free_icache(&sim->icache);
+        free_core(sim->core);
+    }
+    free_decode_cache(&sim->decoded);
+    free_instruction_memory(&sim->instr_mem);
+    free(sim);
+}
+
+// Whether the PC is past the end of the program; true for a NULL handle
+bool sim_halted(const sim_t *sim) {
+    return sim == NULL || sim->core->PC / 4 >= sim->instr_mem.size;
+}
+
+// Execute up to max_instructions instructions, stopping early at the end
+// of the program. The reference engine steps with its caches; the
+// functional engines all step with the decoded engine, which has the same
+// architectural behaviour. The pipeline cannot stop between instructions
+// and only runs to completion with sim_run. executed may be NULL.
+int sim_step(sim_t *sim, uint64_t max_instructions, uint64_t *executed) {
+    if (sim == NULL)
+        return SIM_ERR_ARGUMENT;
+    if (sim->config.engine == ENGINE_PIPELINE)
+        return SIM_ERR_UNSUPPORTED;
+
+    tick_t start_clk = sim->core->clk;
+    uint64_t count = run_instructions(sim->core, max_instructions, NULL);
+    sim->instructions += count;
+#if PERF_COUNTERS
+    sim->core->perf.cycles += sim->core->clk - start_clk;
+#else
+    (void)start_clk;
+#endif
+    if (executed != NULL)
+        *executed = count;
+    return SIM_OK;
+}
+
+static void add_cache_stats(cache_stats_t *total, const cache_stats_t *stats) {
+    total->reads += stats->reads;
+    total->writes += stats->writes;
+    total->read_misses += stats->read_misses;
+    total->write_misses += stats->write_misses;
+    total->evictions += stats->evictions;
+    total->writebacks += stats->writebacks;
+    total->write_throughs += stats->write_throughs;
+    total->stall_cycles += stats->stall_cycles;
+    total->prefetches += stats->prefetches;
+    total->useful_prefetches += stats->useful_prefetches;
+}
+
+static void add_pipeline_stats(pipeline_stats_t *total, const pipeline_stats_t *stats) {
+    total->cycles += stats->cycles;
+    total->retired += stats->retired;
+    total->stall_cycles += stats->stall_cycles;
+    total->flush_cycles += stats->flush_cycles;
+    total->branches += stats->branches;
+    total->mispredictions += stats->mispredictions;
+    total->fetch_stall_cycles += stats->fetch_stall_cycles;
+}
+
+// Run to the end of the program with the configured engine
+int sim_run(sim_t *sim, uint64_t *executed) {
+    if (sim == NULL)
+        return SIM_ERR_ARGUMENT;
+    engine_t engine = sim->config.engine;
+    if (engine == ENGINE_REFERENCE || engine == ENGINE_DECODED)
+        return sim_step(sim, UINT64_MAX, executed);
+
+    uint64_t count = 0;
+    if (!sim_halted(sim)) {
+        engine_config_t config;
+        default_engine_config(&config);
+        config.pipeline = sim->config.pipeline;
+        config.dcache = sim->config.dcache;
+        config.icache = sim->config.icache;
+
+        engine_result_t result;
+        if (run_engine(sim->core, engine, &config, &result) != 0)
+            return SIM_ERR_NOMEM;
+        count = result.instructions;
+        sim->instructions += count;
+        if (engine == ENGINE_PIPELINE) {
+            add_pipeline_stats(&sim->pipeline, &result.pipeline);
+            add_cache_stats(&sim->run_dcache, &result.dcache);
+            add_cache_stats(&sim->run_icache, &result.icache);
+        }
+        free_engine_result(&result);
+    }
+    if (executed != NULL)
+        *executed = count;
+    return SIM_OK;
+}
+
+int sim_get_register(const sim_t *sim, unsigned index, int64_t *value) {
+    if (sim == NULL || value == NULL)
+        return SIM_ERR_ARGUMENT;
+    if (index >= NUM_REGISTERS)
+        return SIM_ERR_REGISTER;
+    *value = sim->core->reg_file[index];
+    return SIM_OK;
+}
+
+int sim_set_register(sim_t *sim, unsigned index, int64_t value) {
+    if (sim == NULL)
+        return SIM_ERR_ARGUMENT;
+    if (index >= NUM_REGISTERS)
+        return SIM_ERR_REGISTER;
+    sim->core->reg_file[index] = value;
+    return SIM_OK;
+}
+
+// Current PC, 0 for a NULL handle
+uint64_t sim_get_pc(const sim_t *sim) {
+    return sim != NULL ? sim->core->PC : 0;
+}
+
+// Move the PC to another instruction; a PC past the end of the program
+// halts the simulator
+int sim_set_pc(sim_t *sim, uint64_t PC) {
+    if (sim == NULL)
+        return SIM_ERR_ARGUMENT;
+    if (PC % 4 != 0)
+        return SIM_ERR_ADDRESS;
+    sim->core->PC = PC;
+    return SIM_OK;
+}
+
+// Copy size bytes of data memory starting at addr into buffer. Addresses
+// wrap at the configured address space; bytes never written read as zero.
+int sim_read_memory(const sim_t *sim, uint64_t addr, void *buffer, size_t size) {
+    if (sim == NULL || (buffer == NULL && size > 0))
+        return SIM_ERR_ARGUMENT;
+    const data_memory_t *mem = sim->core->data_mem;
+    byte_t *out = (byte_t *)buffer;
+    while (size > 0) {
+        size_t offset = addr & (DMEM_PAGE_SIZE - 1);
+        size_t chunk = DMEM_PAGE_SIZE - offset < size ? DMEM_PAGE_SIZE - offset : size;
+        const dmem_page_t *page = dmem_lookup(mem, addr);
+        if (page != NULL)
+            memcpy(out, &page->bytes[offset], chunk);
+        else
+            memset(out, 0, chunk);
+        out += chunk;
+        addr += chunk;
+        size -= chunk;
+    }
+    return SIM_OK;
+}
+
+// Copy size bytes from buffer into data memory starting at addr
+int sim_write_memory(sim_t *sim, uint64_t addr, const void *buffer, size_t size) {
+    if (sim == NULL || (buffer == NULL && size > 0))
+        return SIM_ERR_ARGUMENT;
+    data_memory_t *mem = sim->core->data_mem;
+    const byte_t *in = (const byte_t *)buffer;
+    while (size > 0) {
+        size_t offset = addr & (DMEM_PAGE_SIZE - 1);
+        size_t chunk = DMEM_PAGE_SIZE - offset < size ? DMEM_PAGE_SIZE - offset : size;
+        dmem_page_t *page = dmem_lookup_write(mem, addr);
+        if (page == NULL && (page = dmem_alloc_page(mem, addr)) == NULL)
+            return SIM_ERR_NOMEM;
+        memcpy(&page->bytes[offset], in, chunk);
+        in += chunk;
+        addr += chunk;
+        size -= chunk;
+    }
+    return SIM_OK;
+}
+
+int sim_get_stats(const sim_t *sim, sim_stats_t *stats) {
+    if (sim == NULL || stats == NULL)
+        return SIM_ERR_ARGUMENT;
+    memset(stats, 0, sizeof(*stats));
+    stats->instructions = sim->instructions;
+    stats->cycles = sim->core->clk;
+    stats->perf = sim->core->perf;
+    stats->dcache = sim->run_dcache;
+    stats->icache = sim->run_icache;
+    if (sim->core->dcache != NULL)
+        add_cache_stats(&stats->dcache, &sim->dcache.stats);
+    if (sim->core->icache != NULL)
+        add_cache_stats(&stats->icache, &sim->icache.cache.stats);
+    stats->pipeline = sim->pipeline;
+    stats->program_size = sim->instr_mem.size;
+    stats->num_unknown = sim->instr_mem.num_unknown;
+    return SIM_OK;
+}
+
+// Hash of the PC, registers and data memory, as printed by the CLI; 0 for a
+// NULL handle
+uint64_t sim_state_hash(const sim_t *sim) {
+    return sim != NULL ? core_state_hash(sim->core) : 0;
+}
+
+const char *sim_error_string(int status) {
+    switch (status) {
+    case SIM_OK:              return "ok";
+    case SIM_ERR_OPEN:        return "cannot open trace file";
+    case SIM_ERR_NOMEM:       return "out of memory";
+    case SIM_ERR_CONFIG:      return "invalid configuration";
+    case SIM_ERR_REGISTER:    return "register index out of range";
+    case SIM_ERR_ADDRESS:     return "PC is not instruction-aligned";
+    case SIM_ERR_UNSUPPORTED: return "not supported by this engine";
+    case SIM_ERR_ARGUMENT:    return "invalid argument";
+    }
+    return "unknown error";
+}
@@ -0,0 +1,65 @@
+#ifndef __SIMULATOR_H__
+#define __SIMULATOR_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "engine.h"
+
+// Embeddable simulator API. Every simulator is an independent handle: the
+// library keeps no global state and never prints or exits, so one process
+// can host any number of simulators, each driven by one thread at a time.
+// Calls that return a status give SIM_ERR_ARGUMENT for a NULL handle;
+// sim_halted then returns true, and sim_get_pc and sim_state_hash 0.
+
+#define SIM_OK 0
+#define SIM_ERR_OPEN -1        // Trace file could not be opened
+#define SIM_ERR_NOMEM -2
+#define SIM_ERR_CONFIG -3      // Invalid engine, cache or memory configuration
+#define SIM_ERR_REGISTER -4    // Register index out of range
+#define SIM_ERR_ADDRESS -5     // PC not instruction-aligned
+#define SIM_ERR_UNSUPPORTED -6 // The engine cannot do this, e.g. step the pipeline
+#define SIM_ERR_ARGUMENT -7    // NULL handle or buffer
+
+typedef struct sim_s sim_t;
+
+typedef struct {
+    engine_t engine;         // Engine used by sim_run; see sim_step for stepping
+    cache_config_t dcache;   // size 0 for no data cache
+    cache_config_t icache;   // size 0 for no instruction cache
+    pipeline_config_t pipeline;
+    unsigned addr_bits;      // Data address space, DMEM_MIN_ADDR_BITS to DMEM_MAX_ADDR_BITS
+} sim_config_t;
+
+// Counters accumulated over every step and run since creation
+typedef struct {
+    uint64_t instructions;   // Instructions retired
+    uint64_t cycles;
+    perf_counters_t perf;
+    cache_stats_t dcache;    // Valid when a data cache is configured
+    cache_stats_t icache;    // Valid when an instruction cache is configured
+    pipeline_stats_t pipeline; // ENGINE_PIPELINE only
+    size_t program_size;     // Instructions in the program
+    unsigned num_unknown;    // Trace lines skipped as unknown instructions
+} sim_stats_t;
+
+// Function prototypes
+void default_sim_config(sim_config_t *config);
+int sim_create_from_file(const char *path, const sim_config_t *config, sim_t **sim);
+int sim_create_from_buffer(const char *text, size_t size, const sim_config_t *config, sim_t **sim);
+void sim_destroy(sim_t *sim);
+int sim_step(sim_t *sim, uint64_t max_instructions, uint64_t *executed);
+int sim_run(sim_t *sim, uint64_t *executed);
+bool sim_halted(const sim_t *sim);
+int sim_get_register(const sim_t *sim, unsigned index, int64_t *value);
+int sim_set_register(sim_t *sim, unsigned index, int64_t value);
+uint64_t sim_get_pc(const sim_t *sim);
+int sim_set_pc(sim_t *sim, uint64_t PC);
+int sim_read_memory(const sim_t *sim, uint64_t addr, void *buffer, size_t size);
+int sim_write_memory(sim_t *sim, uint64_t addr, const void *buffer, size_t size);
+int sim_get_stats(const sim_t *sim, sim_stats_t *stats);
+uint64_t sim_state_hash(const sim_t *sim);
+const char *sim_error_string(int status);
+
+#endif
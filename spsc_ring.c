@@ -0,0 +1,23 @@
+#include "spsc_ring.h"
+#include <stdlib.h>
+
+// Capacity is rounded up to a power of two. Returns 0 on success, -1 if
+// allocation fails.
+int init_spsc_ring(spsc_ring_t *ring, size_t record_size, size_t capacity) {
+    memset(ring, 0, sizeof(*ring));
+    size_t rounded = 1;
+    while (rounded < capacity)
+        rounded <<= 1;
+    ring->records = (unsigned char *)malloc(rounded * record_size);
+    if (ring->records == NULL)
+        return -1;
+    ring->record_size = record_size;
+    ring->capacity = rounded;
+    ring->mask = rounded - 1;
+    return 0;
+}
+
+void free_spsc_ring(spsc_ring_t *ring) {
+    free(ring->records);
+    ring->records = NULL;
+}
@@ -0,0 +1,91 @@
+#ifndef __SPSC_RING_H__
+#define __SPSC_RING_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#define SPSC_CACHE_LINE 64
+
+// Lock-free ring of fixed-size records between exactly one producer thread
+// and one consumer thread. head and tail only grow and are masked into the
+// buffer; each side keeps a cached copy of the other's index so it touches
+// the shared line only when its cached view runs out. The producer and
+// consumer indices sit on separate cache lines.
+typedef struct {
+    size_t head;         // Next record to write, owned by the producer
+    size_t cached_tail;  // Producer's view of tail
+    char pad0[SPSC_CACHE_LINE - 2 * sizeof(size_t)];
+    size_t tail;         // Next record to read, owned by the consumer
+    size_t cached_head;  // Consumer's view of head
+    char pad1[SPSC_CACHE_LINE - 2 * sizeof(size_t)];
+    unsigned char *records;
+    size_t record_size;
+    size_t capacity;     // Records, a power of two
+    size_t mask;
+} spsc_ring_t;
+
+// Function prototypes
+int init_spsc_ring(spsc_ring_t *ring, size_t record_size, size_t capacity);
+void free_spsc_ring(spsc_ring_t *ring);
+
+// Producer: slot for the next record, or NULL if the ring is full. The
+// record becomes visible to the consumer on spsc_ring_commit.
+static inline void *spsc_ring_reserve(spsc_ring_t *ring) {
+    if (ring->head - ring->cached_tail == ring->capacity) {
+        ring->cached_tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        if (ring->head - ring->cached_tail == ring->capacity)
+            return NULL;
+    }
+    return ring->records + (ring->head & ring->mask) * ring->record_size;
+}
+
+static inline void spsc_ring_commit(spsc_ring_t *ring) {
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+// Producer: copy a record in. Returns false, without blocking, if full.
+static inline bool spsc_ring_push(spsc_ring_t *ring, const void *record) {
+    void *slot = spsc_ring_reserve(ring);
+    if (slot == NULL)
+        return false;
+    memcpy(slot, record, ring->record_size);
+    spsc_ring_commit(ring);
+    return true;
+}
+
+// Consumer: records waiting to be read
+static inline size_t spsc_ring_size(spsc_ring_t *ring) {
+    ring->cached_head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    return ring->cached_head - ring->tail;
+}
+
+// Consumer: the longest run of waiting records that is contiguous in the
+// buffer, stored in *records. Returns the number of records in the run;
+// they stay in the ring until spsc_ring_release.
+static inline size_t spsc_ring_peek(spsc_ring_t *ring, void **records) {
+    if (ring->cached_head == ring->tail)
+        ring->cached_head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    size_t available = ring->cached_head - ring->tail;
+    size_t offset = ring->tail & ring->mask;
+    if (available > ring->capacity - offset)
+        available = ring->capacity - offset;
+    *records = ring->records + offset * ring->record_size;
+    return available;
+}
+
+static inline void spsc_ring_release(spsc_ring_t *ring, size_t count) {
+    __atomic_store_n(&ring->tail, ring->tail + count, __ATOMIC_RELEASE);
+}
+
+// Consumer: copy the oldest record out. Returns false if the ring is empty.
+static inline bool spsc_ring_pop(spsc_ring_t *ring, void *record) {
+    void *next;
+    if (spsc_ring_peek(ring, &next) == 0)
+        return false;
+    memcpy(record, next, ring->record_size);
+    spsc_ring_release(ring, 1);
+    return true;
+}
+
+#endif
@@ -0,0 +1,274 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "sweep.h"
+#include "work_pool.h"
+#include <string.h>
+#include <time.h>
+
+#define SWEEP_FILE_MAX (1 << 20) // Largest grid file read
+
+// Outcome of one configuration
+typedef struct {
+    const char *status;
+    engine_result_t result;  // Statistics only; profiles are freed by the job
+    addr_t PC;
+    uint64_t state_hash;
+    double seconds;
+} sweep_record_t;
+
+typedef struct {
+    const sweep_grid_t *grid;
+    const core_t *start;
+    engine_t engine;
+    const engine_config_t *config;
+    sweep_record_t *records;
+} sweep_t;
+
+static const char *SWEEP_KEYS[] = {"engine", "predictor", "bht-bits", "history", "btb", "dcache", "icache"};
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static bool parse_unsigned(const char *text, unsigned *value) {
+    char *end;
+    unsigned long v = strtoul(text, &end, 10);
+    if (end == text || *end != '\0' || v > 1u << 30)
+        return false;
+    *value = (unsigned)v;
+    return true;
+}
+
+// Set one parameter of a configuration. Returns 0, or -1 if the value does
+// not parse or leaves its part of the configuration invalid.
+static int apply_setting(engine_config_t *config, engine_t *engine, const char *key, const char *value) {
+    bp_config_t *bp = &config->pipeline.predictor;
+    if (strcmp(key, "engine") == 0)
+        return engine_from_name(value, engine);
+    if (strcmp(key, "predictor") == 0)
+        return bp_kind_from_name(value, &bp->kind);
+    if (strcmp(key, "bht-bits") == 0)
+        return parse_unsigned(value, &bp->table_bits) && bp->table_bits <= BP_MAX_TABLE_BITS ? 0 : -1;
+    if (strcmp(key, "history") == 0)
+        return parse_unsigned(value, &bp->history_bits) && bp->history_bits <= BP_MAX_HISTORY_BITS ? 0 : -1;
+    if (strcmp(key, "btb") == 0)
+        return parse_unsigned(value, &bp->btb_entries) && (bp->btb_entries & (bp->btb_entries - 1)) == 0 ? 0 : -1;
+    cache_config_t *cache = strcmp(key, "dcache") == 0 ? &config->dcache : &config->icache;
+    return parse_cache_config(value, cache) == 0 && cache_config_valid(cache) ? 0 : -1;
+}
+
+static bool known_key(const char *key) {
+    for (size_t i = 0; i < sizeof(SWEEP_KEYS) / sizeof(SWEEP_KEYS[0]); i++) {
+        if (strcmp(key, SWEEP_KEYS[i]) == 0)
+            return true;
+    }
+    return false;
+}
+
+static char *read_grid_file(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return NULL;
+    char *text = (char *)malloc(SWEEP_FILE_MAX + 1);
+    size_t length = text ? fread(text, 1, SWEEP_FILE_MAX, file) : 0;
+    bool failed = text == NULL || ferror(file) || !feof(file);
+    fclose(file);
+    if (failed) {
+        free(text);
+        return NULL;
+    }
+    text[length] = '\0';
+    return text;
+}
+
+// Parse axes of the form KEY=VALUE[,VALUE...], separated by ';' or new
+// lines; "@path" reads them from a file, where blank lines and lines
+// starting with '#' are skipped. Keys are engine, predictor, bht-bits,
+// history, btb, dcache and icache, with the values their options take.
+int parse_sweep_grid(const char *spec, sweep_grid_t *grid) {
+    memset(grid, 0, sizeof(*grid));
+    grid->text = spec[0] == '@' ? read_grid_file(spec + 1) : strdup(spec);
+    if (grid->text == NULL)
+        return spec[0] == '@' ? SWEEP_ERR_IO : SWEEP_ERR_NOMEM;
+
+    int status = SWEEP_OK;
+    grid->num_configs = 1;
+    char *line = grid->text;
+    while (line != NULL && status == SWEEP_OK) {
+        char *next = line + strcspn(line, ";\n");
+        next = *next != '\0' ? (*next = '\0', next + 1) : NULL;
+        line[strcspn(line, "\r")] = '\0';
+        char *axis_text = line;
+        line = next;
+        if (axis_text[0] == '\0' || axis_text[0] == '#')
+            continue;
+
+        char *equals = strchr(axis_text, '=');
+        if (equals == NULL || equals == axis_text || equals[1] == '\0') {
+            status = SWEEP_ERR_SYNTAX;
+            break;
+        }
+        *equals = '\0';
+        if (!known_key(axis_text)) {
+            status = SWEEP_ERR_KEY;
+            break;
+        }
+        for (size_t a = 0; a < grid->num_axes; a++) {
+            if (strcmp(grid->axes[a].key, axis_text) == 0)
+                status = SWEEP_ERR_KEY;
+        }
+        if (status != SWEEP_OK)
+            break;
+        if (grid->num_axes == SWEEP_MAX_AXES) {
+            status = SWEEP_ERR_SIZE;
+            break;
+        }
+
+        sweep_axis_t *axis = &grid->axes[grid->num_axes++];
+        axis->key = axis_text;
+        size_t count = 1;
+        for (const char *c = equals + 1; *c != '\0'; c++)
+            count += *c == ',';
+        if ((axis->values = (char **)calloc(count, sizeof(char *))) == NULL) {
+            status = SWEEP_ERR_NOMEM;
+            break;
+        }
+        char *value = equals + 1;
+        for (size_t v = 0; v < count; v++) {
+            char *comma = value + strcspn(value, ",");
+            char *rest = *comma != '\0' ? comma + 1 : comma;
+            *comma = '\0';
+            engine_config_t config;
+            engine_t engine = ENGINE_PIPELINE;
+            default_engine_config(&config);
+            if (value[0] == '\0' || apply_setting(&config, &engine, axis->key, value) != 0) {
+                status = SWEEP_ERR_VALUE;
+                break;
+            }
+            axis->values[axis->num_values++] = value;
+            value = rest;
+        }
+        if (status == SWEEP_OK && (grid->num_configs *= axis->num_values) > SWEEP_MAX_CONFIGS)
+            status = SWEEP_ERR_SIZE;
+    }
+    if (status == SWEEP_OK && grid->num_axes == 0)
+        status = SWEEP_ERR_SYNTAX;
+    if (status != SWEEP_OK)
+        free_sweep_grid(grid);
+    return status;
+}
+
+void free_sweep_grid(sweep_grid_t *grid) {
+    for (size_t a = 0; a < grid->num_axes; a++)
+        free(grid->axes[a].values);
+    free(grid->text);
+    memset(grid, 0, sizeof(*grid));
+}
+
+const char *sweep_error_string(int status) {
+    switch (status) {
+    case SWEEP_OK:         return "ok";
+    case SWEEP_ERR_SYNTAX: return "expected KEY=VALUE[,VALUE...] axes separated by ';' or new lines";
+    case SWEEP_ERR_KEY:    return "unknown or repeated key (engine, predictor, bht-bits, history, btb, dcache, icache)";
+    case SWEEP_ERR_VALUE:  return "invalid value for its key";
+    case SWEEP_ERR_SIZE:   return "too many axes or configurations";
+    case SWEEP_ERR_IO:     return "cannot read grid file";
+    case SWEEP_ERR_NOMEM:  return "out of memory";
+    }
+    return "unknown error";
+}
+
+// Value of an axis in configuration index
+static const char *axis_value(const sweep_grid_t *grid, size_t axis, size_t index) {
+    for (size_t a = grid->num_axes; a-- > axis + 1;)
+        index /= grid->axes[a].num_values;
+    return grid->axes[axis].values[index % grid->axes[axis].num_values];
+}
+
+// Run one configuration on a fork of the starting core's data memory
+static void sweep_job(size_t job, unsigned worker, void *ctx) {
+    sweep_t *sweep = (sweep_t *)ctx;
+    sweep_record_t *record = &sweep->records[job];
+    (void)worker;
+
+    engine_config_t config = *sweep->config;
+    engine_t engine = sweep->engine;
+    for (size_t a = 0; a < sweep->grid->num_axes; a++)
+        apply_setting(&config, &engine, sweep->grid->axes[a].key, axis_value(sweep->grid, a, job));
+    if (!bp_config_valid(&config.pipeline.predictor)) {
+        record->status = "invalid";
+        return;
+    }
+
+    record->status = "out of memory";
+    const core_t *start = sweep->start;
+    data_memory_t *mem = fork_data_memory(start->data_mem);
+    core_t *core = mem != NULL ? init_core_with_memory(start->instr_mem, mem) : NULL;
+    if (core == NULL) {
+        free_data_memory(mem);
+        return;
+    }
+    core->owns_data_mem = true;
+    core->decoded = start->decoded;
+    core->PC = start->PC;
+    core->clk = start->clk;
+    memcpy(core->reg_file, start->reg_file, sizeof(core->reg_file));
+
+    double start_time = now_seconds();
+    if (run_engine(core, engine, &config, &record->result) == 0) {
+        record->seconds = now_seconds() - start_time;
+        record->status = "ok";
+        record->PC = core->PC;
+        record->state_hash = core_state_hash(core);
+    }
+    free_engine_result(&record->result);
+    free_core(core);
+}
+
+static double miss_rate(const cache_stats_t *stats) {
+    uint64_t accesses = stats->reads + stats->writes;
+    return accesses > 0 ? (double)(stats->read_misses + stats->write_misses) / accesses : 0.0;
+}
+
+// Run every configuration of the grid, on num_threads worker threads, from
+// the state of start: its PC, registers and a copy-on-write fork of its
+// data memory. The instruction memory and decode cache of start are shared
+// read-only. Axes override engine and config. Writes one CSV row per
+// configuration, in grid order. Returns the number of configurations that
+// did not run, or -1 on allocation failure.
+int run_sweep(const sweep_grid_t *grid, const core_t *start, engine_t engine, const engine_config_t *config,
+              unsigned num_threads, FILE *out) {
+    sweep_t sweep = {grid, start, engine, config, NULL};
+    sweep.records = (sweep_record_t *)calloc(grid->num_configs, sizeof(sweep_record_t));
+    if (sweep.records == NULL)
+        return -1;
+    // Jobs of threads that could not start are run by the others
+    if (run_work_pool(grid->num_configs, num_threads, sweep_job, &sweep) != 0)
+        fprintf(stderr, "Warning: some sweep threads could not be started\n");
+
+    fprintf(out, "config");
+    for (size_t a = 0; a < grid->num_axes; a++)
+        fprintf(out, ",%s", grid->axes[a].key);
+    fprintf(out, ",status,instructions,cycles,cpi,branches,mispredictions,dcache_miss_rate,icache_miss_rate,"
+            "seconds,pc,state_hash\n");
+
+    int failed = 0;
+    for (size_t i = 0; i < grid->num_configs; i++) {
+        const sweep_record_t *r = &sweep.records[i];
+        const engine_result_t *result = &r->result;
+        fprintf(out, "%zu", i);
+        for (size_t a = 0; a < grid->num_axes; a++)
+            fprintf(out, ",%s", axis_value(grid, a, i));
+        fprintf(out, ",%s,%llu,%llu,%.4f,%llu,%llu,%.4f,%.4f,%.6f,%llu,%016llx\n", r->status,
+                (unsigned long long)result->instructions, (unsigned long long)result->cycles,
+                result->instructions > 0 ? (double)result->cycles / result->instructions : 0.0,
+                (unsigned long long)result->pipeline.branches, (unsigned long long)result->pipeline.mispredictions,
+                miss_rate(&result->dcache), miss_rate(&result->icache), r->seconds, (unsigned long long)r->PC,
+                (unsigned long long)r->state_hash);
+        failed += strcmp(r->status, "ok") != 0;
+    }
+    free(sweep.records);
+    return failed;
+}
@@ -0,0 +1,40 @@
+#ifndef __SWEEP_H__
+#define __SWEEP_H__
+
+#include "engine.h"
+
+#define SWEEP_MAX_AXES 8
+#define SWEEP_MAX_CONFIGS 100000
+
+#define SWEEP_OK 0
+#define SWEEP_ERR_SYNTAX -1  // An axis is not KEY=VALUE[,VALUE...]
+#define SWEEP_ERR_KEY -2     // Unknown or repeated key
+#define SWEEP_ERR_VALUE -3   // A value is invalid for its key
+#define SWEEP_ERR_SIZE -4    // Too many axes or configurations
+#define SWEEP_ERR_IO -5      // Grid file could not be read
+#define SWEEP_ERR_NOMEM -6
+
+// One swept parameter, named like its command-line option
+typedef struct {
+    const char *key;
+    char **values;
+    size_t num_values;
+} sweep_axis_t;
+
+// Cartesian product of the axes. Configuration i takes its value for the
+// last axis from i mod its size, the first axis varying slowest.
+typedef struct {
+    sweep_axis_t axes[SWEEP_MAX_AXES];
+    size_t num_axes;
+    size_t num_configs;
+    char *text;          // Owned copy of the spec the values point into
+} sweep_grid_t;
+
+// Function prototypes
+int parse_sweep_grid(const char *spec, sweep_grid_t *grid);
+void free_sweep_grid(sweep_grid_t *grid);
+const char *sweep_error_string(int status);
+int run_sweep(const sweep_grid_t *grid, const core_t *start, engine_t engine, const engine_config_t *config,
+              unsigned num_threads, FILE *out);
+
+#endif
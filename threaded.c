@@ -0,0 +1,141 @@
+#include "threaded.h"
+#include <stdlib.h>
+
+// Fast functional engine. Each decoded instruction is bound to its handler
+// once, and every handler dispatches straight to the handler of the next
+// instruction instead of returning to a central tick loop. The entry past
+// the last instruction is bound to the halt handler, so sequential flow
+// needs no PC bounds check; only taken branches check their target.
+//
+// Architectural results match tick_func. Stores the number of
+// instructions executed, which is also added to core->clk, in *instructions.
+// Returns 0, or -1 if the threaded code cannot be allocated, in which case
+// nothing is executed.
+int run_threaded(core_t *core, tick_t *instructions) {
+    const decode_cache_t *cache = core->decoded;
+    *instructions = 0;
+    if (cache == NULL || cache->size == 0)
+        return 0;
+
+    const decoded_instruction_t *uops = cache->uops;
+    const uint64_t size = cache->size;
+    register_t *reg = core->reg_file;
+    data_memory_t *mem = core->data_mem;
+    perf_counters_t *perf = &core->perf;
+    uint64_t pc = core->PC / 4; // Instruction index
+    tick_t executed = 0;
+    const decoded_instruction_t *d;
+
+    if (pc >= size)
+        return 0;
+
+#ifdef THREADED_COMPUTED_GOTO
+    static void *const labels[NUM_UOPS] = {
+        [UOP_NOP] = &&do_nop,   [UOP_ADD] = &&do_add,   [UOP_SUB] = &&do_sub,
+        [UOP_AND] = &&do_and,   [UOP_OR] = &&do_or,     [UOP_SLL] = &&do_sll,
+        [UOP_ADDI] = &&do_addi, [UOP_SUBI] = &&do_subi, [UOP_ANDI] = &&do_andi,
+        [UOP_ORI] = &&do_ori,   [UOP_SLLI] = &&do_slli, [UOP_LD] = &&do_ld,
+        [UOP_SD] = &&do_sd,     [UOP_BEQ] = &&do_beq,
+    };
+
+    // Threaded code: one handler address per instruction plus the halt entry
+    void **code = (void **)malloc((size + 1) * sizeof(void *));
+    if (code == NULL)
+        return -1;
+    for (uint64_t i = 0; i < size; i++)
+        code[i] = labels[uops[i].uop];
+    code[size] = &&halt;
+
+#define HANDLER(name, op) do_##name:
+#define DISPATCH()        do { d = &uops[pc]; goto *code[pc]; } while (0)
+#define NEXT()            do { ++executed; ++pc; DISPATCH(); } while (0)
+#define JUMP(target)      do { ++executed; pc = (target); if (pc >= size) goto halt; DISPATCH(); } while (0)
+
+    DISPATCH();
+#else
+// No do/while wrapper here: continue must reach the dispatch loop
+#define HANDLER(name, op) case op:
+#define NEXT()            { ++executed; ++pc; continue; }
+#define JUMP(target)      { ++executed; pc = (target); continue; }
+
+    while (pc < size) {
+        d = &uops[pc];
+        switch (d->uop) {
+#endif
+
+    HANDLER(nop, UOP_NOP)
+        perf_count(perf, OPCLASS_OTHER, 0, false);
+        NEXT();
+    HANDLER(add, UOP_ADD)
+        perf_count(perf, OPCLASS_R, 0, false);
+        reg[d->rd] = reg[d->rs1] + reg[d->rs2];
+        NEXT();
+    HANDLER(sub, UOP_SUB)
+        perf_count(perf, OPCLASS_R, 0, false);
+        reg[d->rd] = reg[d->rs1] - reg[d->rs2];
+        NEXT();
+    HANDLER(and, UOP_AND)
+        perf_count(perf, OPCLASS_R, 0, false);
+        reg[d->rd] = reg[d->rs1] & reg[d->rs2];
+        NEXT();
+    HANDLER(or, UOP_OR)
+        perf_count(perf, OPCLASS_R, 0, false);
+        reg[d->rd] = reg[d->rs1] | reg[d->rs2];
+        NEXT();
+    HANDLER(sll, UOP_SLL)
+        perf_count(perf, OPCLASS_R, 0, false);
+        reg[d->rd] = (uint64_t)reg[d->rs1] << (reg[d->rs2] & 0x3F);
+        NEXT();
+    HANDLER(addi, UOP_ADDI)
+        perf_count(perf, OPCLASS_I, 0, false);
+        reg[d->rd] = reg[d->rs1] + d->imm;
+        NEXT();
+    HANDLER(subi, UOP_SUBI)
+        perf_count(perf, OPCLASS_I, 0, false);
+        reg[d->rd] = reg[d->rs1] - d->imm;
+        NEXT();
+    HANDLER(andi, UOP_ANDI)
+        perf_count(perf, OPCLASS_I, 0, false);
+        reg[d->rd] = reg[d->rs1] & d->imm;
+        NEXT();
+    HANDLER(ori, UOP_ORI)
+        perf_count(perf, OPCLASS_I, 0, false);
+        reg[d->rd] = reg[d->rs1] | d->imm;
+        NEXT();
+    HANDLER(slli, UOP_SLLI)
+        perf_count(perf, OPCLASS_I, 0, false);
+        reg[d->rd] = (uint64_t)reg[d->rs1] << (d->imm & 0x3F);
+        NEXT();
+    HANDLER(ld, UOP_LD)
+        perf_count(perf, OPCLASS_LOAD, d->funct3, false);
+        reg[d->rd] = dmem_read(mem, reg[d->rs1] + d->imm, d->funct3);
+        NEXT();
+    HANDLER(sd, UOP_SD)
+        perf_count(perf, OPCLASS_STORE, d->funct3, false);
+        dmem_write(mem, reg[d->rs1] + d->imm, reg[d->rs2], d->funct3);
+        NEXT();
+    HANDLER(beq, UOP_BEQ)
+        if (reg[d->rs1] == reg[d->rs2]) {
+            perf_count(perf, OPCLASS_BRANCH, 0, true);
+            JUMP(pc + (uint64_t)(int64_t)(d->imm / 2));
+        }
+        perf_count(perf, OPCLASS_BRANCH, 0, false);
+        NEXT();
+
+#ifdef THREADED_COMPUTED_GOTO
+halt:
+    free(code);
+#else
+        }
+    }
+#endif
+#undef HANDLER
+#undef DISPATCH
+#undef NEXT
+#undef JUMP
+
+    core->PC = pc * 4;
+    core->clk += executed;
+    *instructions = executed;
+    return 0;
+}
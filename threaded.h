@@ -0,0 +1,14 @@
+#ifndef __THREADED_H__
+#define __THREADED_H__
+
+#include "core.h"
+
+// Use computed goto where the compiler supports labels as values
+#if defined(__GNUC__) && !defined(THREADED_USE_SWITCH)
+#define THREADED_COMPUTED_GOTO 1
+#endif
+
+// Function prototypes
+int run_threaded(core_t *core, tick_t *instructions);
+
+#endif
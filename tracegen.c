@@ -0,0 +1,59 @@
+/* Synthetic trace generator.
+ *
+ * Writes a trace of the given workload shape to stdout or a file, in the
+ * instruction syntax the parser accepts.
+ *
+ * Execute as follows:
+ *  $./tracegen [--workload=alu|memory|branchy|straight] [--instructions=N] [--footprint=BYTES]
+ *              [--seed=N] [--output=<trace file>]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "workload.h"
+
+static void usage(const char *prog) {
+    printf("Usage: %s [--workload=alu|memory|branchy|straight] [--instructions=N] [--footprint=BYTES]\n", prog);
+    printf("       %*s [--seed=N] [--output=<trace-file>]\n", (int)strlen(prog), "");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, const char **argv)
+{
+    workload_params_t params;
+    default_workload_params(&params);
+    const char *output = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--workload=", 11) == 0) {
+            if (workload_from_name(argv[i] + 11, &params.kind) != 0)
+                usage(argv[0]);
+        } else if (strncmp(argv[i], "--instructions=", 15) == 0) {
+            params.instructions = strtoull(argv[i] + 15, NULL, 10);
+        } else if (strncmp(argv[i], "--footprint=", 12) == 0) {
+            params.footprint = strtoull(argv[i] + 12, NULL, 10);
+        } else if (strncmp(argv[i], "--seed=", 7) == 0) {
+            params.seed = (unsigned)strtoul(argv[i] + 7, NULL, 10);
+        } else if (strncmp(argv[i], "--output=", 9) == 0) {
+            output = argv[i] + 9;
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    FILE *out = stdout;
+    if (output != NULL && (out = fopen(output, "w")) == NULL) {
+        perror("Cannot open output file.");
+        return EXIT_FAILURE;
+    }
+    int status = generate_workload(out, &params);
+    if (out != stdout && fclose(out) != 0)
+        status = -1;
+    if (status != 0) {
+        fprintf(stderr, "Cannot generate the trace: write error, or a footprint that is not a power of two.\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
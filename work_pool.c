@@ -0,0 +1,137 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "work_pool.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Per-worker deque of job indices [begin, end). The owner takes jobs from
+// the front; idle workers steal the back half. Padded to its own cache line.
+typedef struct {
+    pthread_mutex_t lock;
+    size_t begin;
+    size_t end;
+    char pad[64];
+} work_deque_t;
+
+typedef struct {
+    work_deque_t *deques;
+    unsigned num_threads;
+    work_fn_t fn;
+    void *ctx;
+} work_pool_t;
+
+typedef struct {
+    work_pool_t *pool;
+    unsigned id;
+} worker_arg_t;
+
+unsigned default_num_threads(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (unsigned)n : 1;
+}
+
+// Take the next job from the worker's own deque
+static int pop_job(work_deque_t *deque, size_t *job) {
+    int found = 0;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->begin < deque->end) {
+        *job = deque->begin++;
+        found = 1;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+// Move the back half of a victim's jobs into the thief's deque
+static int steal_jobs(work_deque_t *victim, work_deque_t *thief) {
+    size_t begin = 0, end = 0;
+
+    pthread_mutex_lock(&victim->lock);
+    size_t remaining = victim->end - victim->begin;
+    if (remaining > 0) {
+        end = victim->end;
+        begin = end - (remaining + 1) / 2;
+        victim->end = begin;
+    }
+    pthread_mutex_unlock(&victim->lock);
+
+    if (begin == end)
+        return 0;
+
+    pthread_mutex_lock(&thief->lock);
+    thief->begin = begin;
+    thief->end = end;
+    pthread_mutex_unlock(&thief->lock);
+    return 1;
+}
+
+static void *worker_main(void *arg) {
+    worker_arg_t *worker = (worker_arg_t *)arg;
+    work_pool_t *pool = worker->pool;
+    work_deque_t *own = &pool->deques[worker->id];
+    size_t job;
+
+    for (;;) {
+        while (pop_job(own, &job))
+            pool->fn(job, worker->id, pool->ctx);
+
+        // Jobs are never added, so one sweep without a steal means we are done
+        int stolen = 0;
+        for (unsigned i = 1; i < pool->num_threads && !stolen; i++)
+            stolen = steal_jobs(&pool->deques[(worker->id + i) % pool->num_threads], own);
+        if (!stolen)
+            break;
+    }
+    return NULL;
+}
+
+// Run fn for every job in [0, num_jobs) on num_threads worker threads and
+// wait for all of them. Returns 0 on success, -1 if some threads could not
+// be started; their jobs are stolen by the others, so every job still runs.
+int run_work_pool(size_t num_jobs, unsigned num_threads, work_fn_t fn, void *ctx) {
+    if (num_threads == 0)
+        num_threads = default_num_threads();
+    if (num_threads > num_jobs)
+        num_threads = num_jobs ? (unsigned)num_jobs : 1;
+
+    work_pool_t pool = { NULL, num_threads, fn, ctx };
+    pool.deques = (work_deque_t *)calloc(num_threads, sizeof(work_deque_t));
+    worker_arg_t *args = (worker_arg_t *)calloc(num_threads, sizeof(worker_arg_t));
+    pthread_t *threads = (pthread_t *)calloc(num_threads, sizeof(pthread_t));
+    if (pool.deques == NULL || args == NULL || threads == NULL) {
+        free(pool.deques);
+        free(args);
+        free(threads);
+        return -1;
+    }
+
+    // Start with an even split of the job range
+    for (unsigned i = 0; i < num_threads; i++) {
+        pthread_mutex_init(&pool.deques[i].lock, NULL);
+        pool.deques[i].begin = num_jobs * i / num_threads;
+        pool.deques[i].end = num_jobs * (i + 1) / num_threads;
+        args[i].pool = &pool;
+        args[i].id = i;
+    }
+
+    // Worker 0 runs on the calling thread
+    int status = 0;
+    unsigned started = 1;
+    for (unsigned i = 1; i < num_threads; i++, started++) {
+        if (pthread_create(&threads[i], NULL, worker_main, &args[i]) != 0) {
+            status = -1;
+            break;
+        }
+    }
+    worker_main(&args[0]);
+    for (unsigned i = 1; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    for (unsigned i = 0; i < num_threads; i++)
+        pthread_mutex_destroy(&pool.deques[i].lock);
+    free(pool.deques);
+    free(args);
+    free(threads);
+    return status;
+}
@@ -0,0 +1,13 @@
+#ifndef __WORK_POOL_H__
+#define __WORK_POOL_H__
+
+#include <stddef.h>
+
+// Job callback: runs job number `job` on worker thread `worker`
+typedef void (*work_fn_t)(size_t job, unsigned worker, void *ctx);
+
+// Function prototypes
+unsigned default_num_threads(void);
+int run_work_pool(size_t num_jobs, unsigned num_threads, work_fn_t fn, void *ctx);
+
+#endif
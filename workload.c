@@ -0,0 +1,172 @@
+#include "workload.h"
+#include <string.h>
+
+#define IMM_CHUNK_BITS 11 // Positive addi immediates hold 11 bits
+
+// Register roles. Loop bodies only use x10 and up as scratch.
+#define REG_COUNTER 1
+#define REG_POINTER 2
+#define REG_MASK 3
+#define REG_STATE 4
+#define REG_BIT 5
+#define REG_SCRATCH 10
+#define NUM_SCRATCH 20
+
+static const char *WORKLOAD_NAME[] = {
+    [WORKLOAD_ALU] = "alu",
+    [WORKLOAD_MEMORY] = "memory",
+    [WORKLOAD_BRANCHY] = "branchy",
+    [WORKLOAD_STRAIGHT] = "straight",
+};
+
+void default_workload_params(workload_params_t *params) {
+    params->kind = WORKLOAD_ALU;
+    params->instructions = 10000000;
+    params->footprint = 1 << 16;
+    params->seed = 12345;
+}
+
+int workload_from_name(const char *name, workload_kind_t *kind) {
+    for (size_t i = 0; i < NUM_WORKLOADS; i++) {
+        if (strcmp(name, WORKLOAD_NAME[i]) == 0) {
+            *kind = (workload_kind_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *workload_name(workload_kind_t kind) {
+    return WORKLOAD_NAME[kind];
+}
+
+static unsigned next_random(unsigned *seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
+
+// Load a non-negative constant, 11 bits at a time
+static void emit_constant(FILE *out, unsigned reg, uint64_t value) {
+    unsigned chunks = 1;
+    while (chunks * IMM_CHUNK_BITS < 64 && (value >> (chunks * IMM_CHUNK_BITS)) != 0)
+        chunks++;
+    for (unsigned i = chunks; i-- > 0;) {
+        unsigned chunk = (unsigned)(value >> (i * IMM_CHUNK_BITS)) & ((1u << IMM_CHUNK_BITS) - 1);
+        if (i == chunks - 1) {
+            fprintf(out, "addi x%u, x0, %u\n", reg, chunk);
+        } else {
+            fprintf(out, "slli x%u, x%u, %u\n", reg, reg, IMM_CHUNK_BITS);
+            fprintf(out, "addi x%u, x%u, %u\n", reg, reg, chunk);
+        }
+    }
+}
+
+// One random register-register or register-immediate operation on the
+// scratch registers
+static void emit_alu(FILE *out, unsigned *seed) {
+    unsigned r = next_random(seed);
+    unsigned rd = REG_SCRATCH + r % NUM_SCRATCH;
+    unsigned rs1 = REG_SCRATCH + (r >> 5) % NUM_SCRATCH;
+    unsigned rs2 = REG_SCRATCH + (r >> 10) % NUM_SCRATCH;
+    int imm = (int)((r >> 15) % 256) - 128;
+    switch ((r >> 23) % 6) {
+    case 0: fprintf(out, "add x%u, x%u, x%u\n", rd, rs1, rs2); break;
+    case 1: fprintf(out, "sub x%u, x%u, x%u\n", rd, rs1, rs2); break;
+    case 2: fprintf(out, "and x%u, x%u, x%u\n", rd, rs1, rs2); break;
+    case 3: fprintf(out, "or x%u, x%u, x%u\n", rd, rs1, rs2); break;
+    case 4: fprintf(out, "slli x%u, x%u, %u\n", rd, rs1, (r >> 15) % 8); break;
+    default: fprintf(out, "addi x%u, x%u, %d\n", rd, rs1, imm); break;
+    }
+}
+
+// Loop tail: count down and jump back to the first body instruction. Loops
+// are kept under 16 instructions, the branch offsets the assembler encodes
+// exactly.
+static void emit_loop_end(FILE *out, unsigned body_length) {
+    fprintf(out, "addi x%u, x%u, -1\n", REG_COUNTER, REG_COUNTER);
+    fprintf(out, "beq x%u, x0, 2\n", REG_COUNTER);
+    fprintf(out, "beq x0, x0, -%u\n", body_length + 2);
+}
+
+#define ALU_BODY 10
+
+static void generate_alu(FILE *out, const workload_params_t *params, unsigned seed) {
+    uint64_t iterations = params->instructions / (ALU_BODY + 3) + 1;
+    emit_constant(out, REG_COUNTER, iterations);
+    for (unsigned i = 0; i < ALU_BODY; i++)
+        emit_alu(out, &seed);
+    emit_loop_end(out, ALU_BODY);
+}
+
+// Two loads, an add and a store per element, then advance the pointer and
+// wrap it to the footprint
+static void generate_memory(FILE *out, const workload_params_t *params) {
+    static const char *body[] = {
+        "ld x10, 0(x2)",
+        "ld x11, 8(x2)",
+        "add x12, x10, x11",
+        "addi x12, x12, 1",
+        "sd x12, 16(x2)",
+        "addi x2, x2, 24",
+        "and x2, x2, x3",
+    };
+    unsigned length = sizeof(body) / sizeof(body[0]);
+    uint64_t iterations = params->instructions / (length + 3) + 1;
+    emit_constant(out, REG_COUNTER, iterations);
+    emit_constant(out, REG_MASK, (params->footprint - 1) & ~(uint64_t)7);
+    for (unsigned i = 0; i < length; i++)
+        fprintf(out, "%s\n", body[i]);
+    emit_loop_end(out, length);
+}
+
+// A linear congruential state (x4 = 9 * x4 + 1) decides a forward branch
+// from one of its high bits, so the outcomes follow a long irregular pattern
+static void generate_branchy(FILE *out, const workload_params_t *params) {
+    static const char *body[] = {
+        "slli x10, x4, 3",
+        "add x4, x4, x10",
+        "addi x4, x4, 1",
+        "and x11, x4, x5",
+        "beq x11, x0, 2",
+        "addi x12, x12, 1",
+        "addi x13, x13, 1",
+    };
+    unsigned length = sizeof(body) / sizeof(body[0]);
+    uint64_t iterations = params->instructions / (length + 3) + 1;
+    emit_constant(out, REG_COUNTER, iterations);
+    emit_constant(out, REG_STATE, params->seed);
+    emit_constant(out, REG_BIT, (uint64_t)1 << 20);
+    for (unsigned i = 0; i < length; i++)
+        fprintf(out, "%s\n", body[i]);
+    emit_loop_end(out, length);
+}
+
+static void generate_straight(FILE *out, const workload_params_t *params, unsigned seed) {
+    for (uint64_t i = 0; i < params->instructions; i++)
+        emit_alu(out, &seed);
+}
+
+// Write a trace of the given shape in the syntax the parser accepts.
+// Returns 0 on success, -1 on a write error or invalid parameters.
+int generate_workload(FILE *out, const workload_params_t *params) {
+    unsigned seed = params->seed;
+    switch (params->kind) {
+    case WORKLOAD_ALU:
+        generate_alu(out, params, seed);
+        break;
+    case WORKLOAD_MEMORY:
+        if (params->footprint < 32 || (params->footprint & (params->footprint - 1)) != 0)
+            return -1;
+        generate_memory(out, params);
+        break;
+    case WORKLOAD_BRANCHY:
+        generate_branchy(out, params);
+        break;
+    case WORKLOAD_STRAIGHT:
+        generate_straight(out, params, seed);
+        break;
+    default:
+        return -1;
+    }
+    return ferror(out) ? -1 : 0;
+}
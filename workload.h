@@ -0,0 +1,29 @@
+#ifndef __WORKLOAD_H__
+#define __WORKLOAD_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Synthetic trace shapes
+typedef enum {
+    WORKLOAD_ALU,      // Loop of register and immediate ALU operations
+    WORKLOAD_MEMORY,   // Loop of loads and stores striding through an array
+    WORKLOAD_BRANCHY,  // Loop with a data-dependent forward branch
+    WORKLOAD_STRAIGHT, // Long straight-line ALU code, no branches
+    NUM_WORKLOADS
+} workload_kind_t;
+
+typedef struct {
+    workload_kind_t kind;
+    uint64_t instructions; // Approximate dynamic instruction count
+    uint64_t footprint;    // WORKLOAD_MEMORY: bytes touched, a power of two
+    unsigned seed;         // Register and operand choice
+} workload_params_t;
+
+// Function prototypes
+void default_workload_params(workload_params_t *params);
+int workload_from_name(const char *name, workload_kind_t *kind);
+const char *workload_name(workload_kind_t kind);
+int generate_workload(FILE *out, const workload_params_t *params);
+
+#endif